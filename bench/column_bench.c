@@ -0,0 +1,177 @@
+// Columnar evaluation (vm/columns.h) against the per-row VM. Each workload is
+// one expression over generated columns; the baseline compiles it once and
+// runs the chunk for every row with the row's values stored in the globals.
+// Both results are compared row by row before anything is reported.
+//
+//   tinyscript_column_bench [ROWS]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+#include "vm/columns.h"
+#include "vm/compiler.h"
+#include "vm/vm.h"
+
+#define COLUMN_COUNT 4
+#define RUNS 5
+
+struct workload
+{
+    const char* name;
+    const char* source;
+};
+
+static const struct workload workloads[] = {
+    {"arithmetic", "price * qty - discount * 2 + 1;"},
+    {"filter", "price * qty > 500 && active && discount < 40;"},
+    {"mixed", "!(qty == 0) || (price / (discount + 1) >= 3 != active);"},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+int main(const int argc, const char** argv)
+{
+    const size_t rows = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+    double* price = malloc(rows * sizeof(double));
+    int32_t* qty = malloc(rows * sizeof(int32_t));
+    double* discount = malloc(rows * sizeof(double));
+    uint8_t* active = malloc(rows);
+    double* numbers = malloc(rows * sizeof(double));
+    uint8_t* flags = malloc(rows);
+    uint32_t* selection = malloc(rows * sizeof(uint32_t));
+    if (!price || !qty || !discount || !active || !numbers || !flags || !selection)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    uint64_t state = 1;
+    for (size_t i = 0; i < rows; i++)
+    {
+        price[i] = (double)(next(&state) % 10000) / 100;
+        qty[i] = (int32_t)(next(&state) % 50);
+        discount[i] = (double)(next(&state) % 80);
+        active[i] = (uint8_t)(next(&state) & 1);
+    }
+    const struct column columns[COLUMN_COUNT] = {
+        {"price", COLUMN_DOUBLE, price},
+        {"qty", COLUMN_INT32, qty},
+        {"discount", COLUMN_DOUBLE, discount},
+        {"active", COLUMN_BOOL, active},
+    };
+
+    printf("%-12s %10s %12s %12s %12s %10s\n", "workload", "rows", "vm ns/row", "eval ns/row", "select ns/row",
+           "speedup");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        size_t count;
+        struct lex_token* tokens = parse_text(wl->source, strlen(wl->source), &count);
+        struct ast ast;
+        ast_init(&ast);
+        parse(wl->source, strlen(wl->source), tokens, count, &ast);
+
+        struct column_program program;
+        struct chunk chunk;
+        chunk_init(&chunk);
+        if (!column_compile(&ast, ast.root, columns, COLUMN_COUNT, &program) || !compile(&ast, ast.root, &chunk))
+            return 1;
+
+        // The VM addresses globals by name id; fill them in for every row.
+        // Columns the expression does not use get ids past its own globals.
+        uint32_t slots[COLUMN_COUNT];
+        for (int c = 0; c < COLUMN_COUNT; c++) slots[c] = intern(&ast.names, columns[c].name, strlen(columns[c].name));
+        struct vm vm;
+        vm_init(&vm);
+        vm.global_count = ast.names.count;
+        vm.globals = ts_calloc(vm.global_count, sizeof(struct value));
+        if (!vm.globals) return 1;
+        for (int c = 0; c < COLUMN_COUNT; c++) vm.globals[slots[c]].type = c == 3 ? VAL_BOOL : VAL_NUMBER;
+
+        const int boolean = program.result_type == COLUMN_RESULT_BOOL;
+        size_t mismatches = 0;
+        double start = now();
+        for (size_t i = 0; i < rows; i++)
+        {
+            vm.globals[slots[0]].number = price[i];
+            vm.globals[slots[1]].number = qty[i];
+            vm.globals[slots[2]].number = discount[i];
+            vm.globals[slots[3]].boolean = active[i];
+            struct value result;
+            vm_run(&vm, &chunk, &result);
+            if (boolean) flags[i] = (uint8_t)result.boolean;
+            else numbers[i] = result.number;
+        }
+        const double vm_ns = (now() - start) * 1e9 / (double)rows;
+
+        // Best of a few runs, so page faults on the first write to `check`
+        // are not counted.
+        uint8_t* check = malloc(rows * (boolean ? 1 : sizeof(double)));
+        double eval_ns = 0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            start = now();
+            column_eval(&program, columns, rows, check);
+            const double ns = (now() - start) * 1e9 / (double)rows;
+            if (run == 0 || ns < eval_ns) eval_ns = ns;
+        }
+        if (boolean) for (size_t i = 0; i < rows; i++) mismatches += check[i] != flags[i];
+        else for (size_t i = 0; i < rows; i++) mismatches += ((double*)check)[i] != numbers[i];
+
+        size_t selected = 0;
+        double select_ns = 0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            start = now();
+            selected = column_select(&program, columns, rows, selection);
+            const double ns = (now() - start) * 1e9 / (double)rows;
+            if (run == 0 || ns < select_ns) select_ns = ns;
+        }
+        if (boolean)
+        {
+            size_t expected = 0;
+            for (size_t i = 0; i < rows; i++) expected += flags[i];
+            mismatches += selected != expected;
+        }
+
+        if (mismatches)
+        {
+            fprintf(stderr, "%s: %zu rows differ from the VM\n", wl->name, mismatches);
+            return 1;
+        }
+        printf("%-12s %10zu %12.2f %12.2f %12.2f %9.1fx\n", wl->name, rows, vm_ns, eval_ns,
+               boolean ? select_ns : 0.0, vm_ns / eval_ns);
+
+        free(check);
+        vm_free(&vm);
+        chunk_free(&chunk);
+        column_program_free(&program);
+        free_ast(&ast);
+        ts_free(tokens);
+    }
+    free(price);
+    free(qty);
+    free(discount);
+    free(active);
+    free(numbers);
+    free(flags);
+    free(selection);
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include "corpus.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct generator
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+    uint64_t state;
+    const struct corpus_mix* mix;
+};
+
+// splitmix64: small, fast, and the same on every platform, unlike rand().
+static uint64_t next_random(struct generator* g)
+{
+    uint64_t z = (g->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static unsigned below(struct generator* g, const unsigned n)
+{
+    return (unsigned)(next_random(g) % n);
+}
+
+static void reserve(struct generator* g, const size_t more)
+{
+    if (g->length + more <= g->capacity) return;
+    size_t capacity = g->capacity ? g->capacity : 4096;
+    while (capacity < g->length + more) capacity *= 2;
+    char* data = realloc(g->data, capacity);
+    if (!data)
+    {
+        fprintf(stderr, "Failed to allocate benchmark corpus\n");
+        exit(1);
+    }
+    g->data = data;
+    g->capacity = capacity;
+}
+
+static void emit(struct generator* g, const char* s)
+{
+    const size_t n = strlen(s);
+    reserve(g, n);
+    memcpy(g->data + g->length, s, n);
+    g->length += n;
+}
+
+// Only ever used for short numbers and names.
+static void emitf(struct generator* g, const char* format, ...)
+{
+    char text[64];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    emit(g, text);
+}
+
+static const char* const name_bases[] = {
+    "x", "y", "n", "count", "total", "index", "value", "result", "flag", "items", "threshold_limit", "row_offset",
+};
+
+static const char* const type_names[] = {"Int32", "Int64", "UInt8", "Float", "Double", "Bool", "Char"};
+
+static const char* const binary_operators[] = {
+    " || ", " && ", " == ", " != ", " < ", " > ", " <= ", " >= ", " + ", " - ", " * ", " / ",
+};
+
+static const char* const words[] = {
+    "update", "the", "running", "total", "before", "checking", "limits", "for", "each", "row", "see", "spec",
+};
+
+static void emit_name(struct generator* g)
+{
+    emitf(g, "%s%u", name_bases[below(g, sizeof(name_bases) / sizeof(name_bases[0]))], below(g, 64));
+}
+
+static void emit_number(struct generator* g)
+{
+    switch (below(g, 6))
+    {
+    case 0: emitf(g, "%u.%u", below(g, 1000), below(g, 100));
+        break;
+    case 1: emitf(g, "%ue%d", 1 + below(g, 9), (int)below(g, 20) - 10);
+        break;
+    case 2: emitf(g, "-%u", below(g, 100000));
+        break;
+    default: emitf(g, "%u", below(g, 1000));
+        break;
+    }
+}
+
+static void emit_expression(struct generator* g, unsigned depth);
+
+static void emit_list(struct generator* g, const unsigned depth, const unsigned max_elements)
+{
+    emit(g, "[");
+    const unsigned count = below(g, max_elements + 1);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (i) emit(g, ", ");
+        emit_expression(g, depth);
+    }
+    emit(g, "]");
+}
+
+static void emit_primary(struct generator* g, const unsigned depth)
+{
+    switch (depth ? below(g, 8) : below(g, 5))
+    {
+    case 0:
+    case 1: emit_number(g);
+        break;
+    case 2: emit(g, below(g, 2) ? "true" : "false");
+        break;
+    case 3:
+    case 4: emit_name(g);
+        break;
+    case 5:
+    case 6:
+        emit(g, "(");
+        emit_expression(g, depth - 1);
+        emit(g, ")");
+        break;
+    default: emit_list(g, depth - 1, 4);
+        break;
+    }
+}
+
+static void emit_expression(struct generator* g, const unsigned depth)
+{
+    const unsigned pick = below(g, 8);
+    if (depth == 0 || pick < 2)
+    {
+        emit_primary(g, depth ? depth - 1 : 0);
+    }
+    else if (pick == 2)
+    {
+        // The grammar only puts a unary operator in front of a primary.
+        emit(g, below(g, 2) ? "!" : "-");
+        emit_primary(g, depth - 1);
+    }
+    else
+    {
+        emit_expression(g, depth - 1);
+        emit(g, binary_operators[below(g, sizeof(binary_operators) / sizeof(binary_operators[0]))]);
+        emit_expression(g, depth - 1);
+    }
+}
+
+static void emit_type(struct generator* g, const unsigned depth)
+{
+    if (depth == 0 || below(g, 3))
+    {
+        emit(g, type_names[below(g, sizeof(type_names) / sizeof(type_names[0]))]);
+        return;
+    }
+    emit(g, "List<");
+    const unsigned count = 1 + below(g, 2);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (i) emit(g, ", ");
+        emit_type(g, depth - 1);
+    }
+    emit(g, ">");
+}
+
+static void emit_indent(struct generator* g, const unsigned level)
+{
+    for (unsigned i = 0; i < level; i++) emit(g, "    ");
+}
+
+static void emit_words(struct generator* g)
+{
+    const unsigned count = 2 + below(g, 8);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (i) emit(g, " ");
+        emit(g, words[below(g, sizeof(words) / sizeof(words[0]))]);
+    }
+}
+
+static void emit_statement(struct generator* g, unsigned level);
+
+static void emit_block(struct generator* g, const unsigned level)
+{
+    emit(g, "{\n");
+    const unsigned count = 1 + below(g, 3);
+    for (unsigned i = 0; i < count; i++) emit_statement(g, level + 1);
+    emit_indent(g, level);
+    emit(g, "}");
+}
+
+static void emit_if(struct generator* g, const unsigned level)
+{
+    emit(g, "if (");
+    emit_expression(g, g->mix->depth / 2);
+    emit(g, ") ");
+    emit_block(g, level);
+    const unsigned tail = below(g, 3);
+    if (tail == 1)
+    {
+        emit(g, " else ");
+        emit_block(g, level);
+    }
+    else if (tail == 2)
+    {
+        emit(g, " else ");
+        emit_if(g, level);
+    }
+}
+
+static void emit_statement(struct generator* g, const unsigned level)
+{
+    const struct corpus_mix* mix = g->mix;
+    // Blocks stop nesting ifs past half the depth.
+    const unsigned ifs = level < (mix->depth + 1) / 2 ? mix->ifs : 0;
+    const unsigned weights[] = {
+        mix->declarations, mix->assignments, mix->expressions, mix->lists, ifs, mix->comments, mix->strings,
+    };
+    unsigned total = 0;
+    for (size_t i = 0; i < sizeof(weights) / sizeof(weights[0]); i++) total += weights[i];
+    // A mix of nothing but ifs still has to bottom out inside blocks, so an
+    // empty mix falls back to expression statements.
+    size_t kind = 2;
+    if (total)
+    {
+        unsigned pick = below(g, total);
+        kind = 0;
+        while (pick >= weights[kind]) pick -= weights[kind++];
+    }
+
+    emit_indent(g, level);
+    switch (kind)
+    {
+    case 0:
+        emit(g, "var ");
+        emit_name(g);
+        emit(g, " ");
+        emit_type(g, mix->depth / 2);
+        if (below(g, 4))
+        {
+            emit(g, " := ");
+            emit_expression(g, mix->depth);
+        }
+        emit(g, ";\n");
+        break;
+    case 1:
+        emit_name(g);
+        emit(g, " = ");
+        emit_expression(g, mix->depth);
+        emit(g, ";\n");
+        break;
+    case 2:
+        emit_expression(g, mix->depth);
+        emit(g, ";\n");
+        break;
+    case 3:
+        emit_name(g);
+        emit(g, " = ");
+        emit_list(g, mix->depth / 2, 16);
+        emit(g, ";\n");
+        break;
+    case 4:
+        emit_if(g, level);
+        emit(g, "\n");
+        break;
+    case 5:
+        emit(g, "# ");
+        emit_words(g);
+        emit(g, "\n");
+        break;
+    default:
+        emit(g, "# message \"");
+        emit_words(g);
+        emit(g, below(g, 2) ? "\\n\"\n" : " \\\"quoted\\\"\"\n");
+        break;
+    }
+}
+
+void corpus_default_mix(struct corpus_mix* mix)
+{
+    mix->declarations = 4;
+    mix->assignments = 3;
+    mix->expressions = 2;
+    mix->lists = 1;
+    mix->ifs = 2;
+    mix->comments = 1;
+    mix->strings = 1;
+    mix->depth = 6;
+}
+
+struct mix_key
+{
+    const char* name;
+    size_t offset;
+};
+
+static const struct mix_key mix_keys[] = {
+    {"decl", offsetof(struct corpus_mix, declarations)},
+    {"assign", offsetof(struct corpus_mix, assignments)},
+    {"expr", offsetof(struct corpus_mix, expressions)},
+    {"list", offsetof(struct corpus_mix, lists)},
+    {"if", offsetof(struct corpus_mix, ifs)},
+    {"comment", offsetof(struct corpus_mix, comments)},
+    {"string", offsetof(struct corpus_mix, strings)},
+    {"depth", offsetof(struct corpus_mix, depth)},
+};
+
+int corpus_parse_mix(const char* spec, struct corpus_mix* mix)
+{
+    while (*spec)
+    {
+        const char* equals = strchr(spec, '=');
+        if (!equals) return 0;
+        const size_t key_length = (size_t)(equals - spec);
+        const struct mix_key* key = NULL;
+        for (size_t i = 0; i < sizeof(mix_keys) / sizeof(mix_keys[0]); i++)
+        {
+            if (strlen(mix_keys[i].name) == key_length && memcmp(mix_keys[i].name, spec, key_length) == 0)
+                key = &mix_keys[i];
+        }
+        char* end;
+        const unsigned long value = strtoul(equals + 1, &end, 10);
+        if (!key || end == equals + 1 || (*end && *end != ',') || value > 1000) return 0;
+        *(unsigned*)((char*)mix + key->offset) = (unsigned)value;
+        spec = *end ? end + 1 : end;
+    }
+    return 1;
+}
+
+void corpus_format_mix(const struct corpus_mix* mix, char* out, const size_t size)
+{
+    size_t used = 0;
+    if (size) out[0] = '\0';
+    for (size_t i = 0; i < sizeof(mix_keys) / sizeof(mix_keys[0]) && used < size; i++)
+    {
+        const unsigned value = *(const unsigned*)((const char*)mix + mix_keys[i].offset);
+        const int n = snprintf(out + used, size - used, "%s%s=%u", i ? "," : "", mix_keys[i].name, value);
+        if (n < 0) break;
+        used += (size_t)n;
+    }
+}
+
+char* corpus_generate(const size_t size, const uint64_t seed, const struct corpus_mix* mix, size_t* length)
+{
+    struct generator g = {.state = seed, .mix = mix};
+    reserve(&g, size + 256);
+    while (g.length < size) emit_statement(&g, 0);
+    *length = g.length;
+    return g.data;
+}
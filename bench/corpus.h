@@ -0,0 +1,37 @@
+#ifndef TS_CORPUS_H
+#define TS_CORPUS_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Deterministic generator of synthetic TinyScript programs following
+// spec/grammar.ebnf. The same size, seed and mix always give the same bytes,
+// so results stay comparable across versions.
+
+// Relative weights of each kind of top-level line, and how deep expressions,
+// types and blocks may nest.
+struct corpus_mix
+{
+    unsigned declarations; // var name Type<...> := expression;
+    unsigned assignments; // name = expression;
+    unsigned expressions; // expression;
+    unsigned lists; // name = [ ... ]; with many elements
+    unsigned ifs; // if / else if / else with nested statements
+    unsigned comments; // # plain text
+    // The grammar has no expression that takes a string, so string literals
+    // appear inside comments, which keeps every corpus parseable.
+    unsigned strings;
+    unsigned depth; // expression nesting; blocks and types nest half as deep
+};
+
+void corpus_default_mix(struct corpus_mix* mix);
+// Overrides fields of `mix` from a list like "decl=4,if=0,depth=8". Keys are
+// decl, assign, expr, list, if, comment, string and depth. Returns 0 on an
+// unknown key or a bad number.
+int corpus_parse_mix(const char* spec, struct corpus_mix* mix);
+// Writes `mix` as "decl=4,assign=3,..." into `out`, the form
+// corpus_parse_mix() reads.
+void corpus_format_mix(const struct corpus_mix* mix, char* out, size_t size);
+// Generates whole statements until the text is at least `size` bytes long.
+// Returns a heap buffer and its length in `*length`.
+char* corpus_generate(size_t size, uint64_t seed, const struct corpus_mix* mix, size_t* length);
+#endif
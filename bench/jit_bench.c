@@ -0,0 +1,288 @@
+// The x86-64 JIT (vm/jit.h) against the bytecode VM. Before timing anything
+// it checks the JIT differentially: random expressions over three slots,
+// including ones the JIT hands back to the VM, must give the same status
+// and the same value as the VM for random slot values. Then each workload is
+// compiled once both ways and evaluated once per row.
+//
+//   tinyscript_jit_bench [--check N] [--rows N] [--seed N]
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+#include "vm/compiler.h"
+#include "vm/jit.h"
+#include "vm/vm.h"
+
+#define SLOT_COUNT 3
+#define VALUES 64
+
+static const char* const slot_names[SLOT_COUNT] = {"x", "y", "z"};
+
+struct workload
+{
+    const char* name;
+    const char* source;
+};
+
+static const struct workload workloads[] = {
+    {"polynomial", "((x * x + y) * x - 3 * y) * (z + 1) - (x - y) / 4;"},
+    {"predicate", "x * y > 100 && z != 0 || !(x < 5) && y - z <= 20;"},
+    {"mixed", "(x + y + z) / 3 >= 10 == (x * 2 < y);"},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+struct text
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+static void append(struct text* text, const char* s)
+{
+    const size_t length = strlen(s);
+    if (text->length + length + 1 > text->capacity)
+    {
+        text->capacity = (text->length + length + 1) * 2;
+        text->data = realloc(text->data, text->capacity);
+        if (!text->data) abort();
+    }
+    memcpy(text->data + text->length, s, length + 1);
+    text->length += length;
+}
+
+// A random expression of the given depth. Slots, small numbers and booleans
+// mix freely, so some expressions have type errors the VM reports; names
+// other than the slots leave the JIT to fall back.
+static void generate(struct text* text, uint64_t* state, const int depth)
+{
+    static const char* const leaves[] = {"x", "y", "z", "0", "1", "2.5", "-3", "true", "false", "w"};
+    static const char* const operators[] = {" + ", " - ", " * ", " / ", " < ", " <= ", " > ",
+                                            " >= ", " == ", " != ", " && ", " || "};
+    const uint64_t pick = next(state) % 16;
+    if (depth == 0 || pick < 3)
+    {
+        // "w" is rare, so most expressions compile natively.
+        const uint64_t leaf = next(state) % 64;
+        append(text, leaves[leaf < 63 ? leaf % 9 : 9]);
+        return;
+    }
+    if (pick < 5)
+    {
+        append(text, pick == 3 ? "!(" : "-(");
+        generate(text, state, depth - 1);
+        append(text, ")");
+        return;
+    }
+    append(text, "(");
+    generate(text, state, depth - 1);
+    append(text, operators[next(state) % 12]);
+    generate(text, state, depth - 1);
+    append(text, ")");
+}
+
+static int same(const enum vm_status a_status, const struct value* a, const enum vm_status b_status,
+                const struct value* b)
+{
+    if (a_status != b_status) return 0;
+    if (a_status != VM_OK) return 1;
+    if (a->type != b->type) return 0;
+    if (a->type == VAL_BOOL) return a->boolean == b->boolean;
+    if (a->type != VAL_NUMBER) return 1;
+    return memcmp(&a->number, &b->number, sizeof(double)) == 0 || (isnan(a->number) && isnan(b->number));
+}
+
+// The reference: the expression's own chunk on a VM whose globals hold the
+// slot values.
+struct reference
+{
+    struct chunk chunk;
+    struct vm vm;
+    uint32_t ids[SLOT_COUNT];
+};
+
+static int reference_init(struct reference* ref, struct ast* ast)
+{
+    chunk_init(&ref->chunk);
+    if (!compile(ast, ast->root, &ref->chunk)) return 0;
+    for (int s = 0; s < SLOT_COUNT; s++) ref->ids[s] = intern(&ast->names, slot_names[s], strlen(slot_names[s]));
+    vm_init(&ref->vm);
+    ref->vm.global_count = ast->names.count;
+    ref->vm.globals = ts_calloc(ast->names.count, sizeof(struct value));
+    if (!ref->vm.globals) abort();
+    for (int s = 0; s < SLOT_COUNT; s++) ref->vm.globals[ref->ids[s]].type = VAL_NUMBER;
+    return 1;
+}
+
+static enum vm_status reference_eval(struct reference* ref, const double* slots, struct value* result)
+{
+    for (int s = 0; s < SLOT_COUNT; s++) ref->vm.globals[ref->ids[s]].number = slots[s];
+    return vm_run(&ref->vm, &ref->chunk, result);
+}
+
+static void reference_free(struct reference* ref)
+{
+    vm_free(&ref->vm);
+    chunk_free(&ref->chunk);
+}
+
+static int parse_source(const char* source, struct ast* ast, struct lex_token** tokens)
+{
+    size_t count;
+    *tokens = parse_text(source, strlen(source), &count);
+    ast_init(ast);
+    return *tokens && parse(source, strlen(source), *tokens, count, ast);
+}
+
+static int check(const int expressions, uint64_t* state)
+{
+    // Errors from expressions the VM rejects are expected; keep them quiet.
+    fflush(stderr);
+    const int saved = dup(STDERR_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null < 0) return 0;
+    dup2(null, STDERR_FILENO);
+    close(null);
+    int native = 0, fallback = 0, failures = 0;
+    struct text text = {0};
+    for (int e = 0; e < expressions && failures < 5; e++)
+    {
+        text.length = 0;
+        generate(&text, state, 1 + (int)(next(state) % 6));
+        append(&text, ";");
+        struct ast ast;
+        struct lex_token* tokens;
+        struct jit_expression jit;
+        struct reference ref;
+        if (!parse_source(text.data, &ast, &tokens) || !jit_compile(&ast, ast.root, slot_names, SLOT_COUNT, &jit))
+        {
+            free_ast(&ast);
+            ts_free(tokens);
+            continue;
+        }
+        if (jit.native) native++;
+        else fallback++;
+        reference_init(&ref, &ast);
+        for (int v = 0; v < VALUES; v++)
+        {
+            double slots[SLOT_COUNT];
+            for (int s = 0; s < SLOT_COUNT; s++) slots[s] = (double)((int64_t)(next(state) % 9) - 4) / 2;
+            struct value expected, actual;
+            const enum vm_status expected_status = reference_eval(&ref, slots, &expected);
+            const enum vm_status actual_status = jit_eval(&jit, slots, &actual);
+            if (!same(expected_status, &expected, actual_status, &actual))
+            {
+                printf("JIT differs from the VM on %s with x=%g y=%g z=%g\n", text.data, slots[0], slots[1],
+                       slots[2]);
+                failures++;
+                break;
+            }
+        }
+        reference_free(&ref);
+        jit_free(&jit);
+        free_ast(&ast);
+        ts_free(tokens);
+    }
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    free(text.data);
+    printf("check: %d native, %d fallback, %d failures\n", native, fallback, failures);
+    return failures == 0;
+}
+
+int main(const int argc, const char** argv)
+{
+    int expressions = 5000;
+    size_t rows = 1 << 22;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        const int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--check") == 0 && has_value) expressions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rows") == 0 && has_value) rows = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = strtoull(argv[++i], NULL, 10);
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    uint64_t state = seed;
+    if (!check(expressions, &state)) return 1;
+
+    double* values = malloc(rows * SLOT_COUNT * sizeof(double));
+    if (!values) return 1;
+    for (size_t i = 0; i < rows * SLOT_COUNT; i++) values[i] = (double)(next(&state) % 40);
+
+    printf("%-12s %10s %12s %12s %8s\n", "workload", "rows", "vm ns/row", "jit ns/row", "speedup");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        struct ast ast;
+        struct lex_token* tokens;
+        struct jit_expression jit;
+        struct reference ref;
+        if (!parse_source(wl->source, &ast, &tokens) || !jit_compile(&ast, ast.root, slot_names, SLOT_COUNT, &jit))
+            return 1;
+        if (!jit.native)
+        {
+            fprintf(stderr, "%s: not compiled natively\n", wl->name);
+            return 1;
+        }
+        reference_init(&ref, &ast);
+
+        // Sums keep the loops from being optimized away.
+        double vm_sum = 0, jit_sum = 0;
+        struct value result;
+        double start = now();
+        for (size_t i = 0; i < rows; i++)
+        {
+            reference_eval(&ref, &values[i * SLOT_COUNT], &result);
+            vm_sum += result.type == VAL_BOOL ? result.boolean : result.number;
+        }
+        const double vm_ns = (now() - start) * 1e9 / (double)rows;
+        start = now();
+        for (size_t i = 0; i < rows; i++)
+        {
+            jit_eval(&jit, &values[i * SLOT_COUNT], &result);
+            jit_sum += result.type == VAL_BOOL ? result.boolean : result.number;
+        }
+        const double jit_ns = (now() - start) * 1e9 / (double)rows;
+        if (vm_sum != jit_sum)
+        {
+            fprintf(stderr, "%s: results differ from the VM\n", wl->name);
+            return 1;
+        }
+        printf("%-12s %10zu %12.2f %12.2f %7.1fx\n", wl->name, rows, vm_ns, jit_ns, vm_ns / jit_ns);
+
+        reference_free(&ref);
+        jit_free(&jit);
+        free_ast(&ast);
+        ts_free(tokens);
+    }
+    free(values);
+    return 0;
+}
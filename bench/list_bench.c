@@ -0,0 +1,189 @@
+// Element-wise list operations (packed lists, vm/packed.h) against the
+// per-row VM. Each workload is one expression over lists a, b and c; the
+// packed run stores the lists in the globals and evaluates the expression
+// once, the baseline runs its chunk for every element with that element's
+// numbers in the globals. Both results are compared element by element, and
+// then the reductions are timed against a loop over boxed values.
+// TS_DISABLE_SIMD=1 runs the scalar kernels instead.
+//
+//   tinyscript_list_bench [ELEMENTS]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+#include "vm/compiler.h"
+#include "vm/vm.h"
+
+#define LIST_COUNT 3
+#define RUNS 5
+
+static const char* const list_names[LIST_COUNT] = {"a", "b", "c"};
+
+struct workload
+{
+    const char* name;
+    const char* source;
+};
+
+static const struct workload workloads[] = {
+    {"scale", "a * 2 + b;"},
+    {"polynomial", "(a * a - b) * c / 4 + 1;"},
+    {"compare", "a * b - c / 4 < a + 1;"},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static int bench_reductions(const double* numbers, const size_t count)
+{
+    struct vm vm;
+    vm_init(&vm);
+    const struct value packed = vm_number_list(&vm, numbers, (uint32_t)count);
+    struct value* boxed = malloc(count * sizeof(struct value));
+    if (!boxed) return 0;
+    for (size_t i = 0; i < count; i++) boxed[i] = (struct value){.type = VAL_NUMBER, .number = numbers[i]};
+
+    static const char* const names[] = {"sum", "min", "max"};
+    printf("\n%-12s %10s %12s %12s %8s\n", "reduction", "elements", "boxed ns/el", "packed ns/el", "speedup");
+    for (int r = REDUCE_SUM; r <= REDUCE_MAX; r++)
+    {
+        double boxed_ns = 0, packed_ns = 0, expected = 0, actual = 0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            double start = now();
+            expected = r == REDUCE_SUM ? 0 : boxed[0].number;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (boxed[i].type != VAL_NUMBER) return 0;
+                const double x = boxed[i].number;
+                if (r == REDUCE_SUM) expected += x;
+                else if (r == REDUCE_MIN ? x < expected : x > expected) expected = x;
+            }
+            const double ns = (now() - start) * 1e9 / (double)count;
+            if (run == 0 || ns < boxed_ns) boxed_ns = ns;
+
+            start = now();
+            if (!list_reduce(packed.list, r, &actual)) return 0;
+            const double packed_run = (now() - start) * 1e9 / (double)count;
+            if (run == 0 || packed_run < packed_ns) packed_ns = packed_run;
+        }
+        // The elements are integers, so even the sum is exact in any order.
+        if (actual != expected)
+        {
+            fprintf(stderr, "%s: %g, expected %g\n", names[r], actual, expected);
+            return 0;
+        }
+        printf("%-12s %10zu %12.2f %12.2f %7.1fx\n", names[r], count, boxed_ns, packed_ns, boxed_ns / packed_ns);
+    }
+    free(boxed);
+    vm_free(&vm);
+    return 1;
+}
+
+int main(const int argc, const char** argv)
+{
+    const size_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+    if (count == 0 || count > UINT32_MAX) return 1;
+    double* numbers[LIST_COUNT];
+    double* expected_numbers = malloc(count * sizeof(double));
+    uint8_t* expected_flags = malloc(count);
+    if (!expected_numbers || !expected_flags) return 1;
+    uint64_t state = 1;
+    for (int l = 0; l < LIST_COUNT; l++)
+    {
+        numbers[l] = malloc(count * sizeof(double));
+        if (!numbers[l]) return 1;
+        for (size_t i = 0; i < count; i++) numbers[l][i] = (double)(next(&state) % 2000) - 1000;
+    }
+
+    printf("%-12s %10s %12s %12s %8s\n", "workload", "elements", "vm ns/el", "packed ns/el", "speedup");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        size_t token_count;
+        struct lex_token* tokens = parse_text(wl->source, strlen(wl->source), &token_count);
+        struct ast ast;
+        ast_init(&ast);
+        parse(wl->source, strlen(wl->source), tokens, token_count, &ast);
+        struct chunk chunk;
+        chunk_init(&chunk);
+        if (!compile(&ast, ast.root, &chunk)) return 1;
+
+        uint32_t slots[LIST_COUNT];
+        for (int l = 0; l < LIST_COUNT; l++) slots[l] = intern(&ast.names, list_names[l], strlen(list_names[l]));
+        struct vm vm;
+        vm_init(&vm);
+        vm.global_count = ast.names.count;
+        vm.globals = ts_calloc(vm.global_count, sizeof(struct value));
+        if (!vm.globals) return 1;
+
+        // Per element: the numbers go into the globals one row at a time.
+        int boolean = 0;
+        double start = now();
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int l = 0; l < LIST_COUNT; l++)
+                vm.globals[slots[l]] = (struct value){.type = VAL_NUMBER, .number = numbers[l][i]};
+            struct value result;
+            if (vm_run(&vm, &chunk, &result) != VM_OK) return 1;
+            boolean = result.type == VAL_BOOL;
+            if (boolean) expected_flags[i] = (uint8_t)result.boolean;
+            else expected_numbers[i] = result.number;
+        }
+        const double vm_ns = (now() - start) * 1e9 / (double)count;
+
+        for (int l = 0; l < LIST_COUNT; l++)
+            vm.globals[slots[l]] = vm_number_list(&vm, numbers[l], (uint32_t)count);
+        double packed_ns = 0;
+        struct value result;
+        for (int run = 0; run < RUNS; run++)
+        {
+            start = now();
+            if (vm_run(&vm, &chunk, &result) != VM_OK) return 1;
+            const double ns = (now() - start) * 1e9 / (double)count;
+            if (run == 0 || ns < packed_ns) packed_ns = ns;
+        }
+
+        size_t mismatches = result.type != VAL_LIST || result.list->length != count ||
+                            result.list->kind != (boolean ? LIST_BOOLS : LIST_NUMBERS);
+        for (size_t i = 0; i < count && !mismatches; i++)
+        {
+            if (boolean) mismatches += result.list->bools[i] != expected_flags[i];
+            else mismatches += result.list->numbers[i] != expected_numbers[i];
+        }
+        if (mismatches)
+        {
+            fprintf(stderr, "%s: elements differ from the per-row VM\n", wl->name);
+            return 1;
+        }
+        printf("%-12s %10zu %12.2f %12.2f %7.1fx\n", wl->name, count, vm_ns, packed_ns, vm_ns / packed_ns);
+
+        vm_free(&vm);
+        chunk_free(&chunk);
+        free_ast(&ast);
+        ts_free(tokens);
+    }
+
+    if (!bench_reductions(numbers[0], count)) return 1;
+    for (int l = 0; l < LIST_COUNT; l++) free(numbers[l]);
+    free(expected_numbers);
+    free(expected_flags);
+    return 0;
+}
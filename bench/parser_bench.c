@@ -0,0 +1,311 @@
+// Micro-benchmarks for the parser. Each workload is a generated program that
+// is lexed once and parsed many times into a reused AST, so only parse()
+// itself is timed.
+//
+// With --traverse, each workload is instead parsed once at a larger size and
+// the flat AST is walked three ways: recursively through a copy built as
+// malloc'd pointer nodes, recursively by index, and by a linear scan of the
+// node array. All three visit the same nodes and must agree on a checksum.
+//
+//   tinyscript_parser_bench [--traverse [STATEMENTS]]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+
+#define STATEMENTS 20000
+
+struct workload
+{
+    const char* name;
+    // Writes one statement into `out` and returns its length.
+    int (*statement)(char* out, size_t size, int i);
+    int iterations;
+};
+
+// Bare operands: no operators at all, so every literal pays only for the
+// trip from parse_expression down to the primary.
+static int flat_statement(char* out, const size_t size, const int i)
+{
+    return snprintf(out, size, "[%d, x, true, %d.5, y, false, %d];\n", i, i, i % 7);
+}
+
+// Long runs of operators at every precedence level.
+static int chained_statement(char* out, const size_t size, const int i)
+{
+    return snprintf(out, size, "var v%d Int32 := a + %d * b - c / 2 < d && e == f || g >= %d + h * i - j;\n",
+                    i % 100, i, i);
+}
+
+// Parenthesized nesting, each level restarting the expression grammar.
+static int nested_statement(char* out, const size_t size, const int i)
+{
+    return snprintf(out, size, "((((((((x + %d) * 2) - y) / 3) < z) == true) && (w || !v)) != false);\n", i);
+}
+
+static const struct workload workloads[] = {
+    {"flat", flat_statement, 40},
+    {"chained", chained_statement, 40},
+    {"nested", nested_statement, 40},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static char* generate(const struct workload* wl, const int statements, size_t* length)
+{
+    size_t capacity = 1 << 20, used = 0;
+    char* source = malloc(capacity);
+    for (int i = 0; i < statements && source; i++)
+    {
+        char line[256];
+        const int n = wl->statement(line, sizeof(line), i);
+        if (used + (size_t)n > capacity)
+        {
+            capacity *= 2;
+            source = realloc(source, capacity);
+            if (!source) break;
+        }
+        memcpy(source + used, line, (size_t)n);
+        used += (size_t)n;
+    }
+    if (!source)
+    {
+        fprintf(stderr, "Failed to allocate benchmark source\n");
+        exit(1);
+    }
+    *length = used;
+    return source;
+}
+
+// The same tree as the classic pointer layout: one malloc'd 32-byte node
+// per AST node. An if keeps its else branch in `items`.
+struct pointer_node
+{
+    uint8_t type;
+    uint8_t op;
+    uint32_t count;
+    struct pointer_node* left;
+    struct pointer_node* right;
+    struct pointer_node** items;
+};
+
+static struct pointer_node* build_pointer_tree(const struct ast* ast, const uint32_t index)
+{
+    if (!index) return NULL;
+    const struct ast_node* n = &ast->nodes[index];
+    struct pointer_node* p = calloc(1, sizeof(struct pointer_node));
+    if (!p) exit(1);
+    p->type = n->type;
+    p->op = n->op;
+    uint32_t first = 0;
+    switch (n->type)
+    {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+        first = n->block.first;
+        p->count = n->block.count;
+        break;
+    case AST_TYPE:
+        first = n->type_annotation.first;
+        p->count = n->type_annotation.count;
+        break;
+    case AST_LIST:
+        first = n->list.first;
+        p->count = n->list.count;
+        break;
+    case AST_IF:
+        p->left = build_pointer_tree(ast, n->if_statement.condition);
+        p->right = build_pointer_tree(ast, n->if_statement.then_branch);
+        if (n->if_statement.else_branch)
+        {
+            p->count = 1;
+            p->items = malloc(sizeof(struct pointer_node*));
+            if (!p->items) exit(1);
+            p->items[0] = build_pointer_tree(ast, n->if_statement.else_branch);
+        }
+        return p;
+    case AST_ASSIGNMENT:
+        p->left = build_pointer_tree(ast, n->assignment.expression);
+        return p;
+    case AST_DECLARATION:
+        p->left = build_pointer_tree(ast, n->declaration.type);
+        p->right = build_pointer_tree(ast, n->declaration.expression);
+        return p;
+    case AST_UNARY:
+        p->left = build_pointer_tree(ast, n->unary.operand);
+        return p;
+    case AST_BINARY:
+        p->left = build_pointer_tree(ast, n->binary.left);
+        p->right = build_pointer_tree(ast, n->binary.right);
+        return p;
+    default:
+        return p;
+    }
+    if (p->count)
+    {
+        p->items = malloc(p->count * sizeof(struct pointer_node*));
+        if (!p->items) exit(1);
+        for (uint32_t i = 0; i < p->count; i++) p->items[i] = build_pointer_tree(ast, ast->children[first + i]);
+    }
+    return p;
+}
+
+static void free_pointer_tree(struct pointer_node* p)
+{
+    if (!p) return;
+    free_pointer_tree(p->left);
+    free_pointer_tree(p->right);
+    for (uint32_t i = 0; i < p->count; i++) free_pointer_tree(p->items[i]);
+    free(p->items);
+    free(p);
+}
+
+static uint64_t visit(const uint8_t type, const uint8_t op)
+{
+    return (uint64_t)type * 31 + op;
+}
+
+static uint64_t walk_pointer(const struct pointer_node* p)
+{
+    if (!p) return 0;
+    uint64_t sum = visit(p->type, p->op) + walk_pointer(p->left) + walk_pointer(p->right);
+    for (uint32_t i = 0; i < p->count; i++) sum += walk_pointer(p->items[i]);
+    return sum;
+}
+
+static uint64_t walk_run(const struct ast* ast, uint32_t first, uint32_t count);
+
+static uint64_t walk_flat(const struct ast* ast, const uint32_t index)
+{
+    if (!index) return 0;
+    const struct ast_node* n = &ast->nodes[index];
+    const uint64_t self = visit(n->type, n->op);
+    switch (n->type)
+    {
+    case AST_PROGRAM:
+    case AST_BLOCK: return self + walk_run(ast, n->block.first, n->block.count);
+    case AST_TYPE: return self + walk_run(ast, n->type_annotation.first, n->type_annotation.count);
+    case AST_LIST: return self + walk_run(ast, n->list.first, n->list.count);
+    case AST_IF:
+        return self + walk_flat(ast, n->if_statement.condition) + walk_flat(ast, n->if_statement.then_branch) +
+            walk_flat(ast, n->if_statement.else_branch);
+    case AST_ASSIGNMENT: return self + walk_flat(ast, n->assignment.expression);
+    case AST_DECLARATION: return self + walk_flat(ast, n->declaration.type) + walk_flat(ast, n->declaration.expression);
+    case AST_UNARY: return self + walk_flat(ast, n->unary.operand);
+    case AST_BINARY: return self + walk_flat(ast, n->binary.left) + walk_flat(ast, n->binary.right);
+    default: return self;
+    }
+}
+
+static uint64_t walk_run(const struct ast* ast, const uint32_t first, const uint32_t count)
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) sum += walk_flat(ast, ast->children[first + i]);
+    return sum;
+}
+
+// The parser leaves no unreachable nodes, so this visits the same set.
+static uint64_t scan_flat(const struct ast* ast)
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 1; i < ast->node_count; i++) sum += visit(ast->nodes[i].type, ast->nodes[i].op);
+    return sum;
+}
+
+#define TRAVERSALS 10
+
+static int traverse(const int statements)
+{
+    printf("%-10s %10s %14s %14s %14s\n", "workload", "nodes", "pointer ms", "flat ms", "scan ms");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        size_t length, count;
+        char* source = generate(wl, statements, &length);
+        struct lex_token* tokens = parse_text(source, length, &count);
+        struct ast ast;
+        ast_init(&ast);
+        parse(source, length, tokens, count, &ast);
+        struct pointer_node* tree = build_pointer_tree(&ast, ast.root);
+
+        double best[3] = {1e30, 1e30, 1e30};
+        uint64_t sums[3] = {0, 0, 0};
+        for (int i = 0; i < TRAVERSALS; i++)
+        {
+            double start = now();
+            sums[0] = walk_pointer(tree);
+            double elapsed = now() - start;
+            if (elapsed < best[0]) best[0] = elapsed;
+            start = now();
+            sums[1] = walk_flat(&ast, ast.root);
+            elapsed = now() - start;
+            if (elapsed < best[1]) best[1] = elapsed;
+            start = now();
+            sums[2] = scan_flat(&ast);
+            elapsed = now() - start;
+            if (elapsed < best[2]) best[2] = elapsed;
+        }
+        if (sums[0] != sums[1] || sums[1] != sums[2])
+        {
+            fprintf(stderr, "%s: traversals disagree\n", wl->name);
+            return 1;
+        }
+        printf("%-10s %10u %14.2f %14.2f %14.2f\n", wl->name, ast.node_count - 1, best[0] * 1e3, best[1] * 1e3,
+               best[2] * 1e3);
+
+        free_pointer_tree(tree);
+        free_ast(&ast);
+        ts_free(tokens);
+        free(source);
+    }
+    return 0;
+}
+
+int main(const int argc, const char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--traverse") == 0)
+        return traverse(argc > 2 ? atoi(argv[2]) : STATEMENTS * 20);
+    if (argc > 1)
+    {
+        fprintf(stderr, "Unknown option: %s\n", argv[1]);
+        return 1;
+    }
+    printf("%-10s %10s %12s %12s %10s\n", "workload", "tokens", "ms/parse", "ns/token", "MB/s");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        size_t length, count;
+        char* source = generate(wl, STATEMENTS, &length);
+        struct lex_token* tokens = parse_text(source, length, &count);
+        struct ast ast;
+        ast_init(&ast);
+
+        double best = 1e30;
+        for (int i = 0; i < wl->iterations; i++)
+        {
+            ast_reset(&ast);
+            const double start = now();
+            parse(source, length, tokens, count, &ast);
+            const double elapsed = now() - start;
+            if (elapsed < best) best = elapsed;
+        }
+
+        printf("%-10s %10zu %12.3f %12.2f %10.1f\n", wl->name, count, best * 1e3, best * 1e9 / (double)count,
+               (double)length / best / 1e6);
+
+        free_ast(&ast);
+        ts_free(tokens);
+        free(source);
+    }
+    return 0;
+}
@@ -0,0 +1,1042 @@
+// End-to-end front-end benchmarks over generated corpora (corpus.h). For each
+// size, the corpus is written to a temporary file once, and then every phase
+// of `main` is timed on its own: read_file, parse_text, parse, print_ast (to
+// /dev/null) and free_ast. Each phase runs until it has taken at least
+// --min-time seconds, and the fastest run is reported.
+//
+//   tinyscript_bench [--sizes 1K,64K,1M,16M] [--seed N] [--mix decl=4,if=0,...]
+//                    [--min-time S] [--json FILE|-] [--emit SIZE] [--check]
+//
+// --emit writes one corpus to stdout instead of timing anything. The JSON
+// output keeps a stable layout so two runs can be diffed.
+//
+// --check times nothing either: it lexes generated corpora and stress text
+// (long runs, escapes, strings spanning lines, stray bytes) with every
+// scanner version the CPU has, SIMD and scalar (see lexer/scan.h), and
+// fails on the first token that differs from the scalar lexer's. It also
+// lexes each input with parse_text_parallel at several thread counts, where
+// chunk boundaries land inside multi-line strings and comments, and fails
+// unless the tokens match parse_text's. Finally it makes random edits to a
+// document (parser/document.h) and undoes them, and fails unless its tokens
+// and tree match a fresh parse_text and parse of the text after each one,
+// and saves an AST cache (parser/ast_cache.h), which must load back as the
+// same tree, be ignored when stale or cut short, and never take a damaged
+// file for something the passes cannot walk.
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "lexer/lexer.h"
+#include "lexer/scan.h"
+#include "parser/ast.h"
+#include "parser/ast_cache.h"
+#include "parser/document.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+#include "utils/fs.h"
+#include "utils/pool.h"
+
+#define BENCH_JSON_VERSION 1
+#define MAX_SIZES 16
+#define MAX_RUNS 1000
+
+enum phase
+{
+    PHASE_READ_FILE,
+    PHASE_PARSE_TEXT,
+    PHASE_PARSE,
+    PHASE_PRINT_AST,
+    PHASE_FREE_AST,
+    PHASE_COUNT,
+};
+
+static const char* const phase_names[PHASE_COUNT] = {"read_file", "parse_text", "parse", "print_ast", "free_ast"};
+
+struct phase_result
+{
+    double best; // seconds
+    int runs;
+};
+
+struct size_result
+{
+    size_t target;
+    size_t bytes;
+    size_t tokens;
+    uint32_t nodes;
+    long peak_rss_kb;
+    struct phase_result phases[PHASE_COUNT];
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss; // KB on Linux
+}
+
+static void record(struct phase_result* result, const double elapsed)
+{
+    if (result->runs == 0 || elapsed < result->best) result->best = elapsed;
+    result->runs++;
+}
+
+// Accepts a byte count with an optional K, M or G suffix (powers of 1024).
+static int parse_size(const char* text, size_t* out)
+{
+    char* end;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    else if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift) end++;
+    if (*end != '\0' && *end != ',') return 0;
+    *out = (size_t)(value << shift);
+    return 1;
+}
+
+static size_t parse_sizes(const char* list, size_t* sizes)
+{
+    size_t count = 0;
+    while (*list && count < MAX_SIZES)
+    {
+        if (!parse_size(list, &sizes[count])) return 0;
+        count++;
+        const char* comma = strchr(list, ',');
+        if (!comma) break;
+        list = comma + 1;
+    }
+    return count;
+}
+
+// Points `fd` at /dev/null and returns a copy of what it was, for restore().
+static int redirect_to_null(const int fd)
+{
+    const int saved = dup(fd);
+    const int null = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null < 0)
+    {
+        fprintf(stderr, "Could not redirect output to /dev/null\n");
+        exit(1);
+    }
+    dup2(null, fd);
+    close(null);
+    return saved;
+}
+
+static void restore(const int fd, const int saved)
+{
+    dup2(saved, fd);
+    close(saved);
+}
+
+// print_ast writes to stdout; send it to /dev/null while it is timed.
+static double time_print(const struct ast* ast)
+{
+    fflush(stdout);
+    const int saved = redirect_to_null(STDOUT_FILENO);
+    const double start = now();
+    print_ast(ast);
+    fflush(stdout);
+    const double elapsed = now() - start;
+    restore(STDOUT_FILENO, saved);
+    return elapsed;
+}
+
+static void run_size(struct size_result* result, const uint64_t seed, const struct corpus_mix* mix,
+                     const double min_time)
+{
+    size_t length;
+    char* corpus = corpus_generate(result->target, seed, mix, &length);
+    result->bytes = length;
+
+    char path[] = "/tmp/tinyscript_bench_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0 || write(fd, corpus, length) != (ssize_t)length)
+    {
+        fprintf(stderr, "Could not write the corpus to %s\n", path);
+        exit(1);
+    }
+    close(fd);
+    free(corpus);
+
+    struct phase_result* phases = result->phases;
+    double spent = 0;
+    while (phases[PHASE_READ_FILE].runs == 0 || (spent < min_time && phases[PHASE_READ_FILE].runs < MAX_RUNS))
+    {
+        const double start = now();
+        char* text = read_file(path);
+        const double elapsed = now() - start;
+        if (!text) exit(1);
+        free(text);
+        record(&phases[PHASE_READ_FILE], elapsed);
+        spent += elapsed;
+    }
+    char* source = read_file(path);
+    remove(path);
+    if (!source) exit(1);
+
+    spent = 0;
+    struct lex_token* tokens = NULL;
+    while (phases[PHASE_PARSE_TEXT].runs == 0 || (spent < min_time && phases[PHASE_PARSE_TEXT].runs < MAX_RUNS))
+    {
+        ts_free(tokens);
+        const double start = now();
+        tokens = parse_text(source, length, &result->tokens);
+        const double elapsed = now() - start;
+        if (!tokens) exit(1);
+        record(&phases[PHASE_PARSE_TEXT], elapsed);
+        spent += elapsed;
+    }
+
+    // Every run parses into a fresh AST, as main does, so free_ast is timed
+    // on the AST the same run built.
+    spent = 0;
+    while (phases[PHASE_PARSE].runs == 0 || (spent < min_time && phases[PHASE_PARSE].runs < MAX_RUNS))
+    {
+        struct ast ast;
+        ast_init(&ast);
+        double start = now();
+        const uint32_t root = parse(source, length, tokens, result->tokens, &ast);
+        double elapsed = now() - start;
+        if (!root)
+        {
+            fprintf(stderr, "Generated corpus failed to parse\n");
+            exit(1);
+        }
+        record(&phases[PHASE_PARSE], elapsed);
+        spent += elapsed;
+        result->nodes = ast.node_count;
+
+        if (phases[PHASE_PRINT_AST].runs == 0 || phases[PHASE_PRINT_AST].best * phases[PHASE_PRINT_AST].runs < min_time)
+            record(&phases[PHASE_PRINT_AST], time_print(&ast));
+
+        start = now();
+        free_ast(&ast);
+        elapsed = now() - start;
+        record(&phases[PHASE_FREE_AST], elapsed);
+    }
+
+    ts_free(tokens);
+    free(source);
+    result->peak_rss_kb = peak_rss_kb();
+}
+
+static double rate(const double amount, const double seconds)
+{
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+static void print_table(const struct size_result* results, const size_t count)
+{
+    printf("%-12s %-11s %10s %10s %12s %12s %10s\n", "size", "phase", "ms", "MB/s", "Mtokens/s", "Mnodes/s",
+           "runs");
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct size_result* r = &results[i];
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            const double best = r->phases[p].best;
+            printf("%-12zu %-11s %10.3f %10.1f %12.2f %12.2f %10d\n", r->bytes, phase_names[p], best * 1e3,
+                   rate((double)r->bytes, best) / 1e6, rate((double)r->tokens, best) / 1e6,
+                   rate((double)r->nodes, best) / 1e6, r->phases[p].runs);
+        }
+        printf("%-12zu tokens %zu, nodes %u, peak RSS %ld KB\n", r->bytes, r->tokens, r->nodes, r->peak_rss_kb);
+    }
+}
+
+static void print_json(FILE* out, const struct size_result* results, const size_t count, const uint64_t seed,
+                       const struct corpus_mix* mix)
+{
+    char mix_text[256];
+    corpus_format_mix(mix, mix_text, sizeof(mix_text));
+    fprintf(out, "{\n  \"version\": %d,\n  \"seed\": %llu,\n  \"mix\": \"%s\",\n  \"sizes\": [\n",
+            BENCH_JSON_VERSION, (unsigned long long)seed, mix_text);
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct size_result* r = &results[i];
+        fprintf(out, "    {\n      \"target_bytes\": %zu,\n      \"bytes\": %zu,\n      \"tokens\": %zu,\n"
+                "      \"nodes\": %u,\n      \"peak_rss_kb\": %ld,\n      \"phases\": {\n",
+                r->target, r->bytes, r->tokens, r->nodes, r->peak_rss_kb);
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            const double best = r->phases[p].best;
+            fprintf(out, "        \"%s\": {\"seconds\": %.9f, \"runs\": %d, \"mb_per_s\": %.3f, "
+                    "\"tokens_per_s\": %.0f, \"nodes_per_s\": %.0f}%s\n",
+                    phase_names[p], best, r->phases[p].runs, rate((double)r->bytes, best) / 1e6,
+                    rate((double)r->tokens, best), rate((double)r->nodes, best), p + 1 < PHASE_COUNT ? "," : "");
+        }
+        fprintf(out, "      }\n    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// ---------------------------------------------------------------------------
+// --check
+// ---------------------------------------------------------------------------
+
+static uint64_t next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static char pick(uint64_t* state, const char* set)
+{
+    return set[next(state) % strlen(set)];
+}
+
+// Text that is not a program but exercises every scanner at every length,
+// including strings with escapes and newlines and comments with quotes in
+// them. `strings` weighs string literals against the other pieces. Every
+// string is closed, so lexing it prints nothing.
+static char* stress_text(uint64_t* state, const size_t size, const unsigned strings, size_t* length)
+{
+    static const char ident[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    static const char body[] = "abc xyz #=;:\n\n\t\\\\\"\"";
+    static const char* const punctuation[] = {":=", "==", "!=", "<=", ">=", "&&", "||", "+", "-", "*", "/",
+                                              "(",  ")",  "[",  "]",  "{",  "}",  ",",  ";", ":", "!", "<", ">", "="};
+    char* text = malloc(size + 512);
+    if (!text) exit(1);
+    size_t at = 0;
+    while (at < size)
+    {
+        const uint64_t piece = next(state) % (8 + strings);
+        const size_t run = (size_t)(next(state) % 80);
+        switch (piece)
+        {
+        case 0:
+            for (size_t i = 0; i <= run; i++) text[at++] = pick(state, " \t\n\r\v\f");
+            break;
+        case 1:
+            text[at++] = ident[next(state) % 53];
+            for (size_t i = 0; i < run; i++) text[at++] = ident[next(state) % (sizeof(ident) - 1)];
+            break;
+        case 2:
+            text[at++] = '#';
+            for (size_t i = 0; i < run * 2; i++) text[at++] = pick(state, "abc \"\\#");
+            text[at++] = '\n';
+            break;
+        case 3:
+            if (next(state) & 1) text[at++] = '-';
+            for (size_t i = 0; i <= run % 20; i++) text[at++] = (char)('0' + next(state) % 10);
+            if (next(state) & 1) text[at++] = '.';
+            break;
+        case 4:
+        case 5:
+        {
+            const char* p = punctuation[next(state) % (sizeof(punctuation) / sizeof(punctuation[0]))];
+            while (*p) text[at++] = *p++;
+            break;
+        }
+        case 6:
+            text[at++] = (char)(0x80 + next(state) % 0x80);
+            break;
+        case 7:
+            text[at++] = ' ';
+            break;
+        default:
+            text[at++] = '"';
+            for (size_t i = 0; i < run * 4; i++)
+            {
+                const char c = pick(state, body);
+                text[at++] = c;
+                if (c == '\\') text[at++] = pick(state, "\"\\n#");
+            }
+            text[at++] = '"';
+            break;
+        }
+    }
+    *length = at;
+    return text;
+}
+
+// Compares two token arrays field by field; prints the first difference.
+static int same_tokens(const struct lex_token* expected, const size_t expected_count,
+                       const struct lex_token* actual, const size_t actual_count, const char* what)
+{
+    const size_t count = expected_count < actual_count ? expected_count : actual_count;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (expected[i].type == actual[i].type && expected[i].offset == actual[i].offset &&
+            expected[i].length == actual[i].length)
+            continue;
+        printf("%s: token %zu is %s at %u+%u, expected %s at %u+%u\n", what, i, token_type_to_str(actual[i].type),
+               actual[i].offset, actual[i].length, token_type_to_str(expected[i].type), expected[i].offset,
+               expected[i].length);
+        return 0;
+    }
+    if (expected_count != actual_count)
+    {
+        printf("%s: %zu tokens, expected %zu\n", what, actual_count, expected_count);
+        return 0;
+    }
+    return 1;
+}
+
+struct check_input
+{
+    const char* name;
+    char* text;
+    size_t length;
+};
+
+static int check_scanners(const struct check_input* input, const enum cpu_level best, size_t* token_count)
+{
+    static const char* const level_names[] = {"scalar", "sse2", "avx2"};
+    scan_use(CPU_SCALAR);
+    size_t expected_count;
+    struct lex_token* expected = parse_text(input->text, input->length, &expected_count);
+    int ok = expected != NULL;
+    for (int level = CPU_SSE2; ok && level <= (int)best; level++)
+    {
+        scan_use((enum cpu_level)level);
+        size_t count;
+        struct lex_token* tokens = parse_text(input->text, input->length, &count);
+        char what[96];
+        snprintf(what, sizeof(what), "%s, %s scanners", input->name, level_names[level]);
+        ok = tokens && same_tokens(expected, expected_count, tokens, count, what);
+        ts_free(tokens);
+    }
+    scan_use(best);
+    ts_free(expected);
+    *token_count = expected_count;
+    return ok;
+}
+
+static int check_parallel(const struct check_input* input)
+{
+    static const size_t thread_counts[] = {2, 3, 4, 8};
+    size_t expected_count;
+    struct lex_token* expected = parse_text(input->text, input->length, &expected_count);
+    int ok = expected != NULL;
+    for (size_t t = 0; ok && t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+    {
+        struct thread_pool* pool = thread_pool_create(thread_counts[t]);
+        size_t count;
+        struct lex_token* tokens = parse_text_parallel(input->text, input->length, &count, pool);
+        char what[96];
+        snprintf(what, sizeof(what), "%s, %zu threads", input->name, thread_counts[t]);
+        ok = tokens && same_tokens(expected, expected_count, tokens, count, what);
+        ts_free(tokens);
+        thread_pool_destroy(pool);
+    }
+    ts_free(expected);
+    return ok;
+}
+
+// Stress text around one string literal longer than a parallel lexing chunk,
+// so whole chunks fall inside it.
+static char* long_string_text(uint64_t* state, size_t* length)
+{
+    size_t before, after;
+    char* head = stress_text(state, 1 << 20, 12, &before);
+    char* tail = stress_text(state, 1 << 20, 12, &after);
+    const size_t body = 3 << 19;
+    char* text = malloc(before + body + after + 2);
+    if (!head || !tail || !text) exit(1);
+    memcpy(text, head, before);
+    size_t at = before;
+    text[at++] = '"';
+    for (size_t i = 0; i < body; i++)
+    {
+        const uint64_t r = next(state) % 64;
+        if (r == 0 && i + 1 < body)
+        {
+            text[at++] = '\\';
+            text[at++] = '"';
+            i++;
+        }
+        else text[at++] = r < 4 ? '\n' : r < 6 ? '#' : (char)('a' + r % 26);
+    }
+    text[at++] = '"';
+    memcpy(text + at, tail, after);
+    *length = at + after;
+    free(head);
+    free(tail);
+    return text;
+}
+
+static int same_name(const struct ast* a, const uint32_t a_name, const struct ast* b, const uint32_t b_name)
+{
+    const char* x = interner_lookup(&a->names, a_name);
+    const char* y = interner_lookup(&b->names, b_name);
+    return x && y && strcmp(x, y) == 0;
+}
+
+struct node_pairs
+{
+    uint32_t (*items)[2];
+    size_t count;
+    size_t capacity;
+};
+
+static void push_pair(struct node_pairs* pairs, const uint32_t a, const uint32_t b)
+{
+    if (pairs->count == pairs->capacity)
+    {
+        pairs->capacity = pairs->capacity ? pairs->capacity * 2 : 256;
+        pairs->items = realloc(pairs->items, pairs->capacity * sizeof(pairs->items[0]));
+        if (!pairs->items) exit(1);
+    }
+    pairs->items[pairs->count][0] = a;
+    pairs->items[pairs->count][1] = b;
+    pairs->count++;
+}
+
+static void push_run(struct node_pairs* pairs, const struct ast* a, const uint32_t a_first, const struct ast* b,
+                     const uint32_t b_first, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) push_pair(pairs, a->children[a_first + i], b->children[b_first + i]);
+}
+
+// Compares the trees under `a_root` and `b_root` node by node. Node, child
+// and number indices and name ids may differ between the two ASTs; names
+// are compared by their text and numbers by value.
+static int same_ast(const struct ast* a, const uint32_t a_root, const struct ast* b, const uint32_t b_root,
+                    const char* what)
+{
+    struct node_pairs pairs = {0};
+    push_pair(&pairs, a_root, b_root);
+    int ok = 1;
+    while (ok && pairs.count)
+    {
+        pairs.count--;
+        const uint32_t ai = pairs.items[pairs.count][0], bi = pairs.items[pairs.count][1];
+        if (!ai || !bi)
+        {
+            ok = ai == bi;
+            continue;
+        }
+        const struct ast_node* x = &a->nodes[ai];
+        const struct ast_node* y = &b->nodes[bi];
+        ok = x->type == y->type && x->op == y->op && x->flags == y->flags;
+        if (!ok) break;
+        switch (x->type)
+        {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            ok = x->block.count == y->block.count;
+            if (ok) push_run(&pairs, a, x->block.first, b, y->block.first, x->block.count);
+            break;
+        case AST_IF:
+            push_pair(&pairs, x->if_statement.condition, y->if_statement.condition);
+            push_pair(&pairs, x->if_statement.then_branch, y->if_statement.then_branch);
+            push_pair(&pairs, x->if_statement.else_branch, y->if_statement.else_branch);
+            break;
+        case AST_ASSIGNMENT:
+            ok = same_name(a, x->assignment.name, b, y->assignment.name);
+            push_pair(&pairs, x->assignment.expression, y->assignment.expression);
+            break;
+        case AST_DECLARATION:
+            ok = same_name(a, x->declaration.name, b, y->declaration.name);
+            push_pair(&pairs, x->declaration.type, y->declaration.type);
+            push_pair(&pairs, x->declaration.expression, y->declaration.expression);
+            break;
+        case AST_TYPE:
+            ok = same_name(a, x->type_annotation.name, b, y->type_annotation.name) &&
+                 x->type_annotation.count == y->type_annotation.count;
+            if (ok) push_run(&pairs, a, x->type_annotation.first, b, y->type_annotation.first, x->type_annotation.count);
+            break;
+        case AST_LIST:
+            ok = x->list.count == y->list.count;
+            if (ok) push_run(&pairs, a, x->list.first, b, y->list.first, x->list.count);
+            break;
+        case AST_NUMBER:
+        {
+            const struct lex_number* m = &a->numbers[x->number.index];
+            const struct lex_number* n = &b->numbers[y->number.index];
+            ok = m->is_integer == n->is_integer && (m->is_integer ? m->integer == n->integer : m->real == n->real);
+            break;
+        }
+        case AST_BOOLEAN:
+            ok = x->boolean.value == y->boolean.value;
+            break;
+        case AST_IDENT:
+            ok = same_name(a, x->ident.name, b, y->ident.name);
+            break;
+        case AST_UNARY:
+            push_pair(&pairs, x->unary.operand, y->unary.operand);
+            break;
+        case AST_BINARY:
+            push_pair(&pairs, x->binary.left, y->binary.left);
+            push_pair(&pairs, x->binary.right, y->binary.right);
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+    }
+    if (!ok) printf("%s: the trees differ\n", what);
+    free(pairs.items);
+    return ok;
+}
+
+// Lexes and parses the document's text from scratch and compares the
+// tokens and the tree with the ones the document kept up to date.
+static int same_as_parse(const struct document* doc, const char* what)
+{
+    size_t count;
+    struct lex_token* tokens = parse_text(doc->source, doc->length, &count);
+    int ok = tokens && same_tokens(tokens, count, doc->tokens, doc->token_count, what);
+    struct ast ast;
+    ast_init(&ast);
+    const uint32_t root = ok ? parse_silent(doc->source, doc->length, tokens, count, &ast) : 0;
+    if (ok && !root != !doc->ast.root)
+    {
+        printf("%s: the document %s, parse() %s\n", what, doc->ast.root ? "parses" : "has a syntax error",
+               root ? "parses" : "has a syntax error");
+        ok = 0;
+    }
+    else if (ok && root) ok = same_ast(&ast, root, &doc->ast, doc->ast.root, what);
+    free_ast(&ast);
+    ts_free(tokens);
+    return ok;
+}
+
+// The corpus starts every top-level statement on a line of its own, at
+// column 0; lines inside blocks are indented or close a block with '}'.
+static int starts_statement(const char* text, const size_t length, const size_t at)
+{
+    return at < length && (at == 0 || text[at - 1] == '\n') && text[at] != ' ' && text[at] != '}' &&
+           text[at] != '\n';
+}
+
+static size_t next_statement(const char* text, const size_t length, size_t at)
+{
+    while (at < length && !starts_statement(text, length, at)) at++;
+    return at;
+}
+
+// A run of one to three whole top-level statements of `text`, somewhere
+// from a random point on.
+static size_t statement_run(uint64_t* state, const char* text, const size_t length, size_t* end)
+{
+    const size_t start = next_statement(text, length, (size_t)(next(state) % (length + 1)));
+    *end = start;
+    for (uint64_t n = 1 + next(state) % 3; n && *end < length; n--) *end = next_statement(text, length, *end + 1);
+    return start;
+}
+
+struct undo
+{
+    size_t offset;
+    size_t inserted_length;
+    char* removed;
+    size_t removed_length;
+    int breaks; // the edit may leave a syntax error
+};
+
+// Picks an edit of `doc` and records how to undo it. Most edits keep the
+// program valid: whole statements from `donor` go in, whole statements come
+// out, and digits change. The rest cut, insert and overwrite at random,
+// opening strings, comments and brackets.
+static void make_edit(uint64_t* state, const struct document* doc, const char* donor, const size_t donor_length,
+                      struct undo* u, const char** inserted, char* single)
+{
+    size_t removed = 0, end;
+    *inserted = NULL;
+    u->inserted_length = 0;
+    u->breaks = 0;
+    switch (next(state) % 8)
+    {
+    case 0:
+    case 1:
+    case 2:
+        u->offset = next_statement(doc->source, doc->length, (size_t)(next(state) % (doc->length + 1)));
+        *inserted = donor + statement_run(state, donor, donor_length, &end);
+        u->inserted_length = (size_t)(donor + end - *inserted);
+        break;
+    case 3:
+    case 4:
+        u->offset = statement_run(state, doc->source, doc->length, &end);
+        removed = end - u->offset;
+        break;
+    case 5:
+    case 6:
+        u->offset = (size_t)(next(state) % (doc->length + 1));
+        while (u->offset < doc->length && (doc->source[u->offset] < '0' || doc->source[u->offset] > '9'))
+            u->offset++;
+        if (u->offset == doc->length) break;
+        *single = pick(state, "0123456789");
+        *inserted = single;
+        u->inserted_length = 1;
+        removed = 1;
+        break;
+    default:
+        u->offset = (size_t)(next(state) % (doc->length + 1));
+        removed = doc->length - u->offset < 64 ? doc->length - u->offset : 64;
+        removed = next(state) & 1 ? (size_t)(next(state) % (removed + 1)) : 0;
+        if (next(state) & 1)
+        {
+            *single = pick(state, "\"#()[]{};=+-!<, \n0a");
+            *inserted = single;
+            u->inserted_length = 1;
+        }
+        else
+        {
+            const size_t from = (size_t)(next(state) % (donor_length + 1));
+            *inserted = donor + from;
+            u->inserted_length = (size_t)(next(state) % (donor_length - from < 64 ? donor_length - from + 1 : 65));
+        }
+        u->breaks = 1;
+        break;
+    }
+    u->removed = malloc(removed + 1);
+    if (!u->removed) exit(1);
+    memcpy(u->removed, doc->source + u->offset, removed);
+    u->removed_length = removed;
+}
+
+// Random edits to a document, each kept for a while and then undone in
+// reverse order. An edit that may break the program is undone sooner, so
+// most checks see a text that parses and compare the trees. After every
+// edit and every undo the tokens and tree must match a fresh parse of the
+// text, and once everything is undone the text must be back as it was.
+static int check_document(const uint64_t seed, size_t* edit_count, size_t* parsed_count)
+{
+    enum { ROUNDS = 4, STEPS = 400, MAX_UNDO = 64 };
+    struct corpus_mix mix;
+    corpus_default_mix(&mix);
+    size_t length, donor_length;
+    char* text = corpus_generate(32 << 10, seed, &mix, &length);
+    char* donor = corpus_generate(32 << 10, seed + 100, &mix, &donor_length);
+    struct undo undo[MAX_UNDO];
+    uint64_t state = seed;
+    if (!text || !donor) exit(1);
+
+    // Broken edits leave syntax errors, which the document reports.
+    fflush(stderr);
+    const int saved = redirect_to_null(STDERR_FILENO);
+    struct document doc;
+    int ok = document_open(&doc, text, length) && same_as_parse(&doc, "document, open");
+    *edit_count = *parsed_count = 0;
+    for (int round = 0; ok && round < ROUNDS; round++)
+    {
+        char what[64];
+        size_t depth = 0, broken = 0;
+        for (int step = 0; ok && (step < STEPS || depth); step++)
+        {
+            const uint64_t roll = next(&state) % 6;
+            if (depth && (step >= STEPS || depth == MAX_UNDO || roll < (broken ? 4u : 1u)))
+            {
+                const struct undo* u = &undo[--depth];
+                broken -= (size_t)u->breaks;
+                snprintf(what, sizeof(what), "document, round %d, step %d (undo)", round, step);
+                ok = document_edit(&doc, u->offset, u->inserted_length, u->removed, u->removed_length);
+                free(u->removed);
+            }
+            else
+            {
+                struct undo* u = &undo[depth++];
+                const char* inserted;
+                char single;
+                make_edit(&state, &doc, donor, donor_length, u, &inserted, &single);
+                broken += (size_t)u->breaks;
+                snprintf(what, sizeof(what), "document, round %d, step %d", round, step);
+                ok = document_edit(&doc, u->offset, u->removed_length, inserted, u->inserted_length);
+            }
+            ok = ok && same_as_parse(&doc, what);
+            (*edit_count)++;
+            *parsed_count += doc.ast.root != 0;
+        }
+        while (depth) free(undo[--depth].removed);
+        if (ok && (doc.length != length || memcmp(doc.source, text, length) != 0))
+        {
+            printf("document, round %d: undoing every edit does not restore the text\n", round);
+            ok = 0;
+        }
+    }
+    fflush(stderr);
+    restore(STDERR_FILENO, saved);
+    document_close(&doc);
+    free(donor);
+    free(text);
+    return ok;
+}
+
+static int write_bytes(const char* path, const char* data, const size_t size)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out) return 0;
+    const int ok = fwrite(data, 1, size, out) == size;
+    return fclose(out) == 0 && ok;
+}
+
+// Tries to load the cache at `path` for `source`. A load that succeeds must
+// give a tree the passes can walk; print_ast walks all of it, to /dev/null.
+static int cache_loads(const char* path, const char* source, const size_t length)
+{
+    struct ast_cache cached;
+    if (!ast_cache_load(path, source, length, &cached)) return 0;
+    fflush(stdout);
+    const int saved = redirect_to_null(STDOUT_FILENO);
+    print_ast(&cached.ast);
+    fflush(stdout);
+    restore(STDOUT_FILENO, saved);
+    ast_cache_close(&cached);
+    return 1;
+}
+
+// Saves the AST of a generated corpus as a cache and loads it back, which
+// must give the same tree. A cache must be ignored for any other source, and
+// when it is cut short or has a bad magic or version. Bytes flipped anywhere
+// else either make the load fail or leave a tree that can still be walked;
+// the format has no checksum, so a flipped literal loads as a different one.
+static int check_cache(const uint64_t seed, size_t* corrupt_count, size_t* rejected_count)
+{
+    enum { CORRUPTIONS = 300 };
+    struct corpus_mix mix;
+    corpus_default_mix(&mix);
+    size_t length, count;
+    char* text = corpus_generate(64 << 10, seed, &mix, &length);
+    struct lex_token* tokens = text ? parse_text(text, length, &count) : NULL;
+    struct ast ast;
+    ast_init(&ast);
+    if (!tokens || !parse(text, length, tokens, count, &ast)) exit(1);
+
+    char path[] = "/tmp/tinyscript_bench_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) exit(1);
+    close(fd);
+    int ok = ast_cache_save(path, &ast, text, length);
+
+    struct ast_cache cached;
+    if (ok && !ast_cache_load(path, text, length, &cached))
+    {
+        printf("ast cache: a fresh cache does not load\n");
+        ok = 0;
+    }
+    else if (ok)
+    {
+        ok = same_ast(&ast, ast.root, &cached.ast, cached.ast.root, "ast cache, round trip");
+        ast_cache_close(&cached);
+    }
+
+    struct source_file file;
+    char* bytes = NULL;
+    size_t size = 0;
+    if (ok && map_file(path, &file))
+    {
+        size = file.length;
+        bytes = malloc(size);
+        if (!bytes) exit(1);
+        memcpy(bytes, file.data, size);
+        unmap_file(&file);
+    }
+    else ok = 0;
+
+    uint64_t state = seed;
+    if (ok)
+    {
+        const size_t at = (size_t)(next(&state) % length);
+        text[at] ^= 1;
+        const int stale = cache_loads(path, text, length);
+        text[at] ^= 1;
+        if (stale || cache_loads(path, text, length - 1))
+        {
+            printf("ast cache: loads for a different source\n");
+            ok = 0;
+        }
+    }
+    static const size_t cuts[] = {0, 7, 8, 64, 127, 128};
+    for (size_t i = 0; ok && i < sizeof(cuts) / sizeof(cuts[0]) + 3; i++)
+    {
+        const size_t cut = i < sizeof(cuts) / sizeof(cuts[0]) ? cuts[i] : size - 1 - (size_t)(next(&state) % (size / 2));
+        if (!write_bytes(path, bytes, cut)) exit(1);
+        if (cache_loads(path, text, length))
+        {
+            printf("ast cache: loads when cut to %zu of %zu bytes\n", cut, size);
+            ok = 0;
+        }
+    }
+    static const size_t header_bytes[] = {0, 5, 7, 8, 9, 11}; // magic and version
+    for (size_t i = 0; ok && i < sizeof(header_bytes) / sizeof(header_bytes[0]); i++)
+    {
+        bytes[header_bytes[i]] ^= 0x10;
+        const int loads = write_bytes(path, bytes, size) ? cache_loads(path, text, length) : 1;
+        bytes[header_bytes[i]] ^= 0x10;
+        if (loads)
+        {
+            printf("ast cache: loads with byte %zu of the header changed\n", header_bytes[i]);
+            ok = 0;
+        }
+    }
+
+    *corrupt_count = *rejected_count = 0;
+    for (int trial = 0; ok && trial < CORRUPTIONS; trial++)
+    {
+        size_t at[4];
+        uint8_t flip[4];
+        const int flips = 1 + (int)(next(&state) % 4);
+        for (int f = 0; f < flips; f++)
+        {
+            // Half the flips land in the header and the name table at the front.
+            at[f] = (size_t)(next(&state) % (next(&state) & 1 ? size : (size < 512 ? size : 512)));
+            flip[f] = (uint8_t)(1u << (next(&state) % 8));
+            bytes[at[f]] ^= (char)flip[f];
+        }
+        if (!write_bytes(path, bytes, size)) exit(1);
+        *rejected_count += !cache_loads(path, text, length);
+        (*corrupt_count)++;
+        for (int f = flips - 1; f >= 0; f--) bytes[at[f]] ^= (char)flip[f];
+    }
+
+    remove(path);
+    free(bytes);
+    free_ast(&ast);
+    ts_free(tokens);
+    free(text);
+    return ok;
+}
+
+static int check(const uint64_t seed)
+{
+    static const char* const mixes[] = {NULL, "comment=6,string=6,list=0", "decl=0,assign=0,expr=0,list=8,if=0"};
+    static const char* const mix_names[] = {"corpus, default mix", "corpus, comments", "corpus, lists"};
+    const enum cpu_level best = cpu_detect();
+    if (best == CPU_SCALAR) printf("No SIMD in use (TS_DISABLE_SIMD or CPU); only the scalar scanners run\n");
+
+    struct check_input inputs[6];
+    size_t input_count = 0;
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++)
+    {
+        struct corpus_mix mix;
+        corpus_default_mix(&mix);
+        if (mixes[m]) corpus_parse_mix(mixes[m], &mix);
+        inputs[input_count].name = mix_names[m];
+        inputs[input_count].text = corpus_generate(4 << 20, seed + m, &mix, &inputs[input_count].length);
+        input_count++;
+    }
+    uint64_t state = seed;
+    inputs[input_count].name = "stress";
+    inputs[input_count].text = stress_text(&state, 4 << 20, 1, &inputs[input_count].length);
+    input_count++;
+    inputs[input_count].name = "stress, strings";
+    inputs[input_count].text = stress_text(&state, 4 << 20, 12, &inputs[input_count].length);
+    input_count++;
+    inputs[input_count].name = "stress, long string";
+    inputs[input_count].text = long_string_text(&state, &inputs[input_count].length);
+    input_count++;
+
+    int ok = 1;
+    for (size_t i = 0; i < input_count; i++)
+    {
+        size_t token_count = 0;
+        if (check_scanners(&inputs[i], best, &token_count) && check_parallel(&inputs[i]))
+            printf("%-24s %10zu bytes %10zu tokens  same\n", inputs[i].name, inputs[i].length, token_count);
+        else ok = 0;
+    }
+    for (size_t i = 0; i < input_count; i++) free(inputs[i].text);
+
+    size_t edit_count, parsed_count;
+    if (check_document(seed, &edit_count, &parsed_count))
+        printf("%-24s %10zu edits %9zu parse  same\n", "document edits", edit_count, parsed_count);
+    else ok = 0;
+    size_t corrupt_count, rejected_count;
+    if (check_cache(seed, &corrupt_count, &rejected_count))
+        printf("%-24s %10zu damaged %7zu rejected  ok\n", "ast cache", corrupt_count, rejected_count);
+    else ok = 0;
+    printf("check: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(const int argc, const char** argv)
+{
+    size_t sizes[MAX_SIZES] = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+    size_t size_count = 4;
+    uint64_t seed = 1;
+    double min_time = 0.5;
+    const char* json = NULL;
+    const char* emit = NULL;
+    int run_check = 0;
+    struct corpus_mix mix;
+    corpus_default_mix(&mix);
+
+    for (int i = 1; i < argc; i++)
+    {
+        const int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && has_value)
+        {
+            size_count = parse_sizes(argv[++i], sizes);
+            if (!size_count)
+            {
+                fprintf(stderr, "Bad --sizes list: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--min-time") == 0 && has_value) min_time = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--json") == 0 && has_value) json = argv[++i];
+        else if (strcmp(argv[i], "--emit") == 0 && has_value) emit = argv[++i];
+        else if (strcmp(argv[i], "--check") == 0) run_check = 1;
+        else if (strcmp(argv[i], "--mix") == 0 && has_value)
+        {
+            if (!corpus_parse_mix(argv[++i], &mix))
+            {
+                fprintf(stderr, "Bad --mix: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (run_check) return check(seed) ? 0 : 1;
+    if (emit)
+    {
+        size_t size, length;
+        if (!parse_size(emit, &size))
+        {
+            fprintf(stderr, "Bad --emit size: %s\n", emit);
+            return 1;
+        }
+        char* corpus = corpus_generate(size, seed, &mix, &length);
+        fwrite(corpus, 1, length, stdout);
+        free(corpus);
+        return 0;
+    }
+
+    struct size_result results[MAX_SIZES];
+    memset(results, 0, sizeof(results));
+    for (size_t i = 0; i < size_count; i++)
+    {
+        results[i].target = sizes[i];
+        run_size(&results[i], seed, &mix, min_time);
+    }
+
+    if (!json)
+    {
+        print_table(results, size_count);
+        return 0;
+    }
+    FILE* out = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Could not open %s\n", json);
+        return 1;
+    }
+    print_json(out, results, size_count, seed, &mix);
+    if (out != stdout) fclose(out);
+    return 0;
+}
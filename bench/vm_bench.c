@@ -0,0 +1,395 @@
+// Micro-benchmarks for the bytecode VM. Each workload is a single TinyScript
+// expression that is compiled once and executed many times; a naive
+// tree-walking evaluator over the same AST is timed alongside as a baseline.
+//
+// --check times nothing: it runs a set of programs with and without
+// fold_constants and fails unless both give the same value, or both fail.
+// It also runs programs that declare, shadow and misuse variables, and fails
+// unless resolve() and typecheck() accept or reject each as expected and the
+// ones they accept give true, twice on the same VM, and types a program
+// whose declaration an edit moved behind its use in the node array.
+//
+//   tinyscript_vm_bench [--check]
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/document.h"
+#include "parser/parser.h"
+#include "passes/fold.h"
+#include "passes/resolve.h"
+#include "passes/typecheck.h"
+#include "utils/alloc.h"
+#include "vm/compiler.h"
+#include "vm/vm.h"
+
+struct workload
+{
+    const char* name;
+    const char* source;
+    int iterations;
+};
+
+static const struct workload workloads[] = {
+    {"arithmetic", "((1 + 2) * 3 - 4 / 2) * ((5 + 6) * 7 - 8 / 4) + ((9 - 1) * (2 + 3) - 6 / 3) * 2;", 2000000},
+    {"comparisons", "(1 < 2) && (3 >= 3) && !(4 == 5) && (6 != 7) || (8 > 9) && (10 <= 11);", 2000000},
+    {"lists", "[1, 2, 3, 4, 5, 6, 7, 8, [1 + 1, 2 * 2, 3 - 3], [true, false, 1 < 2]];", 500000},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reference tree walker: recursive, dispatching on node type at every step
+// and producing the same boxed values as the VM.
+static struct value walk(const struct ast* ast, const uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    struct value v = {.type = VAL_NIL};
+    switch (node->type)
+    {
+    case AST_NUMBER:
+        v.type = VAL_NUMBER;
+        v.number = ast_number_value(ast, index);
+        break;
+    case AST_BOOLEAN:
+        v.type = VAL_BOOL;
+        v.boolean = (int)node->boolean.value;
+        break;
+    case AST_LIST:
+        v.type = VAL_LIST;
+        v.list = malloc(sizeof(struct ts_list));
+        v.list->length = v.list->capacity = node->list.count;
+        v.list->kind = LIST_BOXED;
+        v.list->items = malloc(node->list.count * sizeof(struct value));
+        for (uint32_t i = 0; i < node->list.count; i++)
+            v.list->items[i] = walk(ast, ast->children[node->list.first + i]);
+        break;
+    case AST_UNARY:
+        v = walk(ast, node->unary.operand);
+        if (node->op == TOKEN_NOT)
+        {
+            v.boolean = !value_truthy(&v);
+            v.type = VAL_BOOL;
+        }
+        else v.number = -v.number;
+        break;
+    case AST_BINARY:
+    {
+        const struct value l = walk(ast, node->binary.left);
+        if (node->op == TOKEN_AND || node->op == TOKEN_OR)
+        {
+            v.type = VAL_BOOL;
+            v.boolean = value_truthy(&l);
+            if (v.boolean == (node->op == TOKEN_AND))
+            {
+                const struct value r = walk(ast, node->binary.right);
+                v.boolean = value_truthy(&r);
+            }
+            break;
+        }
+        const struct value r = walk(ast, node->binary.right);
+        v.type = VAL_NUMBER;
+        switch (node->op)
+        {
+        case TOKEN_PLUS: v.number = l.number + r.number; break;
+        case TOKEN_MINUS: v.number = l.number - r.number; break;
+        case TOKEN_STAR: v.number = l.number * r.number; break;
+        case TOKEN_SLASH: v.number = l.number / r.number; break;
+        default:
+            v.type = VAL_BOOL;
+            switch (node->op)
+            {
+            case TOKEN_LT: v.boolean = l.number < r.number; break;
+            case TOKEN_LE: v.boolean = l.number <= r.number; break;
+            case TOKEN_GT: v.boolean = l.number > r.number; break;
+            case TOKEN_GE: v.boolean = l.number >= r.number; break;
+            case TOKEN_EQ: v.boolean = values_equal(&l, &r); break;
+            default: v.boolean = !values_equal(&l, &r); break;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return v;
+}
+
+static void release(const struct value* v)
+{
+    if (v->type != VAL_LIST) return;
+    for (uint32_t i = 0; i < v->list->length; i++) release(&v->list->items[i]);
+    free(v->list->items);
+    free(v->list);
+}
+
+// ---------------------------------------------------------------------------
+// --check
+// ---------------------------------------------------------------------------
+
+// Programs where folding is easy to get wrong: lists where a scalar is
+// expected, and identities that must hold element by element.
+static const char* const fold_checks[] = {
+    "!!([1, 2] < [3, 0]);",
+    "!(!([1.5] <= [2]));",
+    "true && ([1, 2] < [3, 0]);",
+    "false || [1, 2] >= 2;",
+    "[1, 2] > 1 && true;",
+    "!!(1 < 2);",
+    "true && 3 > 2;",
+    "!!([1] == [1]);",
+    "var l List<Int32> := [1, -2, 3]; (l * 2) * 1;",
+    "var l List<Int32> := [1, -2, 3]; (l + 1) / 1 - 0;",
+    "var l List<Int32> := [1, -2, 3]; 1 * (l - 4);",
+    "var l List<Int32> := [1, -2, 3]; -(-(l * 2));",
+    "var l List<Int32> := [1, -2, 3]; !!(l > 0);",
+    "var l List<Int32> := [1, -2, 3]; true && l < 2;",
+    "var l List<Int32> := [1, -2, 3]; !!(l == l) || l;",
+    // Integers past 2^53 round in double, folded or not.
+    "9007199254740993 + 1 == 9007199254740992;",
+    "9007199254740992 + 1 == 9007199254740992;",
+    "-9007199254740993 - 1 == -9007199254740994;",
+    "4294967297 * 4294967297 == 18446744082299486209;",
+    "9223372036854775807 - 1 == 9223372036854775806;",
+    "3 * 5 - 16 == -1;",
+};
+
+// Programs for resolve() and typecheck(): scopes, shadowing, and names used
+// before, twice or outside their declaration, and variables of one name
+// with different types in different scopes. Each one that resolves and is
+// well typed ends in an expression that must be true, on a first and on a
+// second run on the same VM.
+struct scope_check
+{
+    const char* source;
+    int resolves;
+    int well_typed;
+};
+
+static const struct scope_check scope_checks[] = {
+    {"var x Int32 := 1; if (true) { var x Int32 := 2; x = x + 1; } x == 1;", 1, 1},
+    {"var x Int32 := 1; if (true) { x = x + 1; } x == 2;", 1, 1},
+    {"var x Int32 := 1; if (x > 0) { var y Int32 := x + 1; if (true) { var x Int32 := y * 10; y = x; } x = y; } "
+     "x == 20;",
+     1, 1},
+    {"var x Int32 := 1; var r Bool := false; if (true) { var x Int32 := x + 1; r = x == 2; } r && x == 1;", 1, 1},
+    {"var x Int32 := 1; if (false) { var x Int32 := 5; } else { var y Int32 := 7; x = y; } x == 7;", 1, 1},
+    {"var x Int32 := 1; x = x + 1; x == 2;", 1, 1},
+    {"var x Int32 := 1; var x Int32 := 2; true;", 0, 0},
+    {"y = 1; var y Int32; true;", 0, 0},
+    {"if (true) { var z Int32 := 1; } z == 1;", 0, 0},
+    {"var w Int32 := w + 1; true;", 0, 0},
+    {"if (true) { var v Int32 := 1; } else { v = 2; } true;", 0, 0},
+    // Each variable has its own type, whatever else shares its name.
+    {"var a Int32 := 1; if (true) { var a Bool := a < 2; a = !a; } a == 1;", 1, 1},
+    {"var a Bool := true; if (true) { var a Int32 := 3; a = a * 2; } a && true;", 1, 1},
+    {"var a Int32 := 1; a = a + 1; if (true) { var a Bool := true; a = !a; } a == 2;", 1, 1},
+    {"var l List<Int32> := [1, 2]; if (true) { var l Int32 := 2; l = l + 1; } l == [1, 2];", 1, 1},
+    {"var b Bool := false; if (true) { var b Int32 := 2; if (b > 1) { var b Bool := true; b = !b; } b = b * 3; } !b;",
+     1, 1},
+    {"var a Int32 := 1; if (true) { var a Bool := a; } true;", 1, 0},
+    {"var a Int32 := 1; if (true) { var a Bool := true; } a = false; true;", 1, 0},
+    {"var a Bool := true; if (true) { var a Int32 := 1; } a + 1 == 2;", 1, 0},
+    {"var a Bool := true; a = 1 < 2; if (true) { var a Int32 := 1; a = true; } a;", 1, 0},
+};
+
+// Parses, optionally folds, resolves, compiles and runs `source` on `vm`.
+static enum vm_status run_source(const char* source, const int fold, struct vm* vm, struct value* result)
+{
+    size_t count;
+    struct lex_token* tokens = parse_text(source, strlen(source), &count);
+    struct ast ast;
+    ast_init(&ast);
+    enum vm_status status = VM_COMPILE_ERROR;
+    if (tokens && parse(source, strlen(source), tokens, count, &ast))
+    {
+        if (fold) ast.root = fold_constants(&ast, ast.root);
+        if (resolve(&ast, ast.root)) status = evaluate(vm, &ast, result);
+    }
+    free_ast(&ast);
+    ts_free(tokens);
+    return status;
+}
+
+// resolve() and typecheck() report the errors the failing programs are there
+// to cause.
+static int silence_stderr(void)
+{
+    fflush(stderr);
+    const int saved = dup(STDERR_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null < 0)
+    {
+        fprintf(stderr, "Could not redirect stderr to /dev/null\n");
+        exit(1);
+    }
+    dup2(null, STDERR_FILENO);
+    close(null);
+    return saved;
+}
+
+static void restore_stderr(const int saved)
+{
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+}
+
+static int check_scope(const struct scope_check* c)
+{
+    size_t count;
+    struct lex_token* tokens = parse_text(c->source, strlen(c->source), &count);
+    struct ast ast;
+    ast_init(&ast);
+    int ok = tokens && parse(c->source, strlen(c->source), tokens, count, &ast);
+    if (!ok) printf("%s\n  does not parse\n", c->source);
+    const int resolves = ok && resolve(&ast, ast.root);
+    if (ok && resolves != c->resolves)
+    {
+        printf("%s\n  resolve() %s\n", c->source, resolves ? "succeeds" : "fails");
+        ok = 0;
+    }
+    struct type_table types = {0};
+    const int well_typed = ok && resolves && typecheck(&ast, ast.root, &types);
+    type_table_free(&types);
+    if (ok && resolves && well_typed != c->well_typed)
+    {
+        printf("%s\n  typecheck() %s\n", c->source, well_typed ? "succeeds" : "fails");
+        ok = 0;
+    }
+    if (ok && well_typed)
+    {
+        struct vm vm;
+        vm_init(&vm);
+        for (int run = 1; ok && run <= 2; run++)
+        {
+            struct value result;
+            const enum vm_status status = evaluate(&vm, &ast, &result);
+            if (status == VM_OK && result.type == VAL_BOOL && result.boolean) continue;
+            printf("%s\n  run %d: ", c->source, run);
+            if (status == VM_OK) print_value(&result);
+            else printf("error");
+            printf("\n");
+            ok = 0;
+        }
+        vm_free(&vm);
+    }
+    free_ast(&ast);
+    ts_free(tokens);
+    return ok;
+}
+
+// A document that has been edited keeps the statements it re-parsed at the
+// end of its node array, after the ones that use them. typecheck() must
+// still see the declaration first.
+static int check_edited(void)
+{
+    static const char source[] = "var a Int32 := 1; var b Int32 := a + 1; b == 3;";
+    struct document doc;
+    int ok = document_open(&doc, source, strlen(source)) && document_edit(&doc, 15, 1, "2", 1) &&
+             doc.ast.root && resolve(&doc.ast, doc.ast.root);
+    struct type_table types = {0};
+    ok = ok && typecheck(&doc.ast, doc.ast.root, &types);
+    type_table_free(&types);
+    struct vm vm;
+    vm_init(&vm);
+    struct value result;
+    ok = ok && evaluate(&vm, &doc.ast, &result) == VM_OK && result.type == VAL_BOOL && result.boolean;
+    if (!ok) printf("%s\n  with 1 edited to 2 does not type or give true\n", source);
+    vm_free(&vm);
+    document_close(&doc);
+    return ok;
+}
+
+static int check(void)
+{
+    int ok = 1;
+    for (size_t i = 0; i < sizeof(fold_checks) / sizeof(fold_checks[0]); i++)
+    {
+        struct vm plain, folded;
+        vm_init(&plain);
+        vm_init(&folded);
+        struct value expected, actual;
+        const enum vm_status expected_status = run_source(fold_checks[i], 0, &plain, &expected);
+        const enum vm_status status = run_source(fold_checks[i], 1, &folded, &actual);
+        if (status != expected_status || (status == VM_OK && !values_equal(&expected, &actual)))
+        {
+            printf("%s\n  unfolded: ", fold_checks[i]);
+            if (expected_status == VM_OK) print_value(&expected);
+            else printf("error");
+            printf("\n  folded:   ");
+            if (status == VM_OK) print_value(&actual);
+            else printf("error");
+            printf("\n");
+            ok = 0;
+        }
+        vm_free(&plain);
+        vm_free(&folded);
+    }
+    const int saved = silence_stderr();
+    for (size_t i = 0; i < sizeof(scope_checks) / sizeof(scope_checks[0]); i++)
+        if (!check_scope(&scope_checks[i])) ok = 0;
+    if (!check_edited()) ok = 0;
+    restore_stderr(saved);
+    printf("check: %zu programs, %s\n",
+           sizeof(fold_checks) / sizeof(fold_checks[0]) + sizeof(scope_checks) / sizeof(scope_checks[0]) + 1,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(const int argc, const char** argv)
+{
+    if (argc > 1)
+    {
+        if (strcmp(argv[1], "--check") == 0) return check() ? 0 : 1;
+        fprintf(stderr, "Unknown option %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%-12s %12s %12s %8s\n", "workload", "walk ns/op", "vm ns/op", "speedup");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const struct workload* wl = &workloads[w];
+        size_t count;
+        struct lex_token* tokens = parse_text(wl->source, strlen(wl->source), &count);
+        struct ast ast;
+        ast_init(&ast);
+        parse(wl->source, strlen(wl->source), tokens, count, &ast);
+
+        double start = now();
+        for (int i = 0; i < wl->iterations; i++)
+        {
+            const struct value v = walk(&ast, ast.children[ast.nodes[ast.root].block.first]);
+            release(&v);
+        }
+        const double walk_ns = (now() - start) * 1e9 / wl->iterations;
+
+        struct chunk chunk;
+        chunk_init(&chunk);
+        compile(&ast, ast.root, &chunk);
+        struct vm vm;
+        vm_init(&vm);
+        struct value result;
+        start = now();
+        for (int i = 0; i < wl->iterations; i++) vm_run(&vm, &chunk, &result);
+        const double vm_ns = (now() - start) * 1e9 / wl->iterations;
+
+        printf("%-12s %12.1f %12.1f %7.2fx\n", wl->name, walk_ns, vm_ns, walk_ns / vm_ns);
+
+        vm_free(&vm);
+        chunk_free(&chunk);
+        free_ast(&ast);
+        ts_free(tokens);
+    }
+    return 0;
+}
@@ -1,42 +1,182 @@
 #include "lexer/lexer.h"
 #include <stdio.h>
 #include "utils/fs.h"
+#include "utils/pool.h"
+#include "utils/diag.h"
+#include "utils/alloc.h"
+#include "utils/stats.h"
 #include <string.h>
 
 #include "parser/ast.h"
 #include "parser/parser.h"
+#include "parser/ast_cache.h"
+#include "passes/fold.h"
+#include "passes/resolve.h"
+#include "passes/typecheck.h"
+#include "driver/batch.h"
+#include "vm/vm.h"
 
-int main(const int argc, const char **argv)
+// Lexes and parses the script into `ast`. Returns 0 after reporting an error.
+static int parse_source(const struct source_file *source, const long jobs, struct ast *ast)
 {
-    if (argc < 2)
-    {
-        fprintf(stderr, "Missing entrypoint argument.\n");
-        abort();
-    }
-    const char *filename = argv[1];
-    const char *file_contents = read_file(filename);
-    if (!file_contents) {
-        fprintf(stderr, "read_file returned NULL\n");
-        return 1;
-    }
-    const size_t file_size = strlen(file_contents);
+    // --jobs 0 uses every online CPU.
+    struct thread_pool *pool = thread_pool_create(jobs < 0 ? 1 : (size_t)jobs);
 
     size_t lex_token_size;
-    const struct lex_token *lex_token = parse_text(file_contents, file_size, &lex_token_size);
+    stats_start(STATS_LEX);
+    struct lex_token *lex_token = parse_text_parallel(source->data, source->length, &lex_token_size, pool);
+    stats_stop(STATS_LEX);
+    if (!lex_token) {
+        thread_pool_destroy(pool);
+        return 0;
+    }
 
 
     // for (int i = 0; i < lex_token_size; i++)
     // {
     //     const struct lex_token t = lex_token[i];
     //     const char *token_str = token_type_to_str(t.type);
-    //     char raw_token_text[t.length];
-    //     memcpy(raw_token_text, t.start, t.length);
+    //     char raw_token_text[t.length + 1];
+    //     memcpy(raw_token_text, source->data + t.offset, t.length);
     //     raw_token_text[t.length] = '\0';
     //     printf("token_type: %s: \"%s\"\n", token_str, raw_token_text);
     // }
 
-    const struct ast_node *ast_node = parse(lex_token, lex_token_size);
-    print_ast(ast_node);
+    stats_add(STATS_TOKENS, lex_token_size);
+    stats_start(STATS_PARSE);
+    const uint32_t root = parse_parallel(source->data, source->length, lex_token, lex_token_size, ast, pool);
+    stats_stop(STATS_PARSE);
+    ts_free(lex_token);
+    thread_pool_destroy(pool);
+    return root != 0;
+}
+
+int main(const int argc, const char **argv)
+{
+    const char *inputs[argc];
+    size_t input_count = 0;
+    int run = 0, batch = 0, cache = 0, check = 0;
+    long jobs = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--run") == 0) run = 1;
+        else if (strcmp(argv[i], "--batch") == 0) batch = 1;
+        else if (strcmp(argv[i], "--cache") == 0) cache = 1;
+        else if (strcmp(argv[i], "--check") == 0) check = 1;
+        else if (strcmp(argv[i], "--stats") == 0) stats_enable();
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = strtol(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) parse_set_max_depth(strtoul(argv[++i], NULL, 10));
+        else inputs[input_count++] = argv[i];
+    }
+
+    // --batch takes any number of files, directories and @lists and uses
+    // every CPU unless told otherwise; a single script defaults to one.
+    if (batch)
+    {
+        return run_batch(inputs, input_count, jobs < 0 ? 0 : (size_t)jobs) ? 1 : 0;
+    }
+
+    const char *filename = input_count ? inputs[input_count - 1] : NULL;
+    if (!filename)
+    {
+        fprintf(stderr, "Missing entrypoint argument.\n");
+        abort();
+    }
+    diag_set_source(filename);
+    struct source_file source;
+    stats_start(STATS_READ);
+    const int mapped = map_file(filename, &source);
+    stats_stop(STATS_READ);
+    if (!mapped) {
+        return 1;
+    }
+    stats_add(STATS_SOURCE_BYTES, source.length);
+
+    // --cache reuses the parse an earlier run saved next to the script, as
+    // long as the script has not changed since, and saves one otherwise.
+    char *cache_path = cache ? ast_cache_path(filename) : NULL;
+    struct ast_cache cached;
+    struct ast parsed;
+    struct ast *ast = &parsed;
+    int status = 0;
+    int hit = 0;
+    if (cache_path)
+    {
+        stats_start(STATS_CACHE);
+        hit = ast_cache_load(cache_path, source.data, source.length, &cached);
+        stats_stop(STATS_CACHE);
+    }
+    if (hit)
+    {
+        ast = &cached.ast;
+    }
+    else
+    {
+        ast_init(&parsed);
+        if (!parse_source(&source, jobs, &parsed)) status = 1;
+        else if (cache_path)
+        {
+            stats_start(STATS_CACHE);
+            ast_cache_save(cache_path, &parsed, source.data, source.length);
+            stats_stop(STATS_CACHE);
+        }
+    }
+    stats_add(STATS_NODES, ast->node_count);
+
+    if (!status && run)
+    {
+        stats_start(STATS_FOLD);
+        ast->root = fold_constants(ast, ast->root);
+        stats_stop(STATS_FOLD);
+    }
+
+    // Running needs the script's variables resolved to scoped slots, and
+    // --check types the script against its declarations as well; either
+    // stops on an error.
+    if (!status && (check || run) && !resolve(ast, ast->root)) status = 1;
+    if (!status && check)
+    {
+        struct type_table types;
+        if (!typecheck(ast, ast->root, &types)) status = 1;
+        type_table_free(&types);
+    }
+
+    if (!status && run)
+    {
+        stats_start(STATS_RUN);
+        struct vm vm;
+        vm_init(&vm);
+        struct value result;
+        if (evaluate(&vm, ast, &result) == VM_OK)
+        {
+            print_value(&result);
+            printf("\n");
+            fflush(stdout);
+        }
+        else status = 1;
+        vm_free(&vm);
+        stats_stop(STATS_RUN);
+    }
+    else if (!status)
+    {
+        stats_start(STATS_PRINT);
+        print_ast(ast);
+        fflush(stdout);
+        stats_stop(STATS_PRINT);
+    }
+
+    if (ast == &cached.ast) ast_cache_close(&cached);
+    else free_ast(&parsed);
+    ts_free(cache_path);
+    unmap_file(&source);
+
+    // --stats reports on stderr, after all of the script's own output.
+    if (stats_enabled())
+    {
+        struct ts_stats stats;
+        stats_get(&stats);
+        stats_print(&stats, stderr);
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "passes/fold.h"
+#include "passes/resolve.h"
+#include "utils/alloc.h"
+#include "utils/diag.h"
+#include "utils/fs.h"
+#include "utils/pool.h"
+#include "vm/compiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum batch_status
+{
+    BATCH_OK,
+    BATCH_READ_ERROR,
+    BATCH_PARSE_ERROR,
+    BATCH_RESOLVE_ERROR,
+    BATCH_COMPILE_ERROR,
+};
+
+static const char* const status_names[] = {"ok", "read", "parse", "resolve", "compile"};
+
+struct batch_result
+{
+    enum batch_status status;
+    size_t bytes;
+    uint32_t nodes;
+    double seconds;
+};
+
+// Scratch owned by one pool thread and reset, not freed, between files.
+struct batch_worker
+{
+    struct ast ast;
+    struct chunk chunk;
+    int ready;
+};
+
+struct batch_job
+{
+    const struct path_list* files;
+    struct batch_result* results;
+    struct batch_worker* workers;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static enum batch_status check_source(struct batch_worker* worker, const struct source_file* source,
+                                      struct batch_result* result)
+{
+    if (source->length > LEX_MAX_INPUT)
+    {
+        fprintf(stderr, "[lexer] %s: input exceeds the %zu byte limit\n", diag_source(), LEX_MAX_INPUT);
+        return BATCH_PARSE_ERROR;
+    }
+
+    struct lexer lexer;
+    lexer_init(&lexer, source->data, source->length);
+    ast_reset(&worker->ast);
+    if (!parse_stream(&lexer, &worker->ast)) return BATCH_PARSE_ERROR;
+    result->nodes = worker->ast.node_count;
+
+    worker->ast.root = fold_constants(&worker->ast, worker->ast.root);
+    if (!resolve(&worker->ast, worker->ast.root)) return BATCH_RESOLVE_ERROR;
+    chunk_reset(&worker->chunk);
+    return compile(&worker->ast, worker->ast.root, &worker->chunk) ? BATCH_OK : BATCH_COMPILE_ERROR;
+}
+
+static void check_file_task(void* context, const size_t index, const size_t worker_id)
+{
+    const struct batch_job* job = context;
+    struct batch_worker* worker = &job->workers[worker_id];
+    struct batch_result* result = &job->results[index];
+    const char* path = job->files->paths[index];
+
+    if (!worker->ready)
+    {
+        ast_init(&worker->ast);
+        chunk_init(&worker->chunk);
+        worker->ready = 1;
+    }
+
+    const double start = now();
+    diag_set_source(path);
+    struct source_file source;
+    if (map_file(path, &source))
+    {
+        result->bytes = source.length;
+        result->status = check_source(worker, &source, result);
+        unmap_file(&source);
+    }
+    else result->status = BATCH_READ_ERROR;
+    diag_set_source(NULL);
+    result->seconds = now() - start;
+}
+
+// "@file" names a list of inputs, one per line; blank lines are skipped.
+static int expand_list(const char* list_path, struct path_list* files)
+{
+    struct source_file list;
+    if (!map_file(list_path, &list)) return 0;
+
+    int ok = 1;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    for (size_t pos = 0; pos < list.length;)
+    {
+        const char* start = list.data + pos;
+        const char* newline = memchr(start, '\n', list.length - pos);
+        size_t length = newline ? (size_t)(newline - start) : list.length - pos;
+        pos += length + 1;
+        if (length > 0 && start[length - 1] == '\r') length--;
+        if (length == 0) continue;
+
+        if (length + 1 > line_capacity)
+        {
+            line_capacity = (length + 1) * 2;
+            char* grown = ts_realloc(line, line_capacity);
+            if (!grown)
+            {
+                fprintf(stderr, "Could not allocate memory for path list\n");
+                abort();
+            }
+            line = grown;
+        }
+        memcpy(line, start, length);
+        line[length] = '\0';
+        ok &= collect_files(line, files);
+    }
+    ts_free(line);
+    unmap_file(&list);
+    return ok;
+}
+
+size_t run_batch(const char* const* inputs, const size_t count, const size_t jobs)
+{
+    // Inputs that cannot be read or listed count as failures but do not stop
+    // the rest of the batch.
+    struct path_list files = {0};
+    size_t unreadable = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (inputs[i][0] == '@') unreadable += !expand_list(inputs[i] + 1, &files);
+        else unreadable += !collect_files(inputs[i], &files);
+    }
+    if (files.count == 0)
+    {
+        fprintf(stderr, "No input files.\n");
+        path_list_free(&files);
+        return unreadable ? unreadable : 1;
+    }
+
+    struct thread_pool* pool = thread_pool_create(jobs);
+    const size_t threads = thread_pool_size(pool);
+    struct batch_result* results = ts_calloc(files.count, sizeof(struct batch_result));
+    struct batch_worker* workers = ts_calloc(threads, sizeof(struct batch_worker));
+    if (!results || !workers)
+    {
+        fprintf(stderr, "Failed to allocate memory for batch\n");
+        abort();
+    }
+
+    struct batch_job job = {.files = &files, .results = results, .workers = workers};
+    const double start = now();
+    thread_pool_run(pool, check_file_task, &job, files.count);
+    const double elapsed = now() - start;
+
+    size_t failed = unreadable, bytes = 0;
+    for (size_t i = 0; i < files.count; i++)
+    {
+        const struct batch_result* result = &results[i];
+        printf("%-8s %12zu B %10u nodes %9.3f ms  %s\n", status_names[result->status], result->bytes,
+               result->nodes, result->seconds * 1e3, files.paths[i]);
+        failed += result->status != BATCH_OK;
+        bytes += result->bytes;
+    }
+    printf("%zu files, %zu failed, %.2f MB in %.1f ms on %zu threads: %.1f MB/s, %.0f files/s\n",
+           files.count, failed, (double)bytes / 1e6, elapsed * 1e3, threads,
+           (double)bytes / 1e6 / elapsed, (double)files.count / elapsed);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (!workers[i].ready) continue;
+        free_ast(&workers[i].ast);
+        chunk_free(&workers[i].chunk);
+    }
+    ts_free(workers);
+    ts_free(results);
+    thread_pool_destroy(pool);
+    path_list_free(&files);
+    return failed;
+}
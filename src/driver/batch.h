@@ -0,0 +1,12 @@
+#ifndef TS_BATCH_H
+#define TS_BATCH_H
+#include <stddef.h>
+
+// Reads, lexes, parses, resolves and compiles many scripts in one process.
+// Inputs are files, directories (searched recursively) or "@list" files
+// naming one path per line. Files are spread over a work-stealing pool of
+// `jobs` threads (0 means one per CPU) whose ASTs and chunks are reused from
+// file to file. Prints one line per file in input order and a throughput
+// summary, and returns the number of files that failed.
+size_t run_batch(const char* const* inputs, size_t count, size_t jobs);
+#endif
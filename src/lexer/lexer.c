@@ -1,261 +1,485 @@
 #include "lexer.h"
-#include <string.h>
-#include <ctype.h>
+#include "scan.h"
+#include "number.h"
+#include "lines.h"
+#include "utils/pool.h"
+#include "utils/diag.h"
+#include "utils/alloc.h"
 #include <stdio.h>
+#include <string.h>
+
+enum char_class
+{
+    CC_SPACE = 1 << 0,
+    CC_DIGIT = 1 << 1,
+    CC_IDENT_START = 1 << 2,
+    CC_IDENT_PART = 1 << 3,
+    CC_UPPER = 1 << 4,
+};
 
-#define MAX_TOKENS 1024
+#define __ 0
+#define SP CC_SPACE
+#define DG (CC_DIGIT | CC_IDENT_PART)
+#define LO (CC_IDENT_START | CC_IDENT_PART)
+#define UP (CC_IDENT_START | CC_IDENT_PART | CC_UPPER)
 
-static const char* keywords[] = {"var", "if", "else", "true", "false"};
-static enum token_type keyword_tokens[] = {
-    TOKEN_VAR, TOKEN_IF, TOKEN_ELSE, TOKEN_TRUE, TOKEN_FALSE
+// ASCII classification, independent of the C locale. Bytes >= 0x80 are
+// left unclassified and lex as TOKEN_UNKNOWN.
+static const unsigned char char_class[256] = {
+    __, __, __, __, __, __, __, __, __, SP, SP, SP, SP, SP, __, __, // 0x00
+    __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, // 0x10
+    SP, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, // 0x20
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, __, __, __, __, __, __, // 0x30
+    __, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, // 0x40
+    UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, __, __, __, __, LO, // 0x50
+    __, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, // 0x60
+    LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, LO, __, __, __, __, __, // 0x70
 };
 
-static enum token_type match_keyword(const char* start, const size_t length)
+#undef __
+#undef SP
+#undef DG
+#undef LO
+#undef UP
+
+#define CHAR_IS(c, cls) (char_class[(unsigned char)(c)] & (cls))
+
+// Keywords are few and short, so dispatch on length and first byte and
+// compare the remaining bytes inline.
+static enum token_type match_keyword(const char* s, const size_t length)
 {
-    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
+    switch (length)
     {
-        if (strlen(keywords[i]) == length && strncmp(start, keywords[i], length) == 0)
-            return keyword_tokens[i];
+    case 2:
+        if (s[0] == 'i' && s[1] == 'f') return TOKEN_IF;
+        break;
+    case 3:
+        if (s[0] == 'v' && s[1] == 'a' && s[2] == 'r') return TOKEN_VAR;
+        break;
+    case 4:
+        if (s[0] == 'e' && s[1] == 'l' && s[2] == 's' && s[3] == 'e') return TOKEN_ELSE;
+        if (s[0] == 't' && s[1] == 'r' && s[2] == 'u' && s[3] == 'e') return TOKEN_TRUE;
+        break;
+    case 5:
+        if (s[0] == 'f' && s[1] == 'a' && s[2] == 'l' && s[3] == 's' && s[4] == 'e') return TOKEN_FALSE;
+        break;
+    default:
+        break;
     }
     return TOKEN_IDENT;
 }
 
-static int is_identifier_start(const char c)
+static struct lex_token make_token(const enum token_type type, const size_t offset, const size_t len)
 {
-    return isalpha(c) || c == '_';
+    struct lex_token token;
+    token.type = (uint8_t)type;
+    token.offset = (uint32_t)offset;
+    token.length = (uint32_t)len;
+    return token;
 }
 
-static int is_identifier_part(const char c)
+static void report_unterminated_string(const struct lexer* lexer, const size_t offset)
 {
-    return isalnum(c) || c == '_';
+    struct line_index lines;
+    int line, column;
+    line_index_build(&lines, lexer->input, lexer->length);
+    line_index_locate(&lines, (uint32_t)offset, &line, &column);
+    line_index_free(&lines);
+    const char* name = diag_source();
+    if (name) fprintf(stderr, "[lexer] Unterminated string at %s:%d:%d\n", name, line, column);
+    else fprintf(stderr, "[lexer] Unterminated string at line %d, column %d\n", line, column);
 }
 
-static int is_type_name(const char* start, const size_t length)
+void lexer_init(struct lexer* lexer, const char* input, const size_t length)
 {
-    return length > 0 && isupper(start[0]);
+    lexer->input = input;
+    lexer->length = length;
+    lexer->pos = 0;
+    lexer->silent = 0;
 }
 
-static void add_token(struct lex_token* tokens, size_t* count,
-                      const enum token_type type, const char* start, const size_t len,
-                      const int line, const int column)
-{
-    if (*count >= MAX_TOKENS) return;
-    tokens[*count].type = type;
-    tokens[*count].start = start;
-    tokens[*count].length = len;
-    tokens[*count].line = line;
-    tokens[*count].column = column;
-    (*count)++;
-}
-
-struct lex_token* parse_text(const char* input, const size_t length, size_t* out_len)
+struct lex_token lexer_next(struct lexer* lexer)
 {
-    struct lex_token* tokens = calloc(MAX_TOKENS, sizeof(struct lex_token));
-    size_t count = 0;
-    size_t pos = 0;
-    int line = 1, column = 1;
+    const char* input = lexer->input;
+    const size_t length = lexer->length;
+    size_t pos = lexer->pos;
+    struct lex_token token;
 
     while (pos < length)
     {
         const char c = input[pos];
 
-        if (isspace(c))
+        if (CHAR_IS(c, CC_SPACE))
         {
-            if (c == '\n')
-            {
-                line++;
-                column = 1;
-            }
-            else column++;
-            pos++;
+            // Single separators are the common case; only hand longer runs
+            // (indentation, blank lines) to the bulk scanner.
+            if (pos + 1 >= length || !CHAR_IS(input[pos + 1], CC_SPACE)) pos++;
+            else pos = scan_whitespace(input, pos, length);
             continue;
         }
 
-        const char* start = &input[pos];
-        const int start_col = column;
+        const size_t start = pos;
 
-        if (is_identifier_start(c))
+        if (CHAR_IS(c, CC_IDENT_START))
         {
-            const size_t start_pos = pos;
-            while (pos < length && is_identifier_part(input[pos]))
-            {
-                pos++;
-                column++;
-            }
-            const size_t len = pos - start_pos;
-            enum token_type type = match_keyword(start, len);
-            if (type == TOKEN_IDENT && is_type_name(start, len))
+            const size_t short_end = pos + 8 < length ? pos + 8 : length;
+            pos++;
+            while (pos < short_end && CHAR_IS(input[pos], CC_IDENT_PART)) pos++;
+            if (pos == short_end) pos = scan_ident(input, pos, length);
+            const size_t len = pos - start;
+            enum token_type type;
+            if (CHAR_IS(c, CC_UPPER))
                 type = TOKEN_TYPE_NAME;
+            else
+                type = len <= 5 ? match_keyword(input + start, len) : TOKEN_IDENT;
 
-            add_token(tokens, &count, type, start, len, line, start_col);
-            continue;
+            token = make_token(type, start, len);
+            goto done;
         }
 
-        if (isdigit(c) || (c == '-' && isdigit(input[pos + 1])))
+        if (CHAR_IS(c, CC_DIGIT) || (c == '-' && pos + 1 < length && CHAR_IS(input[pos + 1], CC_DIGIT)))
         {
-            const size_t start_pos = pos;
-            if (input[pos] == '-')
-            {
-                pos++;
-                column++;
-            }
-            while (isdigit(input[pos]))
-            {
-                pos++;
-                column++;
-            }
-            if (input[pos] == '.')
-            {
-                pos++;
-                column++;
-                while (isdigit(input[pos]))
-                {
-                    pos++;
-                    column++;
-                }
-            }
-            if (input[pos] == 'e' || input[pos] == 'E')
-            {
-                pos++;
-                column++;
-                if (input[pos] == '+' || input[pos] == '-')
-                {
-                    pos++;
-                    column++;
-                }
-                while (isdigit(input[pos]))
-                {
-                    pos++;
-                    column++;
-                }
-            }
-            add_token(tokens, &count, TOKEN_NUMBER, start, pos - start_pos, line, start_col);
-            continue;
+            pos = skip_number(input, pos, length);
+            token = make_token(TOKEN_NUMBER, start, pos - start);
+            goto done;
         }
 
         if (c == '"')
         {
-            const size_t start_pos = pos++;
-            column++;
-            while (pos < length && input[pos] != '"')
-            {
-                if (input[pos] == '\\' && pos + 1 < length) pos++;
-                pos++;
-                column++;
-            }
-            if (input[pos] == '"')
+            pos++;
+            for (;;)
             {
-                pos++;
-                column++;
+                pos = scan_string(input, pos, length);
+                if (pos >= length || input[pos] == '"') break;
+                // Escape: skip the backslash and the escaped byte.
+                pos += pos + 1 < length ? 2 : 1;
             }
-            else fprintf(stderr, "[lexer] Unterminated string at line %d\n", line);
+            if (pos < length && input[pos] == '"') pos++;
+            else if (!lexer->silent) report_unterminated_string(lexer, start);
 
-            add_token(tokens, &count, TOKEN_STRING, start, pos - start_pos, line, start_col);
-            continue;
+            token = make_token(TOKEN_STRING, start, pos - start);
+            goto done;
         }
 
         if (pos + 1 < length)
         {
             const char next = input[pos + 1];
-            if (c == ':' && next == '=')
-            {
-                add_token(tokens, &count, TOKEN_DECL_ASSIGN, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '=' && next == '=')
-            {
-                add_token(tokens, &count, TOKEN_EQ, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '!' && next == '=')
-            {
-                add_token(tokens, &count, TOKEN_NEQ, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '<' && next == '=')
-            {
-                add_token(tokens, &count, TOKEN_LE, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '>' && next == '=')
-            {
-                add_token(tokens, &count, TOKEN_GE, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '&' && next == '&')
-            {
-                add_token(tokens, &count, TOKEN_AND, start, 2, line, column);
-                pos += 2;
-                column += 2;
-                continue;
-            }
-            if (c == '|' && next == '|')
+            enum token_type type = TOKEN_UNKNOWN;
+            if (c == ':' && next == '=') type = TOKEN_DECL_ASSIGN;
+            else if (c == '=' && next == '=') type = TOKEN_EQ;
+            else if (c == '!' && next == '=') type = TOKEN_NEQ;
+            else if (c == '<' && next == '=') type = TOKEN_LE;
+            else if (c == '>' && next == '=') type = TOKEN_GE;
+            else if (c == '&' && next == '&') type = TOKEN_AND;
+            else if (c == '|' && next == '|') type = TOKEN_OR;
+
+            if (type != TOKEN_UNKNOWN)
             {
-                add_token(tokens, &count, TOKEN_OR, start, 2, line, column);
+                token = make_token(type, start, 2);
                 pos += 2;
-                column += 2;
-                continue;
+                goto done;
             }
         }
 
+        enum token_type type;
         switch (c)
         {
-        case '=': add_token(tokens, &count, TOKEN_ASSIGN, start, 1, line, column);
+        case '=': type = TOKEN_ASSIGN;
             break;
-        case '!': add_token(tokens, &count, TOKEN_NOT, start, 1, line, column);
+        case '!': type = TOKEN_NOT;
             break;
-        case '+': add_token(tokens, &count, TOKEN_PLUS, start, 1, line, column);
+        case '+': type = TOKEN_PLUS;
             break;
-        case '-': add_token(tokens, &count, TOKEN_MINUS, start, 1, line, column);
+        case '-': type = TOKEN_MINUS;
             break;
-        case '*': add_token(tokens, &count, TOKEN_STAR, start, 1, line, column);
+        case '*': type = TOKEN_STAR;
             break;
-        case '/': add_token(tokens, &count, TOKEN_SLASH, start, 1, line, column);
+        case '/': type = TOKEN_SLASH;
             break;
-        case '<': add_token(tokens, &count, TOKEN_LT, start, 1, line, column);
+        case '<': type = TOKEN_LT;
             break;
-        case '>': add_token(tokens, &count, TOKEN_GT, start, 1, line, column);
+        case '>': type = TOKEN_GT;
             break;
-        case '(': add_token(tokens, &count, TOKEN_LPAREN, start, 1, line, column);
+        case '(': type = TOKEN_LPAREN;
             break;
-        case ')': add_token(tokens, &count, TOKEN_RPAREN, start, 1, line, column);
+        case ')': type = TOKEN_RPAREN;
             break;
-        case '{': add_token(tokens, &count, TOKEN_LBRACE, start, 1, line, column);
+        case '{': type = TOKEN_LBRACE;
             break;
-        case '}': add_token(tokens, &count, TOKEN_RBRACE, start, 1, line, column);
+        case '}': type = TOKEN_RBRACE;
             break;
-        case '[': add_token(tokens, &count, TOKEN_LBRACKET, start, 1, line, column);
+        case '[': type = TOKEN_LBRACKET;
             break;
-        case ']': add_token(tokens, &count, TOKEN_RBRACKET, start, 1, line, column);
+        case ']': type = TOKEN_RBRACKET;
             break;
-        case ',': add_token(tokens, &count, TOKEN_COMMA, start, 1, line, column);
+        case ',': type = TOKEN_COMMA;
             break;
-        case ';': add_token(tokens, &count, TOKEN_SEMICOLON, start, 1, line, column);
+        case ';': type = TOKEN_SEMICOLON;
             break;
-        case ':': add_token(tokens, &count, TOKEN_COLON, start, 1, line, column);
+        case ':': type = TOKEN_COLON;
             break;
         case '#':
-            while (pos < length && input[pos] != '\n') pos++;
-            break;
-        default: add_token(tokens, &count, TOKEN_UNKNOWN, start, 1, line, column);
+            pos = scan_line(input, pos, length);
+            continue;
+        default: type = TOKEN_UNKNOWN;
             break;
         }
+        token = make_token(type, start, 1);
         pos++;
-        column++;
+        goto done;
+    }
+
+    token = make_token(TOKEN_EOF, length, 0);
+
+done:
+    lexer->pos = pos;
+    return token;
+}
+
+static size_t estimate_token_count(const size_t length)
+{
+    // Generated scripts average roughly one token per 4-6 source bytes.
+    return length / 4 + 16;
+}
+
+struct token_buffer
+{
+    struct lex_token* tokens;
+    size_t count;
+    size_t capacity;
+};
+
+static void token_buffer_init(struct token_buffer* buffer, const size_t capacity)
+{
+    buffer->tokens = ts_malloc(capacity * sizeof(struct lex_token));
+    buffer->count = 0;
+    buffer->capacity = capacity;
+    if (!buffer->tokens)
+    {
+        fprintf(stderr, "Failed to allocate memory in parse_text\n");
+        abort();
+    }
+}
+
+static void token_buffer_push(struct token_buffer* buffer, const struct lex_token token)
+{
+    if (buffer->count == buffer->capacity)
+    {
+        buffer->capacity *= 2;
+        struct lex_token* grown = ts_realloc(buffer->tokens, buffer->capacity * sizeof(struct lex_token));
+        if (!grown)
+        {
+            fprintf(stderr, "Failed to reallocate memory in parse_text\n");
+            abort();
+        }
+        buffer->tokens = grown;
+    }
+    buffer->tokens[buffer->count++] = token;
+}
+
+// Lexes from `start`, keeping the tokens that begin before `end`, and
+// returns the offset of the first token that begins at or after it (the
+// input length at EOF).
+static size_t lex_range(struct lexer* lexer, const size_t start, const size_t end, struct token_buffer* out)
+{
+    lexer->pos = start;
+    for (;;)
+    {
+        const struct lex_token token = lexer_next(lexer);
+        if (token.type == TOKEN_EOF || token.offset >= end) return token.offset;
+        token_buffer_push(out, token);
+    }
+}
+
+// First of `count` tokens that starts at or after `offset`.
+static size_t lower_bound(const struct lex_token* tokens, const size_t count, const size_t offset)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (tokens[mid].offset < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+struct lex_token* parse_text(const char* input, const size_t length, size_t* out_len)
+{
+    if (length > LEX_MAX_INPUT)
+    {
+        fprintf(stderr, "[lexer] Input of %zu bytes exceeds the %zu byte limit\n", length, LEX_MAX_INPUT);
+        return NULL;
     }
 
-    *out_len = count;
-    return tokens;
+    struct token_buffer buffer;
+    token_buffer_init(&buffer, estimate_token_count(length));
+
+    struct lexer lexer;
+    lexer_init(&lexer, input, length);
+    lex_range(&lexer, 0, length, &buffer);
+
+    *out_len = buffer.count;
+    return buffer.tokens;
+}
+
+// Parallel lexing.
+//
+// The input is cut into chunks that start right after a newline, and every
+// chunk is lexed on its own as if nothing before it were open. That guess
+// is right unless the newline sits inside a string literal (comments end at
+// the newline, so they never cross a cut). Each chunk also reports where
+// the first token past its end begins; lexing from a token start is
+// deterministic, so the stitch pass only has to find that offset among the
+// next chunk's tokens. Everything before it is discarded; when it is not
+// there at all, the chunk started inside a string and is lexed again from
+// the correct offset.
+
+#define PARALLEL_MIN_CHUNK (256 * 1024)
+
+struct lex_chunk
+{
+    size_t start;
+    size_t end;
+    struct token_buffer tokens;
+    size_t next; // offset of the first token at or after `end`
+    size_t skip; // leading tokens to drop after stitching
+};
+
+struct parallel_lex
+{
+    const char* input;
+    size_t length;
+    struct lex_chunk* chunks;
+    struct lex_token* output;
+    size_t* output_offsets;
+};
+
+static void lex_chunk_task(void* context, const size_t index, const size_t worker)
+{
+    (void)worker;
+    const struct parallel_lex* job = context;
+    struct lex_chunk* chunk = &job->chunks[index];
+
+    struct lexer lexer;
+    lexer_init(&lexer, job->input, job->length);
+    lexer.silent = 1; // a wrong guess may see strings that do not exist
+    token_buffer_init(&chunk->tokens, estimate_token_count(chunk->end - chunk->start));
+    chunk->next = lex_range(&lexer, chunk->start, chunk->end, &chunk->tokens);
+    chunk->skip = 0;
+}
+
+static void copy_chunk_task(void* context, const size_t index, const size_t worker)
+{
+    (void)worker;
+    const struct parallel_lex* job = context;
+    const struct lex_chunk* chunk = &job->chunks[index];
+    memcpy(job->output + job->output_offsets[index], chunk->tokens.tokens + chunk->skip,
+           (chunk->tokens.count - chunk->skip) * sizeof(struct lex_token));
+}
+
+struct lex_token* parse_text_parallel(const char* input, const size_t length, size_t* out_len,
+                                      struct thread_pool* pool)
+{
+    const size_t threads = thread_pool_size(pool);
+    if (threads == 1 || length < 2 * PARALLEL_MIN_CHUNK || length > LEX_MAX_INPUT)
+        return parse_text(input, length, out_len);
+
+    // A few chunks per thread so an unlucky one does not hold up the rest.
+    size_t chunk_count = threads * 4;
+    if (length / chunk_count < PARALLEL_MIN_CHUNK) chunk_count = length / PARALLEL_MIN_CHUNK;
+
+    struct lex_chunk* chunks = ts_calloc(chunk_count, sizeof(struct lex_chunk));
+    if (!chunks)
+    {
+        fprintf(stderr, "Failed to allocate memory in parse_text_parallel\n");
+        abort();
+    }
+
+    size_t count = 0, start = 0;
+    for (size_t i = 0; i < chunk_count && start < length; i++)
+    {
+        size_t end = length;
+        if (i + 1 < chunk_count)
+        {
+            const char* newline = memchr(input + start + length / chunk_count, '\n',
+                                         length - start - length / chunk_count);
+            end = newline ? (size_t)(newline - input) + 1 : length;
+        }
+        chunks[count].start = start;
+        chunks[count].end = end;
+        count++;
+        start = end;
+    }
+
+    struct parallel_lex job = {.input = input, .length = length, .chunks = chunks};
+    thread_pool_run(pool, lex_chunk_task, &job, count);
+
+    // Stitch: carry the sequential lexer's position from chunk to chunk.
+    size_t total = chunks[0].tokens.count;
+    for (size_t i = 1; i < count; i++)
+    {
+        struct lex_chunk* chunk = &chunks[i];
+        const size_t expected = chunks[i - 1].next;
+        const size_t first = lower_bound(chunk->tokens.tokens, chunk->tokens.count, expected);
+        if (expected >= chunk->end)
+        {
+            // The previous chunk's last token runs past this whole chunk.
+            chunk->skip = chunk->tokens.count;
+            chunk->next = expected;
+        }
+        else if (first < chunk->tokens.count && chunk->tokens.tokens[first].offset == expected)
+        {
+            chunk->skip = first;
+        }
+        else
+        {
+            struct lexer lexer;
+            lexer_init(&lexer, input, length);
+            lexer.silent = 1;
+            chunk->tokens.count = 0;
+            chunk->next = lex_range(&lexer, expected, chunk->end, &chunk->tokens);
+        }
+        total += chunk->tokens.count - chunk->skip;
+    }
+
+    // The only string that can run off the end is the last token; report it
+    // once here instead of from whichever chunk happened to see it.
+    const struct lex_chunk* last = &chunks[count - 1];
+    if (last->tokens.count > last->skip)
+    {
+        const struct lex_token* token = &last->tokens.tokens[last->tokens.count - 1];
+        if (token->type == TOKEN_STRING && token->offset + token->length == length)
+        {
+            struct lexer lexer;
+            lexer_init(&lexer, input, length);
+            lexer.pos = token->offset;
+            lexer_next(&lexer);
+        }
+    }
+
+    size_t* offsets = ts_malloc(count * sizeof(size_t));
+    struct lex_token* output = ts_malloc((total ? total : 1) * sizeof(struct lex_token));
+    if (!offsets || !output)
+    {
+        fprintf(stderr, "Failed to allocate memory in parse_text_parallel\n");
+        abort();
+    }
+    for (size_t i = 0, at = 0; i < count; i++)
+    {
+        offsets[i] = at;
+        at += chunks[i].tokens.count - chunks[i].skip;
+    }
+    job.output = output;
+    job.output_offsets = offsets;
+    thread_pool_run(pool, copy_chunk_task, &job, count);
+
+    for (size_t i = 0; i < count; i++) ts_free(chunks[i].tokens.tokens);
+    ts_free(chunks);
+    ts_free(offsets);
+
+    *out_len = total;
+    return output;
 }
 
 const char* token_type_to_str(enum token_type type) {
@@ -310,3 +534,84 @@ const char* token_type_to_str(enum token_type type) {
         default:               return "TOKEN_<INVALID>";
     }
 }
+
+double lex_number_to_double(const struct lex_number* number)
+{
+    return number->is_integer ? (double)number->integer : number->real;
+}
+
+// Incremental re-lexing.
+//
+// Text before the edit is unchanged, and so is every token that starts
+// before the last one ahead of the edit; that token may merge with inserted
+// text, so lexing restarts at its start. Once a new token starts past the
+// inserted text at the shifted offset of an old token, the two lexers are in
+// step on identical text, and the old tokens from there on are kept.
+
+int relex(const char* input, const size_t length, const struct text_edit* edit, struct lex_token** tokens,
+          size_t* count, struct token_damage* damage)
+{
+    if (length > LEX_MAX_INPUT)
+    {
+        fprintf(stderr, "[lexer] Input of %zu bytes exceeds the %zu byte limit\n", length, LEX_MAX_INPUT);
+        return 0;
+    }
+
+    struct lex_token* old = *tokens;
+    const size_t old_count = *count;
+    size_t first = lower_bound(old, old_count, edit->offset), start = 0;
+    if (first > 0)
+    {
+        first--;
+        start = old[first].offset;
+    }
+
+    struct token_buffer fresh;
+    token_buffer_init(&fresh, 16);
+    struct lexer lexer;
+    lexer_init(&lexer, input, length);
+    lexer.pos = start;
+
+    const size_t edit_end = edit->offset + edit->inserted;
+    size_t resume = first;
+    for (;;)
+    {
+        const struct lex_token token = lexer_next(&lexer);
+        if (token.type == TOKEN_EOF)
+        {
+            resume = old_count;
+            break;
+        }
+        if (token.offset >= edit_end)
+        {
+            const size_t old_offset = token.offset - edit->inserted + edit->removed;
+            while (resume < old_count && old[resume].offset < old_offset) resume++;
+            if (resume < old_count && old[resume].offset == old_offset) break;
+        }
+        token_buffer_push(&fresh, token);
+    }
+
+    const size_t tail = old_count - resume;
+    const size_t new_count = first + fresh.count + tail;
+    if (new_count > old_count)
+    {
+        old = ts_realloc(old, new_count * sizeof(struct lex_token));
+        if (!old)
+        {
+            fprintf(stderr, "Failed to reallocate memory in relex\n");
+            abort();
+        }
+    }
+    memmove(old + first + fresh.count, old + resume, tail * sizeof(struct lex_token));
+    for (size_t i = first + fresh.count; i < new_count; i++)
+        old[i].offset = (uint32_t)(old[i].offset + edit->inserted - edit->removed);
+    memcpy(old + first, fresh.tokens, fresh.count * sizeof(struct lex_token));
+    ts_free(fresh.tokens);
+
+    damage->first = first;
+    damage->old_end = resume;
+    damage->new_end = first + fresh.count;
+    *tokens = old;
+    *count = new_count;
+    return 1;
+}
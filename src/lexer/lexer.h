@@ -1,5 +1,6 @@
 #ifndef TS_LEXER_H
 #define TS_LEXER_H
+#include <stdint.h>
 #include <stdlib.h>
 
 enum token_type
@@ -54,15 +55,77 @@ enum token_type
     TOKEN_UNKNOWN
 };
 
+// Value of a NUMBER literal. The lexer only finds where a literal ends; the
+// parser converts it with scan_number (lexer/number.h) when it builds the node.
+struct lex_number
+{
+    union
+    {
+        int64_t integer;
+        double real;
+    };
+    int is_integer;
+};
+
+// A token is a span of the source; its text is input + offset, its value
+// (for numbers) is computed by whoever consumes it, and its line and column
+// come from a line_index (lines.h) when a diagnostic needs them. Offsets are
+// 32-bit, so a single input is limited to LEX_MAX_INPUT bytes.
 struct lex_token
 {
-    enum token_type type;
-    const char* start;
+    uint8_t type; // enum token_type
+    uint32_t offset;
+    uint32_t length;
+};
+
+_Static_assert(sizeof(struct lex_token) == 12, "lex_token should stay 12 bytes");
+
+#define LEX_MAX_INPUT ((size_t)UINT32_MAX)
+
+struct lexer
+{
+    const char* input;
     size_t length;
-    int line;
-    int column;
+    size_t pos;
+    int silent; // suppress diagnostics
 };
 
+void lexer_init(struct lexer* lexer, const char* input, size_t length);
+// Returns the next token, or a TOKEN_EOF token once the input is exhausted.
+struct lex_token lexer_next(struct lexer* lexer);
+
+// Lexes the whole input into a heap array owned by the caller. Returns NULL
+// if the input is longer than LEX_MAX_INPUT.
 struct lex_token *parse_text(const char *input, size_t length, size_t *out_len);
+struct thread_pool;
+// Same result as parse_text, lexing chunks of the input on `pool`. Inputs
+// too small to be worth splitting are lexed sequentially.
+struct lex_token* parse_text_parallel(const char* input, size_t length, size_t* out_len,
+                                      struct thread_pool* pool);
+// An edit of lexed text: `removed` bytes at `offset` were replaced with
+// `inserted` new ones.
+struct text_edit
+{
+    size_t offset;
+    size_t removed;
+    size_t inserted;
+};
+
+// What relex() changed: tokens [first, old_end) of the old array became
+// [first, new_end) of the new one, and the ones after were only shifted.
+struct token_damage
+{
+    size_t first;
+    size_t old_end;
+    size_t new_end;
+};
+
+// Updates the `*count` tokens of a text to match its edited version `input`
+// after `edit`, re-lexing only around the edit; *tokens may be reallocated.
+// Returns 0, leaving the tokens alone, if the new text is longer than
+// LEX_MAX_INPUT.
+int relex(const char* input, size_t length, const struct text_edit* edit, struct lex_token** tokens, size_t* count,
+          struct token_damage* damage);
 const char* token_type_to_str(enum token_type);
+double lex_number_to_double(const struct lex_number* number);
 #endif
@@ -0,0 +1,59 @@
+#include "lines.h"
+#include "utils/alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void line_index_build(struct line_index* index, const char* input, const size_t length)
+{
+    size_t capacity = length / 32 + 16;
+    index->starts = ts_malloc(capacity * sizeof(uint32_t));
+    index->count = 0;
+    if (!index->starts)
+    {
+        fprintf(stderr, "Failed to allocate memory in line_index_build\n");
+        abort();
+    }
+
+    index->starts[index->count++] = 0;
+    const char* cursor = input;
+    const char* end = input + length;
+    while ((cursor = memchr(cursor, '\n', (size_t)(end - cursor))) != NULL)
+    {
+        cursor++;
+        if (index->count == capacity)
+        {
+            capacity *= 2;
+            uint32_t* grown = ts_realloc(index->starts, capacity * sizeof(uint32_t));
+            if (!grown)
+            {
+                fprintf(stderr, "Failed to reallocate memory in line_index_build\n");
+                abort();
+            }
+            index->starts = grown;
+        }
+        index->starts[index->count++] = (uint32_t)(cursor - input);
+    }
+}
+
+void line_index_locate(const struct line_index* index, const uint32_t offset, int* line, int* column)
+{
+    // Last line start <= offset; starts[0] is always 0.
+    size_t lo = 0, hi = index->count;
+    while (hi - lo > 1)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index->starts[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    *line = (int)lo + 1;
+    *column = (int)(offset - index->starts[lo]) + 1;
+}
+
+void line_index_free(struct line_index* index)
+{
+    ts_free(index->starts);
+    index->starts = NULL;
+    index->count = 0;
+}
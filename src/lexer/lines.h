@@ -0,0 +1,19 @@
+#ifndef TS_LINES_H
+#define TS_LINES_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte offsets of the first character of every line. Tokens only carry an
+// offset; diagnostics turn it back into a line and column through this
+// index, which is built on first use rather than tracked while lexing.
+struct line_index
+{
+    uint32_t* starts;
+    size_t count;
+};
+
+void line_index_build(struct line_index* index, const char* input, size_t length);
+// 1-based line and byte column of `offset`.
+void line_index_locate(const struct line_index* index, uint32_t offset, int* line, int* column);
+void line_index_free(struct line_index* index);
+#endif
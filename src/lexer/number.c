@@ -0,0 +1,222 @@
+#include "number.h"
+#include "pow5_table.h"
+#include "utils/alloc.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// More significant digits than this do not fit in the 64-bit mantissa.
+#define MAX_DIGITS 19
+
+static int is_digit(const char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static void mul_64x64(const uint64_t a, const uint64_t b, uint64_t* hi, uint64_t* lo)
+{
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 p = (unsigned __int128)a * b;
+    *hi = (uint64_t)(p >> 64);
+    *lo = (uint64_t)p;
+#else
+    const uint64_t a_lo = (uint32_t)a, a_hi = a >> 32, b_lo = (uint32_t)b, b_hi = b >> 32;
+    const uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+    const uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+    *lo = (mid << 32) | (uint32_t)p0;
+    *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+static int leading_zeros(const uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    for (uint64_t bit = 1ULL << 63; !(x & bit); bit >>= 1) n++;
+    return n;
+#endif
+}
+
+// Eisel-Lemire: w * 10^q rounded to nearest-even binary64, for 0 < w and at
+// most 19 decimal digits. Mirrors compute_float() from fast_float. As there,
+// the 128-bit product always decides the rounding (Mushtak and Lemire, "Fast
+// Number Parsing Without Fallback"), so this never defers to strtod; only
+// slow_path() does, for literals with more than 19 significant digits.
+static double eisel_lemire(const int64_t q, uint64_t w)
+{
+    if (q < POW5_MIN_EXPONENT) return 0.0;
+    if (q > POW5_MAX_EXPONENT) return HUGE_VAL;
+
+    const int lz = leading_zeros(w);
+    w <<= lz;
+
+    const size_t index = 2 * (size_t)(q - POW5_MIN_EXPONENT);
+    uint64_t hi, lo;
+    mul_64x64(w, pow5_128[index], &hi, &lo);
+    // Only when the low bits below the 55-bit precision are all ones can the
+    // truncated first product round the wrong way; refine with the second word.
+    if ((hi & 0x1FF) == 0x1FF)
+    {
+        uint64_t hi2, lo2;
+        mul_64x64(w, pow5_128[index + 1], &hi2, &lo2);
+        lo += hi2;
+        if (hi2 > lo) hi++;
+    }
+
+    const int upperbit = (int)(hi >> 63);
+    const int shift = upperbit + 64 - 52 - 3;
+    uint64_t mantissa = hi >> shift;
+    int32_t power2 = (int32_t)((((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023);
+
+    if (power2 <= 0)
+    {
+        // Subnormal result.
+        if (-power2 + 1 >= 64) return 0.0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (1ULL << 52) ? 0 : 1;
+    }
+    else
+    {
+        // Exactly halfway: round to even instead of up.
+        if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == hi)
+            mantissa &= ~1ULL;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        if (mantissa >= 2ULL << 52)
+        {
+            mantissa = 1ULL << 52;
+            power2++;
+        }
+        mantissa &= ~(1ULL << 52);
+        if (power2 >= 0x7FF) return HUGE_VAL;
+    }
+
+    const uint64_t bits = mantissa | (uint64_t)power2 << 52;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static double slow_path(const char* s, const size_t length)
+{
+    // Too many digits for a single 64-bit mantissa: let the C library do the
+    // arbitrary-precision work on a terminated copy.
+    char buffer[128];
+    char* copy = length < sizeof(buffer) ? buffer : ts_malloc(length + 1);
+    if (!copy) return 0.0;
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    const double d = strtod(copy, NULL);
+    if (copy != buffer) ts_free(copy);
+    return d;
+}
+
+size_t scan_number(const char* input, size_t pos, const size_t length, struct lex_number* out)
+{
+    const size_t start = pos;
+    const int negative = input[pos] == '-';
+    if (negative) pos++;
+
+    uint64_t w = 0;
+    int digits = 0; // significant digits folded into w
+    int dropped = 0; // significant digits that did not fit
+    int64_t exponent = 0;
+    int is_integer = 1;
+
+    for (; pos < length && is_digit(input[pos]); pos++)
+    {
+        if (digits < MAX_DIGITS)
+        {
+            w = w * 10 + (uint64_t)(input[pos] - '0');
+            if (w) digits++;
+        }
+        else
+        {
+            dropped++;
+            exponent++;
+        }
+    }
+
+    if (pos < length && input[pos] == '.')
+    {
+        is_integer = 0;
+        for (pos++; pos < length && is_digit(input[pos]); pos++)
+        {
+            if (digits < MAX_DIGITS)
+            {
+                w = w * 10 + (uint64_t)(input[pos] - '0');
+                if (w) digits++;
+                exponent--;
+            }
+            else dropped++;
+        }
+    }
+
+    if (pos < length && (input[pos] == 'e' || input[pos] == 'E'))
+    {
+        is_integer = 0;
+        pos++;
+        int exp_negative = 0;
+        if (pos < length && (input[pos] == '+' || input[pos] == '-'))
+        {
+            exp_negative = input[pos] == '-';
+            pos++;
+        }
+        int64_t e = 0;
+        for (; pos < length && is_digit(input[pos]); pos++)
+        {
+            if (e < 100000) e = e * 10 + (input[pos] - '0');
+        }
+        exponent += exp_negative ? -e : e;
+    }
+
+    if (is_integer && !dropped && (w <= INT64_MAX || (negative && w == (uint64_t)INT64_MAX + 1)))
+    {
+        out->is_integer = 1;
+        out->integer = negative ? (int64_t)(0 - w) : (int64_t)w;
+        return pos;
+    }
+
+    double d;
+    if (dropped) d = slow_path(input + start + negative, pos - start - negative);
+    else if (w == 0) d = 0.0;
+    else if (exponent >= -22 && exponent <= 22 && w <= 1ULL << 53)
+    {
+        // Clinger's fast path: both operands are exact, so one IEEE operation
+        // gives the correctly rounded result.
+        d = (double)w;
+        d = exponent < 0 ? d / exact_pow10[-exponent] : d * exact_pow10[exponent];
+    }
+    else d = eisel_lemire(exponent, w);
+
+    out->is_integer = 0;
+    out->real = negative ? -d : d;
+    return pos;
+}
+
+size_t skip_number(const char* input, size_t pos, const size_t length)
+{
+    if (input[pos] == '-') pos++;
+    while (pos < length && is_digit(input[pos])) pos++;
+    if (pos < length && input[pos] == '.')
+    {
+        for (pos++; pos < length && is_digit(input[pos]); pos++) {}
+    }
+    if (pos < length && (input[pos] == 'e' || input[pos] == 'E'))
+    {
+        pos++;
+        if (pos < length && (input[pos] == '+' || input[pos] == '-')) pos++;
+        while (pos < length && is_digit(input[pos])) pos++;
+    }
+    return pos;
+}
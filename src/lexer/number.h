@@ -0,0 +1,13 @@
+#ifndef TS_NUMBER_H
+#define TS_NUMBER_H
+#include <stddef.h>
+#include "lexer.h"
+
+// Scans a NUMBER lexeme ([-] digits [. digits] [(e|E) [+|-] digits]) starting
+// at input[pos], computing its value on the way, and returns the index just
+// past it. Literals without a fraction or exponent that fit in int64 come
+// back as integers; everything else is the correctly rounded double.
+size_t scan_number(const char* input, size_t pos, size_t length, struct lex_number* out);
+// Same grammar as scan_number, but only finds the end of the lexeme.
+size_t skip_number(const char* input, size_t pos, size_t length);
+#endif
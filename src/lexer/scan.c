@@ -0,0 +1,268 @@
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Without vector units, line and string bodies are still searched a word at
+// a time: a byte of `v` equal to `c` becomes zero in v ^ (ONES * c), and the
+// lowest zero byte sets the high bit of its byte in zero_bytes(). Bytes
+// above it may be flagged wrongly, which does not matter for finding the
+// first one.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_SWAR 1
+#define ONES 0x0101010101010101ull
+
+static uint64_t zero_bytes(const uint64_t v)
+{
+    return (v - ONES) & ~v & (ONES << 7);
+}
+
+static uint64_t load_word(const char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#endif
+
+static int is_space(const unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') < 5;
+}
+
+static int is_ident(const unsigned char c)
+{
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static size_t whitespace_scalar(const char* input, size_t pos, const size_t length)
+{
+    while (pos < length && is_space((unsigned char)input[pos])) pos++;
+    return pos;
+}
+
+static size_t ident_scalar(const char* input, size_t pos, const size_t length)
+{
+    while (pos < length && is_ident((unsigned char)input[pos])) pos++;
+    return pos;
+}
+
+static size_t line_scalar(const char* input, size_t pos, const size_t length)
+{
+#ifdef SCAN_SWAR
+    for (; pos + 8 <= length; pos += 8)
+    {
+        const uint64_t stop = zero_bytes(load_word(input + pos) ^ (ONES * '\n'));
+        if (stop) return pos + (size_t)__builtin_ctzll(stop) / 8;
+    }
+#endif
+    while (pos < length && input[pos] != '\n') pos++;
+    return pos;
+}
+
+static size_t string_scalar(const char* input, size_t pos, const size_t length)
+{
+#ifdef SCAN_SWAR
+    for (; pos + 8 <= length; pos += 8)
+    {
+        const uint64_t v = load_word(input + pos);
+        const uint64_t stop = zero_bytes(v ^ (ONES * '"')) | zero_bytes(v ^ (ONES * '\\'));
+        if (stop) return pos + (size_t)__builtin_ctzll(stop) / 8;
+    }
+#endif
+    while (pos < length && input[pos] != '"' && input[pos] != '\\') pos++;
+    return pos;
+}
+
+#ifdef SCAN_X86
+// SSE2 has no unsigned byte compare, so range checks bias both sides by 0x80
+// and use the signed one: (c - lo) < n  <=>  (c - lo - 128) < (n - 128).
+#define RANGE_SSE2(v, lo, n) \
+    _mm_cmplt_epi8(_mm_sub_epi8((v), _mm_set1_epi8((char)((lo) + 128))), _mm_set1_epi8((char)((n) - 128)))
+#define RANGE_AVX2(v, lo, n) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((n) - 128)), _mm256_sub_epi8((v), _mm256_set1_epi8((char)((lo) + 128))))
+
+static unsigned space_mask_sse2(const __m128i v)
+{
+    const __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(sp, RANGE_SSE2(v, '\t', 5)));
+}
+
+static unsigned ident_mask_sse2(const __m128i v)
+{
+    const __m128i alpha = RANGE_SSE2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+    const __m128i digit = RANGE_SSE2(v, '0', 10);
+    const __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+
+static size_t whitespace_sse2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 16 <= length)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(input + pos));
+        const unsigned run = ~space_mask_sse2(v) & 0xFFFF;
+        if (run) return pos + (size_t)__builtin_ctz(run);
+        pos += 16;
+    }
+    return whitespace_scalar(input, pos, length);
+}
+
+static size_t ident_sse2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 16 <= length)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(input + pos));
+        const unsigned stop = ~ident_mask_sse2(v) & 0xFFFF;
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 16;
+    }
+    return ident_scalar(input, pos, length);
+}
+
+static size_t line_sse2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 16 <= length)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(input + pos));
+        const unsigned stop = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 16;
+    }
+    return line_scalar(input, pos, length);
+}
+
+static size_t string_sse2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 16 <= length)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(input + pos));
+        const __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+        const __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+        const unsigned stop = (unsigned)_mm_movemask_epi8(_mm_or_si128(quote, slash));
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 16;
+    }
+    return string_scalar(input, pos, length);
+}
+
+__attribute__((target("avx2")))
+static size_t whitespace_avx2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 32 <= length)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(input + pos));
+        const __m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+        const unsigned run = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(sp, RANGE_AVX2(v, '\t', 5)));
+        if (run) return pos + (size_t)__builtin_ctz(run);
+        pos += 32;
+    }
+    return whitespace_sse2(input, pos, length);
+}
+
+__attribute__((target("avx2")))
+static size_t ident_avx2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 32 <= length)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(input + pos));
+        const __m256i alpha = RANGE_AVX2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26);
+        const __m256i digit = RANGE_AVX2(v, '0', 10);
+        const __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        const unsigned stop = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 32;
+    }
+    return ident_sse2(input, pos, length);
+}
+
+__attribute__((target("avx2")))
+static size_t line_avx2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 32 <= length)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(input + pos));
+        const unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 32;
+    }
+    return line_sse2(input, pos, length);
+}
+
+__attribute__((target("avx2")))
+static size_t string_avx2(const char* input, size_t pos, const size_t length)
+{
+    while (pos + 32 <= length)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(input + pos));
+        const __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        const __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+        const unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(quote, slash));
+        if (stop) return pos + (size_t)__builtin_ctz(stop);
+        pos += 32;
+    }
+    return string_sse2(input, pos, length);
+}
+#endif
+
+struct scan_ops
+{
+    size_t (*whitespace)(const char*, size_t, size_t);
+    size_t (*ident)(const char*, size_t, size_t);
+    size_t (*line)(const char*, size_t, size_t);
+    size_t (*string)(const char*, size_t, size_t);
+};
+
+static struct scan_ops ops = {whitespace_scalar, ident_scalar, line_scalar, string_scalar};
+
+void scan_use(const enum cpu_level level)
+{
+    ops = (struct scan_ops){whitespace_scalar, ident_scalar, line_scalar, string_scalar};
+#ifdef SCAN_X86
+    switch (level)
+    {
+    case CPU_AVX2:
+        ops = (struct scan_ops){whitespace_avx2, ident_avx2, line_avx2, string_avx2};
+        break;
+    case CPU_SSE2:
+        ops = (struct scan_ops){whitespace_sse2, ident_sse2, line_sse2, string_sse2};
+        break;
+    default:
+        break;
+    }
+#else
+    (void)level;
+#endif
+}
+
+#ifdef SCAN_X86
+__attribute__((constructor))
+static void scan_select(void)
+{
+    scan_use(cpu_detect());
+}
+#endif
+
+size_t scan_whitespace(const char* input, const size_t pos, const size_t length)
+{
+    return ops.whitespace(input, pos, length);
+}
+
+size_t scan_ident(const char* input, const size_t pos, const size_t length)
+{
+    return ops.ident(input, pos, length);
+}
+
+size_t scan_line(const char* input, const size_t pos, const size_t length)
+{
+    return ops.line(input, pos, length);
+}
+
+size_t scan_string(const char* input, const size_t pos, const size_t length)
+{
+    return ops.string(input, pos, length);
+}
@@ -0,0 +1,23 @@
+#ifndef TS_SCAN_H
+#define TS_SCAN_H
+#include <stddef.h>
+#include "utils/cpu.h"
+
+// Bulk scanners used by the lexer for long runs of uninteresting bytes. Each
+// one starts at `pos` and returns the index of the first byte that ends the
+// run, or `length`. The vector variants are selected once at startup.
+
+// Skips whitespace.
+size_t scan_whitespace(const char* input, size_t pos, size_t length);
+// Skips [A-Za-z0-9_].
+size_t scan_ident(const char* input, size_t pos, size_t length);
+// Skips to the next '\n'.
+size_t scan_line(const char* input, size_t pos, size_t length);
+// Skips to the next '"' or '\\'.
+size_t scan_string(const char* input, size_t pos, size_t length);
+
+// Switches every scanner to the versions for `level`, which the CPU must
+// support (see cpu_detect()). Not thread-safe; meant for checks that compare
+// the versions against each other.
+void scan_use(enum cpu_level level);
+#endif
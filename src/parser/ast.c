@@ -2,8 +2,263 @@
 // Created by evgen on 18.07.2025.
 //
 #include "ast.h"
+#include "utils/alloc.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// An array with a capacity of 0 but a non-NULL pointer is borrowed (see
+// ast.h): the first growth copies its `count` items into memory of its own.
+static void grow(void** items, const uint32_t count, uint32_t* capacity, const size_t item_size,
+                 const uint32_t needed) {
+    if (needed <= *capacity) return;
+    uint32_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed) new_capacity *= 2;
+    const int borrowed = *capacity == 0 && *items;
+    void* grown = borrowed ? ts_malloc((size_t)new_capacity * item_size)
+                           : ts_realloc(*items, (size_t)new_capacity * item_size);
+    if (!grown) {
+        fprintf(stderr, "Failed to allocate memory for AST\n");
+        abort();
+    }
+    if (borrowed && count) memcpy(grown, *items, (size_t)count * item_size);
+    *items = grown;
+    *capacity = new_capacity;
+}
+
+static void release(void* items, const uint32_t capacity) {
+    if (capacity) ts_free(items);
+}
+
+void ast_init(struct ast* ast) {
+    memset(ast, 0, sizeof(*ast));
+    interner_init(&ast->names);
+    ast_reset(ast);
+}
+
+void ast_reset(struct ast* ast) {
+    ast->node_count = 0;
+    ast->child_count = 0;
+    ast->number_count = 0;
+    ast->root = 0;
+    interner_reset(&ast->names);
+    ast_add_node(ast, (struct ast_node){ .type = AST_NONE });
+}
+
+void free_ast(struct ast* ast) {
+    release(ast->nodes, ast->node_capacity);
+    release(ast->children, ast->child_capacity);
+    release(ast->numbers, ast->number_capacity);
+    interner_free(&ast->names);
+    memset(ast, 0, sizeof(*ast));
+}
+
+uint32_t ast_add_node(struct ast* ast, const struct ast_node node) {
+    grow((void**)&ast->nodes, ast->node_count, &ast->node_capacity, sizeof(struct ast_node), ast->node_count + 1);
+    ast->nodes[ast->node_count] = node;
+    return ast->node_count++;
+}
+
+uint32_t ast_add_children(struct ast* ast, const uint32_t* items, const uint32_t count) {
+    if (!count) return 0;
+    grow((void**)&ast->children, ast->child_count, &ast->child_capacity, sizeof(uint32_t), ast->child_count + count);
+    const uint32_t first = ast->child_count;
+    if (count) memcpy(ast->children + first, items, count * sizeof(uint32_t));
+    ast->child_count += count;
+    return first;
+}
+
+uint32_t ast_add_number(struct ast* ast, const struct lex_number value) {
+    grow((void**)&ast->numbers, ast->number_count, &ast->number_capacity, sizeof(struct lex_number),
+         ast->number_count + 1);
+    ast->numbers[ast->number_count] = value;
+    return ast->number_count++;
+}
+
+void ast_reserve(struct ast* ast, const uint32_t nodes, const uint32_t children, const uint32_t numbers) {
+    grow((void**)&ast->nodes, ast->node_count, &ast->node_capacity, sizeof(struct ast_node), ast->node_count + nodes);
+    grow((void**)&ast->children, ast->child_count, &ast->child_capacity, sizeof(uint32_t), ast->child_count + children);
+    grow((void**)&ast->numbers, ast->number_count, &ast->number_capacity, sizeof(struct lex_number),
+         ast->number_count + numbers);
+}
+
+static uint32_t shift_node(const uint32_t index, const struct ast_rebase* rebase) {
+    return index ? index + rebase->node_shift : 0;
+}
+
+static uint32_t shift_run(const uint32_t first, const uint32_t count, const struct ast_rebase* rebase) {
+    return count ? first + rebase->child_shift : 0;
+}
+
+void ast_rebase_node(struct ast_node* node, const struct ast_rebase* rebase) {
+    switch (node->type) {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            node->block.first = shift_run(node->block.first, node->block.count, rebase);
+            break;
+        case AST_IF:
+            node->if_statement.condition = shift_node(node->if_statement.condition, rebase);
+            node->if_statement.then_branch = shift_node(node->if_statement.then_branch, rebase);
+            node->if_statement.else_branch = shift_node(node->if_statement.else_branch, rebase);
+            break;
+        case AST_ASSIGNMENT:
+            node->assignment.name = rebase->names[node->assignment.name];
+            node->assignment.expression = shift_node(node->assignment.expression, rebase);
+            break;
+        case AST_DECLARATION:
+            node->declaration.name = rebase->names[node->declaration.name];
+            node->declaration.type = shift_node(node->declaration.type, rebase);
+            node->declaration.expression = shift_node(node->declaration.expression, rebase);
+            break;
+        case AST_TYPE:
+            node->type_annotation.name = rebase->names[node->type_annotation.name];
+            node->type_annotation.first = shift_run(node->type_annotation.first, node->type_annotation.count, rebase);
+            break;
+        case AST_NUMBER:
+            node->number.index += rebase->number_shift;
+            break;
+        case AST_IDENT:
+            node->ident.name = rebase->names[node->ident.name];
+            break;
+        case AST_LIST:
+            node->list.first = shift_run(node->list.first, node->list.count, rebase);
+            break;
+        case AST_UNARY:
+            node->unary.operand = shift_node(node->unary.operand, rebase);
+            break;
+        case AST_BINARY:
+            node->binary.left = shift_node(node->binary.left, rebase);
+            node->binary.right = shift_node(node->binary.right, rebase);
+            break;
+        default:
+            break;
+    }
+}
+
+static void mark_run(const struct ast* ast, const uint32_t first, const uint32_t count, uint8_t* live) {
+    for (uint32_t i = 0; i < count; i++) live[ast->children[first + i]] = 1;
+}
+
+static void mark_children(const struct ast* ast, const struct ast_node* node, uint8_t* live) {
+    switch (node->type) {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            mark_run(ast, node->block.first, node->block.count, live);
+            break;
+        case AST_IF:
+            live[node->if_statement.condition] = 1;
+            live[node->if_statement.then_branch] = 1;
+            live[node->if_statement.else_branch] = 1;
+            break;
+        case AST_ASSIGNMENT:
+            live[node->assignment.expression] = 1;
+            break;
+        case AST_DECLARATION:
+            live[node->declaration.type] = 1;
+            live[node->declaration.expression] = 1;
+            break;
+        case AST_TYPE:
+            mark_run(ast, node->type_annotation.first, node->type_annotation.count, live);
+            break;
+        case AST_LIST:
+            mark_run(ast, node->list.first, node->list.count, live);
+            break;
+        case AST_UNARY:
+            live[node->unary.operand] = 1;
+            break;
+        case AST_BINARY:
+            live[node->binary.left] = 1;
+            live[node->binary.right] = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t copy_run(struct ast* to, const struct ast* from, const uint32_t first, const uint32_t count,
+                         const uint32_t* remap) {
+    for (uint32_t i = 0; i < count; i++) {
+        grow((void**)&to->children, to->child_count, &to->child_capacity, sizeof(uint32_t), to->child_count + 1);
+        to->children[to->child_count++] = remap[from->children[first + i]];
+    }
+    return count ? to->child_count - count : 0;
+}
+
+void ast_compact(struct ast* ast, uint32_t* roots, const size_t count) {
+    uint8_t* live = ts_calloc(ast->node_count, 1);
+    uint32_t* remap = ts_calloc(ast->node_count, sizeof(uint32_t));
+    if (!live || !remap) {
+        fprintf(stderr, "Failed to allocate memory for AST\n");
+        abort();
+    }
+
+    // Children always sit below their parent, so one pass from the top
+    // reaches everything a root does.
+    for (size_t i = 0; i < count; i++) live[roots[i]] = 1;
+    for (uint32_t i = ast->node_count; i-- > 1;) {
+        if (live[i]) mark_children(ast, &ast->nodes[i], live);
+    }
+
+    // Names are kept as they are, so name ids do not change.
+    struct ast out;
+    memset(&out, 0, sizeof(out));
+    out.names = ast->names;
+    ast_add_node(&out, (struct ast_node){ .type = AST_NONE });
+    for (uint32_t i = 1; i < ast->node_count; i++) {
+        if (!live[i]) continue;
+        struct ast_node node = ast->nodes[i];
+        switch (node.type) {
+            case AST_PROGRAM:
+            case AST_BLOCK:
+                node.block.first = copy_run(&out, ast, node.block.first, node.block.count, remap);
+                break;
+            case AST_IF:
+                node.if_statement.condition = remap[node.if_statement.condition];
+                node.if_statement.then_branch = remap[node.if_statement.then_branch];
+                node.if_statement.else_branch = remap[node.if_statement.else_branch];
+                break;
+            case AST_ASSIGNMENT:
+                node.assignment.expression = remap[node.assignment.expression];
+                break;
+            case AST_DECLARATION:
+                node.declaration.type = remap[node.declaration.type];
+                node.declaration.expression = remap[node.declaration.expression];
+                break;
+            case AST_TYPE:
+                node.type_annotation.first =
+                    copy_run(&out, ast, node.type_annotation.first, node.type_annotation.count, remap);
+                break;
+            case AST_NUMBER:
+                node.number.index = ast_add_number(&out, ast->numbers[node.number.index]);
+                break;
+            case AST_LIST:
+                node.list.first = copy_run(&out, ast, node.list.first, node.list.count, remap);
+                break;
+            case AST_UNARY:
+                node.unary.operand = remap[node.unary.operand];
+                break;
+            case AST_BINARY:
+                node.binary.left = remap[node.binary.left];
+                node.binary.right = remap[node.binary.right];
+                break;
+            default:
+                break;
+        }
+        remap[i] = ast_add_node(&out, node);
+    }
+    for (size_t i = 0; i < count; i++) roots[i] = remap[roots[i]];
+
+    ts_free(live);
+    ts_free(remap);
+    release(ast->nodes, ast->node_capacity);
+    release(ast->children, ast->child_capacity);
+    release(ast->numbers, ast->number_capacity);
+    *ast = out;
+}
+
+double ast_number_value(const struct ast* ast, uint32_t node) {
+    return lex_number_to_double(&ast->numbers[ast->nodes[node].number.index]);
+}
 
 static void print_indent(int level) {
     for (int i = 0; i < level; i++) {
@@ -11,144 +266,176 @@ static void print_indent(int level) {
     }
 }
 
-static void print_type_annotation(const struct type_annotation* type, int level) {
-    if (!type) {
-        print_indent(level);
-        printf("null\n");
+// print_ast() walks the tree on an explicit stack so that arbitrarily deep
+// nesting cannot overflow the C stack. Each item prints one node, one
+// label line or one piece of a type annotation.
+enum print_step {
+    PRINT_NODE,
+    PRINT_LABEL,
+    PRINT_ELEMENT,
+    PRINT_TYPE,
+    PRINT_TEXT,
+};
+
+struct print_item {
+    uint8_t step;
+    int level;
+    uint32_t value; // node index, or list element number
+    const char* text;
+};
+
+struct print_stack {
+    struct print_item* items;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static void push(struct print_stack* stack, const struct print_item item) {
+    grow((void**)&stack->items, stack->count, &stack->capacity, sizeof(struct print_item), stack->count + 1);
+    stack->items[stack->count++] = item;
+}
+
+static void push_node(struct print_stack* stack, const uint32_t index, const int level) {
+    push(stack, (struct print_item){ .step = PRINT_NODE, .level = level, .value = index });
+}
+
+// Pushes a labelled child: the label line, then the child one level deeper.
+static void push_child(struct print_stack* stack, const char* label, const uint32_t index, const int level) {
+    push_node(stack, index, level + 1);
+    push(stack, (struct print_item){ .step = PRINT_LABEL, .level = level, .text = label });
+}
+
+// Prints a type annotation inline: its name, then its arguments in
+// angle brackets.
+static void print_type(const struct ast* ast, struct print_stack* stack, const uint32_t index) {
+    const struct ast_node* type = &ast->nodes[index];
+    if (type->type != AST_TYPE) {
+        printf("null");
         return;
     }
-    print_indent(level);
-    printf("Type: %s", type->type_name);
-    if (type->generic_count > 0) {
+    printf("%s", interner_lookup(&ast->names, type->type_annotation.name));
+    if (type->type_annotation.count > 0) {
         printf("<");
-        for (size_t i = 0; i < type->generic_count; i++) {
-            if (i > 0) printf(", ");
-            print_type_annotation(type->generic_types[i], level);
+        push(stack, (struct print_item){ .step = PRINT_TEXT, .text = ">" });
+        for (uint32_t i = type->type_annotation.count; i-- > 0;) {
+            push(stack, (struct print_item){ .step = PRINT_TYPE, .value = ast->children[type->type_annotation.first + i] });
+            if (i > 0) push(stack, (struct print_item){ .step = PRINT_TEXT, .text = ", " });
         }
-        printf(">");
     }
-    printf("\n");
 }
 
-void print_ast(const struct ast_node* node) {
-    static int indent_level = 0;
+// Prints the first line of a node and pushes whatever follows it, in
+// reverse so that it comes off the stack in order.
+static void print_node(const struct ast* ast, struct print_stack* stack, uint32_t index, int level) {
+    const struct ast_node* node = &ast->nodes[index];
 
-    if (!node) {
-        print_indent(indent_level);
-        printf("null\n");
-        return;
-    }
-
-    print_indent(indent_level);
+    print_indent(level);
     switch (node->type) {
-        case AST_DECLARATION: {
+        case AST_NONE:
+            printf("null\n");
+            break;
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            printf(node->type == AST_PROGRAM ? "Program:\n" : "Block:\n");
+            for (uint32_t i = node->block.count; i-- > 0;) {
+                push_node(stack, ast->children[node->block.first + i], level + 1);
+            }
+            break;
+        case AST_IF:
+            printf("If:\n");
+            if (node->if_statement.else_branch) {
+                push_child(stack, "Else:", node->if_statement.else_branch, level + 1);
+            }
+            push_child(stack, "Then:", node->if_statement.then_branch, level + 1);
+            push_child(stack, "Condition:", node->if_statement.condition, level + 1);
+            break;
+        case AST_ASSIGNMENT:
+            printf("Assignment:\n");
+            print_indent(level + 1);
+            printf("Identifier: %s\n", interner_lookup(&ast->names, node->assignment.name));
+            push_child(stack, "Expression:", node->assignment.expression, level + 1);
+            break;
+        case AST_DECLARATION:
             printf("Declaration:\n");
-            indent_level++;
-            print_indent(indent_level);
-            printf("Identifier: %s\n", node->declaration.ident);
-            print_indent(indent_level);
-            printf("Type Annotation:\n");
-            indent_level++;
-            print_type_annotation(node->declaration.type, indent_level);
-            indent_level--;
-            print_indent(indent_level);
-            printf("Expression:\n");
-            indent_level++;
-            print_ast(node->declaration.expression);
-            indent_level--;
-            indent_level--;
+            print_indent(level + 1);
+            printf("Identifier: %s\n", interner_lookup(&ast->names, node->declaration.name));
+            print_indent(level + 1);
+            printf("Type: ");
+            push_child(stack, "Expression:", node->declaration.expression, level + 1);
+            push(stack, (struct print_item){ .step = PRINT_TEXT, .text = "\n" });
+            print_type(ast, stack, node->declaration.type);
+            break;
+        case AST_TYPE:
+            printf("Type: ");
+            push(stack, (struct print_item){ .step = PRINT_TEXT, .text = "\n" });
+            print_type(ast, stack, index);
+            break;
+        case AST_NUMBER: {
+            const struct lex_number* number = &ast->numbers[node->number.index];
+            if (number->is_integer) printf("Number: %lld\n", (long long)number->integer);
+            else printf("Number: %g\n", number->real);
             break;
         }
-        case AST_EXPRESSION: {
-            printf("Expression:\n");
-            indent_level++;
-            if (node->number.value) {
-                print_indent(indent_level);
-                printf("Number: %f\n", node->number.value);
-            } else if (node->boolean.value) {
-                print_indent(indent_level);
-                printf("Boolean: %s\n", node->boolean.value ? "true" : "false");
-            } else if (node->ident.name) {
-                print_indent(indent_level);
-                printf("Identifier: %s\n", node->ident.name);
-            } else if (node->list.element_count > 0 || node->list.elements) {
-                print_indent(indent_level);
-                printf("List:\n");
-                indent_level++;
-                for (size_t i = 0; i < node->list.element_count; i++) {
-                    print_indent(indent_level);
-                    printf("Element %zu:\n", i);
-                    indent_level++;
-                    print_ast(node->list.elements[i]);
-                    indent_level--;
-                }
-                indent_level--;
-            } else if (node->binary.op) {
-                print_indent(indent_level);
-                printf("Binary Operation: %s\n", token_type_to_str(node->binary.op));
-                indent_level++;
-                print_indent(indent_level);
-                printf("Left:\n");
-                indent_level++;
-                print_ast(node->binary.left);
-                indent_level--;
-                print_indent(indent_level);
-                printf("Right:\n");
-                indent_level++;
-                print_ast(node->binary.right);
-                indent_level--;
-                indent_level--;
-            } else {
-                print_indent(indent_level);
-                printf("Empty Expression\n");
+        case AST_BOOLEAN:
+            printf("Boolean: %s\n", node->boolean.value ? "true" : "false");
+            break;
+        case AST_IDENT:
+            printf("Identifier: %s\n", interner_lookup(&ast->names, node->ident.name));
+            break;
+        case AST_LIST:
+            printf("List:\n");
+            for (uint32_t i = node->list.count; i-- > 0;) {
+                push_node(stack, ast->children[node->list.first + i], level + 2);
+                push(stack, (struct print_item){ .step = PRINT_ELEMENT, .level = level + 1, .value = i });
             }
-            indent_level--;
             break;
-        }
+        case AST_UNARY:
+            printf("Unary Operation: %s\n", token_type_to_str(node->op));
+            push_node(stack, node->unary.operand, level + 1);
+            break;
+        case AST_BINARY:
+            printf("Binary Operation: %s\n", token_type_to_str(node->op));
+            push_child(stack, "Right:", node->binary.right, level + 1);
+            push_child(stack, "Left:", node->binary.left, level + 1);
+            break;
         default:
-            print_indent(indent_level);
             printf("Unknown node type: %d\n", node->type);
             break;
     }
 }
 
-void free_ast(struct ast_node* node) {
-    if (!node) return;
-
-    switch (node->type) {
-        case AST_DECLARATION: {
-            free((char*)node->declaration.ident);
-            if (node->declaration.type) {
-                free((char*)node->declaration.type->type_name);
-                for (size_t i = 0; i < node->declaration.type->generic_count; i++) {
-                    if (node->declaration.type->generic_types[i]) {
-                        free((char*)node->declaration.type->generic_types[i]->type_name);
-                        free(node->declaration.type->generic_types[i]);
-                    }
-                }
-                free(node->declaration.type->generic_types);
-                free(node->declaration.type);
-            }
-            free_ast(node->declaration.expression);
-            break;
+static void print_tree(const struct ast* ast, uint32_t root) {
+    struct print_stack stack = { 0 };
+    push_node(&stack, root, 0);
+    while (stack.count) {
+        const struct print_item item = stack.items[--stack.count];
+        switch (item.step) {
+            case PRINT_NODE:
+                print_node(ast, &stack, item.value, item.level);
+                break;
+            case PRINT_LABEL:
+                print_indent(item.level);
+                printf("%s\n", item.text);
+                break;
+            case PRINT_ELEMENT:
+                print_indent(item.level);
+                printf("Element %u:\n", item.value);
+                break;
+            case PRINT_TYPE:
+                print_type(ast, &stack, item.value);
+                break;
+            default:
+                printf("%s", item.text);
+                break;
         }
-        case AST_EXPRESSION: {
-            if (node->ident.name) {
-                free((char*)node->ident.name);
-            } else if (node->list.elements) {
-                for (size_t i = 0; i < node->list.element_count; i++) {
-                    free_ast(node->list.elements[i]);
-                }
-                free(node->list.elements);
-            } else if (node->binary.op) {
-                free_ast(node->binary.left);
-                free_ast(node->binary.right);
-            }
-            break;
-        }
-        default:
-            fprintf(stderr, "Unknown node type: %d\n", node->type);
-            break;
     }
-    free(node);
-}
\ No newline at end of file
+    ts_free(stack.items);
+}
+
+void print_ast_node(const struct ast* ast, uint32_t node) {
+    print_tree(ast, node);
+}
+
+void print_ast(const struct ast* ast) {
+    print_tree(ast, ast->root);
+}
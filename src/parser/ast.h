@@ -1,11 +1,30 @@
 #ifndef AST_H
 #define AST_H
+#include <stdint.h>
 #include "lexer/lexer.h"
+#include "utils/intern.h"
+
+// Nodes live in one contiguous array and refer to each other by 32-bit index.
+// Index 0 is a sentinel (AST_NONE) meaning "no node". Variable-length child
+// lists (statements, list elements, generic arguments) are runs in the
+// `children` side array, and number literals point into `numbers`, which keeps integer
+// literals exact.
 
 enum ast_node_type
 {
+    AST_NONE,
+    AST_PROGRAM,
+    AST_BLOCK,
+    AST_IF,
+    AST_ASSIGNMENT,
     AST_DECLARATION,
-    AST_EXPRESSION,
+    AST_TYPE,
+    AST_NUMBER,
+    AST_BOOLEAN,
+    AST_IDENT,
+    AST_LIST,
+    AST_UNARY,
+    AST_BINARY,
 };
 
 enum data_type
@@ -26,66 +45,158 @@ enum data_type
     DT_LIST,
 };
 
-struct ast_node;
+struct block
+{
+    uint32_t first; // statements: children[first .. first + count)
+    uint32_t count;
+    uint32_t slot_count; // variables declared directly in the block, set by resolve()
+};
 
-struct type_annotation
+struct if_statement
+{
+    uint32_t condition;
+    uint32_t then_branch; // AST_BLOCK
+    uint32_t else_branch; // AST_BLOCK, AST_IF, or 0
+};
+
+struct assignment_statement
 {
-    const char* type_name;
-    struct type_annotation** generic_types; // Изменено на type_annotation*
-    size_t generic_count;
+    uint32_t name; // interned
+    uint32_t expression;
+    uint32_t binding; // set by resolve()
 };
 
+// The declarations of a block take its slots 0, 1, 2, ... in order.
 struct declaration_statement
 {
-    const char* ident;
-    struct type_annotation* type;
-    struct ast_node* expression;
+    uint32_t name; // interned
+    uint32_t type; // AST_TYPE node
+    uint32_t expression; // 0 when there is no initializer
+};
+
+struct type_annotation
+{
+    uint32_t name; // interned
+    uint32_t first; // generic arguments: children[first .. first + count)
+    uint32_t count;
 };
 
 struct list
 {
-    struct ast_node** elements;
-    size_t element_count;
+    uint32_t first; // elements: children[first .. first + count)
+    uint32_t count;
 };
 
 struct number
 {
-    double value;
+    uint32_t index; // into ast.numbers
 };
 
 struct boolean
 {
-    int value;
+    uint32_t value;
 };
 
 struct ident
 {
-    const char* name;
+    uint32_t name; // interned
+    uint32_t binding; // set by resolve()
+};
+
+struct unary
+{
+    uint32_t operand;
 };
 
 struct binary
 {
-    struct ast_node* left;
-    struct ast_node* right;
-    enum token_type op;
+    uint32_t left;
+    uint32_t right;
 };
 
 struct ast_node
 {
-    enum ast_node_type type;
+    uint8_t type; // enum ast_node_type
+    uint8_t op; // enum token_type, for AST_UNARY and AST_BINARY
+    uint16_t flags;
 
     union
     {
+        struct block block; // AST_PROGRAM and AST_BLOCK
+        struct if_statement if_statement;
+        struct assignment_statement assignment;
         struct declaration_statement declaration;
+        struct type_annotation type_annotation;
         struct list list;
         struct number number;
         struct boolean boolean;
         struct ident ident;
+        struct unary unary;
         struct binary binary;
     };
 };
 
-void print_ast(const struct ast_node*);
-void free_ast(struct ast_node*);
+_Static_assert(sizeof(struct ast_node) == 16, "ast_node should stay 16 bytes");
+
+// Owns every node, child run, literal and name produced by one parse. Names
+// are interned in `names`, so equal names have equal ids. An array whose
+// capacity is 0 while its pointer is not NULL is borrowed, for instance from
+// a mapped AST cache (ast_cache.h): it is copied before it first grows and
+// is never freed here.
+struct ast
+{
+    struct ast_node* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+
+    uint32_t* children;
+    uint32_t child_count;
+    uint32_t child_capacity;
+
+    struct lex_number* numbers;
+    uint32_t number_count;
+    uint32_t number_capacity;
+
+    struct interner names;
+    uint32_t root; // AST_PROGRAM
+};
+
+void ast_init(struct ast*);
+// Drops the tree but keeps its memory for the next parse.
+void ast_reset(struct ast*);
+void free_ast(struct ast*);
+
+uint32_t ast_add_node(struct ast*, struct ast_node node);
+// Copies a run of node indices into the children array and returns its start
+// (0 for an empty run).
+uint32_t ast_add_children(struct ast*, const uint32_t* items, uint32_t count);
+uint32_t ast_add_number(struct ast*, struct lex_number value);
+// Makes room for that many more nodes, child slots and numbers, so they can
+// be written directly past the current counts.
+void ast_reserve(struct ast*, uint32_t nodes, uint32_t children, uint32_t numbers);
+
+// How the indices inside a node change when it is copied into another AST:
+// node references other than 0 move by node_shift, non-empty child runs by
+// child_shift, number indices by number_shift, and name ids go through
+// `names`.
+struct ast_rebase
+{
+    uint32_t node_shift;
+    uint32_t child_shift;
+    uint32_t number_shift;
+    const uint32_t* names;
+};
+
+void ast_rebase_node(struct ast_node* node, const struct ast_rebase* rebase);
+// Drops every node not reachable from the `count` roots, along with the
+// child runs and numbers only they used, and renumbers the rest in their
+// current order. Name ids stay the same. The roots are rewritten in place
+// (0 stays 0) and ast->root is cleared.
+void ast_compact(struct ast*, uint32_t* roots, size_t count);
+// Value of an AST_NUMBER node as a double.
+double ast_number_value(const struct ast*, uint32_t node);
+
+void print_ast(const struct ast*);
+void print_ast_node(const struct ast*, uint32_t node);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,458 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define CACHE_POSIX 1
+#endif
+
+#include "parser/ast_cache.h"
+#include "utils/alloc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// "\r\n\032" catches files mangled by text-mode transfers, as in PNG.
+static const char cache_magic[8] = {'T', 'S', 'A', 'S', 'T', '\r', '\n', '\032'};
+
+#define CACHE_BYTE_ORDER 0x01020304u
+// Every section starts on this boundary, which suits all the arrays.
+#define CACHE_ALIGN 16
+
+struct cache_section
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct cache_name
+{
+    uint32_t offset; // into the strings section, NUL-terminated there
+    uint32_t length;
+    uint32_t hash;
+};
+
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint16_t node_size;
+    uint16_t number_size;
+    uint32_t root;
+    uint64_t source_length;
+    uint64_t source_hash;
+    uint64_t file_size;
+    struct cache_section nodes;
+    struct cache_section children;
+    struct cache_section numbers;
+    struct cache_section names;
+    struct cache_section strings; // count is in bytes
+};
+
+// Four independent multiply-xorshift lanes over 32-byte blocks, so the hash
+// runs well ahead of the page faults it causes. It only has to tell edited
+// sources apart, not resist crafted collisions.
+static uint64_t mix(uint64_t h, const uint64_t word)
+{
+    h = (h ^ word) * 0xff51afd7ed558ccdull;
+    return h ^ (h >> 32);
+}
+
+static uint64_t hash_source(const char* s, const size_t length)
+{
+    uint64_t lanes[4] = {
+        0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull,
+    };
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            uint64_t word;
+            memcpy(&word, s + i + lane * 8, 8);
+            lanes[lane] = mix(lanes[lane], word);
+        }
+    }
+    uint64_t h = length;
+    for (int lane = 0; lane < 4; lane++) h = mix(h, lanes[lane]);
+    for (; i < length; i += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, s + i, length - i < 8 ? length - i : 8);
+        h = mix(h, word);
+    }
+    return mix(h, 0);
+}
+
+char* ast_cache_path(const char* source_path)
+{
+    const size_t length = strlen(source_path);
+    char* path = ts_malloc(length + sizeof(".ast"));
+    if (!path)
+    {
+        fprintf(stderr, "Failed to allocate memory in ast_cache\n");
+        abort();
+    }
+    memcpy(path, source_path, length);
+    memcpy(path + length, ".ast", sizeof(".ast"));
+    return path;
+}
+
+// ---------------------------------------------------------------------------
+// Writing
+// ---------------------------------------------------------------------------
+
+static uint64_t align_up(const uint64_t offset)
+{
+    return (offset + CACHE_ALIGN - 1) & ~(uint64_t)(CACHE_ALIGN - 1);
+}
+
+static uint64_t place(struct cache_section* section, const uint64_t at, const uint64_t count, const size_t item_size)
+{
+    section->offset = align_up(at);
+    section->count = count;
+    return section->offset + count * item_size;
+}
+
+static int write_section(FILE* out, uint64_t* at, const uint64_t offset, const void* items, const size_t size)
+{
+    static const char padding[CACHE_ALIGN];
+    if (offset > *at && fwrite(padding, 1, offset - *at, out) != offset - *at) return 0;
+    if (size && fwrite(items, 1, size, out) != size) return 0;
+    *at = offset + size;
+    return 1;
+}
+
+int ast_cache_save(const char* path, const struct ast* ast, const char* source, const size_t length)
+{
+    const struct interner* names = &ast->names;
+    struct cache_name* table = ts_malloc((names->count ? names->count : 1) * sizeof(struct cache_name));
+    if (!table)
+    {
+        fprintf(stderr, "Failed to allocate memory in ast_cache\n");
+        abort();
+    }
+    uint64_t string_bytes = 0;
+    for (uint32_t id = 0; id < names->count; id++)
+    {
+        table[id].offset = (uint32_t)string_bytes;
+        table[id].length = names->entries[id].length;
+        table[id].hash = names->entries[id].hash;
+        string_bytes += names->entries[id].length + 1;
+    }
+
+    struct cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = AST_CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.node_size = sizeof(struct ast_node);
+    header.number_size = sizeof(struct lex_number);
+    header.root = ast->root;
+    header.source_length = length;
+    header.source_hash = hash_source(source, length);
+    uint64_t end = sizeof(header);
+    end = place(&header.nodes, end, ast->node_count, sizeof(struct ast_node));
+    end = place(&header.children, end, ast->child_count, sizeof(uint32_t));
+    end = place(&header.numbers, end, ast->number_count, sizeof(struct lex_number));
+    end = place(&header.names, end, names->count, sizeof(struct cache_name));
+    end = place(&header.strings, end, string_bytes, 1);
+    header.file_size = end;
+
+    const size_t path_length = strlen(path);
+    char* temporary = ts_malloc(path_length + sizeof(".tmp"));
+    if (!temporary)
+    {
+        fprintf(stderr, "Failed to allocate memory in ast_cache\n");
+        abort();
+    }
+    memcpy(temporary, path, path_length);
+    memcpy(temporary + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE* out = fopen(temporary, "wb");
+    int ok = out != NULL;
+    uint64_t at = 0;
+    ok = ok && write_section(out, &at, 0, &header, sizeof(header));
+    ok = ok && write_section(out, &at, header.nodes.offset, ast->nodes, ast->node_count * sizeof(struct ast_node));
+    ok = ok && write_section(out, &at, header.children.offset, ast->children, ast->child_count * sizeof(uint32_t));
+    ok = ok && write_section(out, &at, header.numbers.offset, ast->numbers,
+                             ast->number_count * sizeof(struct lex_number));
+    ok = ok && write_section(out, &at, header.names.offset, table, names->count * sizeof(struct cache_name));
+    ok = ok && write_section(out, &at, header.strings.offset, NULL, 0);
+    for (uint32_t id = 0; ok && id < names->count; id++)
+        ok = fwrite(names->entries[id].str, 1, names->entries[id].length + 1, out) == names->entries[id].length + 1;
+    if (out && fclose(out) != 0) ok = 0;
+    if (ok && rename(temporary, path) != 0) ok = 0;
+    if (!ok)
+    {
+        fprintf(stderr, "Could not write AST cache %s\n", path);
+        remove(temporary);
+    }
+    ts_free(temporary);
+    ts_free(table);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+// ---------------------------------------------------------------------------
+
+#ifdef CACHE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int open_cache(const char* path, struct ast_cache* cache)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(struct cache_header))
+    {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+    cache->data = data;
+    cache->size = (size_t)st.st_size;
+    cache->mapped = 1;
+    return 1;
+}
+
+static void close_cache(struct ast_cache* cache)
+{
+    munmap(cache->data, cache->size);
+}
+#else
+static int open_cache(const char* path, struct ast_cache* cache)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in) return 0;
+    long size = -1;
+    if (fseek(in, 0, SEEK_END) == 0) size = ftell(in);
+    void* data = size >= (long)sizeof(struct cache_header) ? ts_malloc((size_t)size) : NULL;
+    const int ok = data && fseek(in, 0, SEEK_SET) == 0 && fread(data, 1, (size_t)size, in) == (size_t)size;
+    fclose(in);
+    if (!ok)
+    {
+        ts_free(data);
+        return 0;
+    }
+    cache->data = data;
+    cache->size = (size_t)size;
+    cache->mapped = 0;
+    return 1;
+}
+
+static void close_cache(struct ast_cache* cache)
+{
+    ts_free(cache->data);
+}
+#endif
+
+static int section_fits(const struct cache_section* section, const size_t item_size, const uint64_t file_size)
+{
+    return section->offset % CACHE_ALIGN == 0 && section->offset <= file_size &&
+        section->count <= (file_size - section->offset) / item_size && section->count <= UINT32_MAX;
+}
+
+// Checks everything the loaded AST relies on that the header can tell.
+static int header_valid(const struct cache_header* header, const uint64_t file_size)
+{
+    return memcmp(header->magic, cache_magic, sizeof(cache_magic)) == 0 &&
+        header->version == AST_CACHE_VERSION && header->byte_order == CACHE_BYTE_ORDER &&
+        header->node_size == sizeof(struct ast_node) && header->number_size == sizeof(struct lex_number) &&
+        header->file_size == file_size && section_fits(&header->nodes, sizeof(struct ast_node), file_size) &&
+        section_fits(&header->children, sizeof(uint32_t), file_size) &&
+        section_fits(&header->numbers, sizeof(struct lex_number), file_size) &&
+        section_fits(&header->names, sizeof(struct cache_name), file_size) &&
+        section_fits(&header->strings, 1, file_size) && header->nodes.count > 0 &&
+        header->root < header->nodes.count;
+}
+
+static int run_valid(const struct ast* ast, const uint32_t first, const uint32_t count)
+{
+    if (count == 0) return 1;
+    if (first > ast->child_count || count > ast->child_count - first) return 0;
+    for (uint32_t i = 0; i < count; i++)
+        if (ast->children[first + i] == 0 || ast->children[first + i] >= ast->node_count) return 0;
+    return 1;
+}
+
+// Checks that every index in the tree is in range and that the nodes
+// reachable from the root form a tree, so passes can walk it without bounds
+// checks and without looping.
+static int tree_valid(const struct ast* ast)
+{
+    const uint32_t n = ast->node_count;
+    const uint32_t names = ast->names.count;
+    if (ast->nodes[0].type != AST_NONE || ast->nodes[ast->root].type != AST_PROGRAM) return 0;
+    uint8_t* seen = ts_calloc(n, 1);
+    uint32_t* stack = ts_malloc(n * sizeof(uint32_t));
+    if (!seen || !stack)
+    {
+        fprintf(stderr, "Failed to allocate memory in ast_cache\n");
+        abort();
+    }
+    uint32_t depth = 0;
+    int ok = 1;
+    stack[depth++] = ast->root;
+    while (ok && depth)
+    {
+        const uint32_t index = stack[--depth];
+        if (seen[index])
+        {
+            ok = 0;
+            break;
+        }
+        seen[index] = 1;
+        const struct ast_node* node = &ast->nodes[index];
+        // Up to three child nodes, 0 where there is none.
+        uint32_t next[3] = {0, 0, 0};
+        switch (node->type)
+        {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            ok = run_valid(ast, node->block.first, node->block.count);
+            break;
+        case AST_IF:
+            next[0] = node->if_statement.condition;
+            next[1] = node->if_statement.then_branch;
+            next[2] = node->if_statement.else_branch;
+            ok = next[0] && next[1];
+            break;
+        case AST_ASSIGNMENT:
+            next[0] = node->assignment.expression;
+            ok = node->assignment.name < names && next[0];
+            break;
+        case AST_DECLARATION:
+            next[0] = node->declaration.type;
+            next[1] = node->declaration.expression;
+            ok = node->declaration.name < names && next[0] && next[0] < n && ast->nodes[next[0]].type == AST_TYPE;
+            break;
+        case AST_TYPE:
+            ok = node->type_annotation.name < names &&
+                run_valid(ast, node->type_annotation.first, node->type_annotation.count);
+            break;
+        case AST_NUMBER:
+            ok = node->number.index < ast->number_count;
+            break;
+        case AST_BOOLEAN:
+            break;
+        case AST_IDENT:
+            ok = node->ident.name < names;
+            break;
+        case AST_LIST:
+            ok = run_valid(ast, node->list.first, node->list.count);
+            break;
+        case AST_UNARY:
+            next[0] = node->unary.operand;
+            ok = next[0] != 0;
+            break;
+        case AST_BINARY:
+            next[0] = node->binary.left;
+            next[1] = node->binary.right;
+            ok = next[0] && next[1];
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+        if (!ok) break;
+
+        uint32_t first = 0, count = 0;
+        if (node->type == AST_PROGRAM || node->type == AST_BLOCK) first = node->block.first, count = node->block.count;
+        else if (node->type == AST_TYPE) first = node->type_annotation.first, count = node->type_annotation.count;
+        else if (node->type == AST_LIST) first = node->list.first, count = node->list.count;
+        // A tree never has more than node_count nodes pending.
+        for (uint32_t i = 0; ok && i < count; i++)
+        {
+            const uint32_t child = ast->children[first + i];
+            if (seen[child] || depth == n) ok = 0;
+            else stack[depth++] = child;
+        }
+        for (int i = 0; ok && i < 3; i++)
+        {
+            if (!next[i]) continue;
+            if (next[i] >= n || seen[next[i]] || depth == n) ok = 0;
+            else stack[depth++] = next[i];
+        }
+    }
+    ts_free(stack);
+    ts_free(seen);
+    return ok;
+}
+
+int ast_cache_load(const char* path, const char* source, const size_t length, struct ast_cache* cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    if (!open_cache(path, cache)) return 0;
+
+    char* base = cache->data;
+    const struct cache_header* header = cache->data;
+    if (!header_valid(header, cache->size) || header->source_length != length ||
+        header->source_hash != hash_source(source, length))
+    {
+        close_cache(cache);
+        memset(cache, 0, sizeof(*cache));
+        return 0;
+    }
+
+    // Capacities stay 0: the arrays are borrowed from the mapping.
+    struct ast* ast = &cache->ast;
+    ast_init(ast);
+    ts_free(ast->nodes);
+    ast->nodes = (struct ast_node*)(base + header->nodes.offset);
+    ast->node_count = (uint32_t)header->nodes.count;
+    ast->node_capacity = 0;
+    ast->children = header->children.count ? (uint32_t*)(base + header->children.offset) : NULL;
+    ast->child_count = (uint32_t)header->children.count;
+    ast->numbers = header->numbers.count ? (struct lex_number*)(base + header->numbers.offset) : NULL;
+    ast->number_count = (uint32_t)header->numbers.count;
+    ast->root = header->root;
+
+    struct interner* names = &ast->names;
+    const struct cache_name* table = (const struct cache_name*)(base + header->names.offset);
+    const char* strings = base + header->strings.offset;
+    if (header->names.count)
+    {
+        names->entries = ts_malloc(header->names.count * sizeof(struct intern_entry));
+        if (!names->entries)
+        {
+            fprintf(stderr, "Failed to allocate memory in ast_cache\n");
+            abort();
+        }
+        names->capacity = (uint32_t)header->names.count;
+    }
+    for (uint32_t id = 0; id < header->names.count; id++)
+    {
+        const struct cache_name* name = &table[id];
+        if (name->offset >= header->strings.count || name->length >= header->strings.count - name->offset ||
+            strings[name->offset + name->length] != '\0')
+        {
+            ast_cache_close(cache);
+            return 0;
+        }
+        names->entries[id].str = strings + name->offset;
+        names->entries[id].length = name->length;
+        names->entries[id].hash = name->hash;
+        names->count = id + 1;
+    }
+    interner_rebuild(names);
+    if (!tree_valid(ast))
+    {
+        ast_cache_close(cache);
+        return 0;
+    }
+    return 1;
+}
+
+void ast_cache_close(struct ast_cache* cache)
+{
+    free_ast(&cache->ast);
+    if (cache->data) close_cache(cache);
+    memset(cache, 0, sizeof(*cache));
+}
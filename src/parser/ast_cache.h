@@ -0,0 +1,41 @@
+#ifndef TS_AST_CACHE_H
+#define TS_AST_CACHE_H
+#include <stddef.h>
+#include "parser/ast.h"
+
+// A parsed program saved next to its source, so later runs can skip lexing
+// and parsing.
+//
+// The file is a header followed by the node, child, number and name arrays
+// exactly as they sit in a struct ast. The AST refers to everything by index,
+// so nothing in the file holds an address: a load maps the file and points
+// the AST at it. Only the name table, with one entry per distinct name, is
+// rebuilt, and its strings stay in the mapping. The header records the
+// format version, the layout it was written with, and the length and hash
+// of the source text. A cache that does not match the text is ignored.
+//
+// The mapping is private and writable, so passes that rewrite nodes in place
+// (fold_constants) work on the loaded AST without touching the file.
+
+#define AST_CACHE_VERSION 1
+
+struct ast_cache
+{
+    struct ast ast;
+    void* data;
+    size_t size;
+    int mapped;
+};
+
+// Where the cache for `source_path` lives: the same path with ".ast" added.
+// Release the result with ts_free().
+char* ast_cache_path(const char* source_path);
+// Loads the cache at `path` if it was written for exactly `source`. Returns
+// 0, quietly, if there is no such cache or it is out of date or damaged.
+int ast_cache_load(const char* path, const char* source, size_t length, struct ast_cache* cache);
+// Writes `ast` as the cache of `source`. The file is written under a
+// temporary name and renamed into place, so readers never see part of it.
+// Returns 1 on success, 0 after printing an error.
+int ast_cache_save(const char* path, const struct ast* ast, const char* source, size_t length);
+void ast_cache_close(struct ast_cache* cache);
+#endif
@@ -0,0 +1,277 @@
+#include "parser/document.h"
+#include "parser/parser.h"
+#include "utils/alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An edit is applied in four steps:
+//
+// 1. relex() updates the tokens and reports which of them changed.
+// 2. Re-parsing starts one statement before the first changed token. A
+//    statement only ends after peeking at the token that follows it (an
+//    'if' looks for 'else'), so the one before the edit may now run on.
+// 3. Statements are parsed one by one until one ends, past the changed
+//    tokens, exactly where an old statement that parsed cleanly started.
+//    The tokens from there on are the old ones and a top-level statement
+//    depends on nothing before it, so every later statement is kept as is.
+// 4. A statement with a syntax error is recorded as a failed statement up
+//    to the next statement end past the error, where parsing resumes, and is
+//    parsed again whenever an edit reaches it.
+//
+// Replaced subtrees stay in the AST as garbage until it has doubled since
+// the last compaction.
+
+#define COMPACT_SLACK 4096
+
+static void reserve_statements(struct document_statements* list, const size_t needed)
+{
+    if (needed <= list->capacity) return;
+    size_t capacity = list->capacity ? list->capacity : 64;
+    while (capacity < needed) capacity *= 2;
+    uint32_t* tokens = ts_realloc(list->tokens, capacity * sizeof(uint32_t));
+    if (tokens) list->tokens = tokens;
+    uint32_t* nodes = ts_realloc(list->nodes, capacity * sizeof(uint32_t));
+    if (nodes) list->nodes = nodes;
+    if (!tokens || !nodes)
+    {
+        fprintf(stderr, "Failed to allocate memory in document\n");
+        abort();
+    }
+    list->capacity = capacity;
+}
+
+static void push_statement(struct document_statements* list, const size_t token, const uint32_t node)
+{
+    reserve_statements(list, list->count + 1);
+    list->tokens[list->count] = (uint32_t)token;
+    list->nodes[list->count] = node;
+    list->count++;
+}
+
+// First statement that starts at or after token `token`.
+static size_t first_statement_from(const struct document_statements* list, const size_t token)
+{
+    size_t lo = 0, hi = list->count;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (list->tokens[mid] < token) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static size_t count_failed(const uint32_t* nodes, const size_t count)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) failed += nodes[i] == 0;
+    return failed;
+}
+
+// Where parsing resumes after a statement starting at `start` failed: just
+// past the first ';' or '}' at or after token `min - 1` that closes the
+// statement's outermost bracket level. Any point would keep the result
+// right, since a statement that parses is what parsing from its start
+// gives; this one keeps a failed statement about as long as it looks.
+static size_t recovery_point(const struct document* doc, const size_t start, const size_t min)
+{
+    const struct lex_token* tokens = doc->tokens;
+    long depth = 0;
+    for (size_t i = start; i < doc->token_count; i++)
+    {
+        switch (tokens[i].type)
+        {
+        case TOKEN_LPAREN:
+        case TOKEN_LBRACKET:
+        case TOKEN_LBRACE:
+            depth++;
+            continue;
+        case TOKEN_RPAREN:
+        case TOKEN_RBRACKET:
+            if (depth > 0) depth--;
+            continue;
+        case TOKEN_RBRACE:
+            if (depth > 0) depth--;
+            if (depth != 0 || (i + 1 < doc->token_count && tokens[i + 1].type == TOKEN_ELSE)) continue;
+            break;
+        case TOKEN_SEMICOLON:
+            if (depth != 0) continue;
+            break;
+        default:
+            continue;
+        }
+        if (i + 1 >= min) return i + 1;
+    }
+    return doc->token_count;
+}
+
+static void reparse(struct document* doc, const struct token_damage* damage)
+{
+    struct document_statements* list = &doc->statements;
+
+    // The statement holding the first changed token, and the one before it.
+    size_t lo = first_statement_from(list, damage->first + 1);
+    lo = lo > 2 ? lo - 2 : 0;
+    // Statements from `hi` on start at unchanged tokens; move them to their
+    // new token indices.
+    const size_t hi = first_statement_from(list, damage->old_end);
+    for (size_t i = hi; i < list->count; i++)
+        list->tokens[i] = (uint32_t)(list->tokens[i] + damage->new_end - damage->old_end);
+    if (lo > hi) lo = hi;
+
+    struct document_statements fresh = {0};
+    size_t pos = lo < hi ? list->tokens[lo] : damage->first;
+    size_t keep = hi;
+    int resynced = 0;
+    while (pos < doc->token_count)
+    {
+        while (keep < list->count && list->tokens[keep] < pos) keep++;
+        if (pos >= damage->new_end && keep < list->count && list->tokens[keep] == pos && list->nodes[keep])
+        {
+            resynced = 1;
+            break;
+        }
+
+        const size_t at = pos;
+        const uint32_t node = parse_statement_at(doc->source, doc->length, doc->tokens, doc->token_count, &pos,
+                                                 &doc->ast);
+        if (!node) pos = recovery_point(doc, at, pos + 1 > damage->new_end ? pos + 1 : damage->new_end);
+        push_statement(&fresh, at, node);
+    }
+    if (!resynced) keep = list->count;
+
+    // Splice the new statements over [lo, keep).
+    const size_t removed = keep - lo, added = fresh.count;
+    doc->failed_statements += count_failed(fresh.nodes, added);
+    doc->failed_statements -= count_failed(list->nodes + lo, removed);
+    reserve_statements(list, list->count - removed + added);
+    memmove(list->tokens + lo + added, list->tokens + keep, (list->count - keep) * sizeof(uint32_t));
+    memmove(list->nodes + lo + added, list->nodes + keep, (list->count - keep) * sizeof(uint32_t));
+    if (added)
+    {
+        memcpy(list->tokens + lo, fresh.tokens, added * sizeof(uint32_t));
+        memcpy(list->nodes + lo, fresh.nodes, added * sizeof(uint32_t));
+    }
+    list->count = list->count - removed + added;
+
+    // The root's run has room to spare, so it is patched in place from the
+    // first changed statement on instead of being copied whole.
+    if (doc->has_program && list->count <= doc->program_capacity)
+    {
+        const size_t changed = removed == added ? added : list->count - lo;
+        if (changed) memcpy(doc->ast.children + doc->program_first + lo, list->nodes + lo, changed * sizeof(uint32_t));
+        doc->program_count = (uint32_t)list->count;
+    }
+    else doc->has_program = 0;
+
+    ts_free(fresh.tokens);
+    ts_free(fresh.nodes);
+}
+
+static void update_root(struct document* doc)
+{
+    struct document_statements* list = &doc->statements;
+    struct ast* ast = &doc->ast;
+
+    if (ast->node_count + ast->child_count > 2 * doc->live_size + COMPACT_SLACK)
+    {
+        ast_compact(ast, list->nodes, list->count);
+        doc->has_program = 0;
+        doc->live_size = ast->node_count + ast->child_count;
+    }
+
+    ast->root = 0;
+    if (doc->failed_statements) return;
+    if (!doc->has_program)
+    {
+        const uint32_t capacity = (uint32_t)(list->count + list->count / 8 + 64);
+        ast_reserve(ast, 0, capacity, 0);
+        doc->program_first = ast->child_count;
+        doc->program_count = (uint32_t)list->count;
+        doc->program_capacity = capacity;
+        doc->has_program = 1;
+        if (list->count) memcpy(ast->children + doc->program_first, list->nodes, list->count * sizeof(uint32_t));
+        ast->child_count += capacity;
+    }
+    struct ast_node program = { .type = AST_PROGRAM };
+    program.block.first = doc->program_count ? doc->program_first : 0;
+    program.block.count = doc->program_count;
+    ast->root = ast_add_node(ast, program);
+}
+
+int document_open(struct document* doc, const char* source, const size_t length)
+{
+    memset(doc, 0, sizeof(*doc));
+    doc->tokens = parse_text(source, length, &doc->token_count);
+    if (!doc->tokens) return 0;
+
+    doc->capacity = length ? length : 1;
+    doc->source = ts_malloc(doc->capacity);
+    if (!doc->source)
+    {
+        fprintf(stderr, "Failed to allocate memory in document\n");
+        abort();
+    }
+    memcpy(doc->source, source, length);
+    doc->length = length;
+
+    ast_init(&doc->ast);
+    const struct token_damage all = {0, 0, doc->token_count};
+    reparse(doc, &all);
+    doc->live_size = doc->ast.node_count + doc->ast.child_count;
+    update_root(doc);
+    return 1;
+}
+
+int document_edit(struct document* doc, const size_t offset, const size_t removed, const char* inserted,
+                  const size_t inserted_length)
+{
+    if (offset > doc->length || removed > doc->length - offset)
+    {
+        fprintf(stderr, "[document] Edit of %zu bytes at %zu is outside the %zu byte text\n", removed, offset,
+                doc->length);
+        return 0;
+    }
+    const size_t length = doc->length - removed + inserted_length;
+    if (length > LEX_MAX_INPUT)
+    {
+        fprintf(stderr, "[lexer] Input of %zu bytes exceeds the %zu byte limit\n", length, LEX_MAX_INPUT);
+        return 0;
+    }
+
+    if (length > doc->capacity)
+    {
+        size_t capacity = doc->capacity * 2;
+        if (capacity < length) capacity = length;
+        char* grown = ts_realloc(doc->source, capacity);
+        if (!grown)
+        {
+            fprintf(stderr, "Failed to allocate memory in document\n");
+            abort();
+        }
+        doc->source = grown;
+        doc->capacity = capacity;
+    }
+    memmove(doc->source + offset + inserted_length, doc->source + offset + removed, doc->length - offset - removed);
+    memcpy(doc->source + offset, inserted, inserted_length);
+    doc->length = length;
+
+    const struct text_edit edit = {offset, removed, inserted_length};
+    struct token_damage damage;
+    relex(doc->source, doc->length, &edit, &doc->tokens, &doc->token_count, &damage);
+    reparse(doc, &damage);
+    update_root(doc);
+    return 1;
+}
+
+void document_close(struct document* doc)
+{
+    ts_free(doc->source);
+    ts_free(doc->tokens);
+    free_ast(&doc->ast);
+    ts_free(doc->statements.tokens);
+    ts_free(doc->statements.nodes);
+    memset(doc, 0, sizeof(*doc));
+}
@@ -0,0 +1,59 @@
+#ifndef TS_DOCUMENT_H
+#define TS_DOCUMENT_H
+#include <stddef.h>
+#include <stdint.h>
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+
+// Top-level statements in source order: the token each starts at and its
+// node. Tokens that failed to parse are kept as one statement with node 0
+// until an edit reaches them.
+struct document_statements
+{
+    uint32_t* tokens;
+    uint32_t* nodes;
+    size_t count;
+    size_t capacity;
+};
+
+// A source text kept lexed and parsed across edits, for hosts that re-parse
+// on every keystroke. An edit re-lexes only the tokens around it and
+// re-parses only the top-level statements those tokens belong to; every
+// other statement keeps its subtree, so the work per edit follows the size
+// of the edit rather than of the text.
+struct document
+{
+    char* source;
+    size_t length;
+    size_t capacity;
+
+    struct lex_token* tokens;
+    size_t token_count;
+
+    // ast.root is the AST_PROGRAM of the whole text, or 0 while some
+    // statement has a syntax error.
+    struct ast ast;
+
+    struct document_statements statements;
+    size_t failed_statements;
+
+    // The root's statement run, with room to grow in place.
+    uint32_t program_first;
+    uint32_t program_count;
+    uint32_t program_capacity;
+    int has_program;
+
+    // Nodes plus child slots right after the last compaction; replaced
+    // statements are garbage until the AST grows to twice that.
+    size_t live_size;
+};
+
+// Copies, lexes and parses `source`. Returns 0 if it is too large to lex;
+// syntax errors are reported and leave ast.root at 0.
+int document_open(struct document* doc, const char* source, size_t length);
+// Replaces `removed` bytes at `offset` with `inserted_length` bytes from
+// `inserted` and brings the tokens and AST up to date. Returns 0, changing
+// nothing, if the range is outside the text or the result is too large.
+int document_edit(struct document* doc, size_t offset, size_t removed, const char* inserted, size_t inserted_length);
+void document_close(struct document* doc);
+#endif
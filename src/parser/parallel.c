@@ -0,0 +1,227 @@
+#include "parser/parser.h"
+#include "ast.h"
+#include "utils/pool.h"
+#include "utils/alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parallel front end for whole programs.
+//
+// Top-level statements never share state in the parser, so the token array
+// is cut at statement ends into a few batches per thread, and each batch is
+// parsed into its own AST. The batches are then copied into the result in
+// source order with their node, child, number and name indices rebased.
+// Names are re-interned batch by batch in local id order, which is the
+// order of first occurrence, so the result is identical to a sequential
+// parse of the same tokens. Batches are parsed silently: if any of them
+// fails, the whole input is parsed again sequentially, so the error that
+// gets reported is the first one, exactly as parse() reports it, whatever
+// order the batches ran in.
+
+#define PARALLEL_MIN_TOKENS (64 * 1024)
+
+struct parse_batch
+{
+    size_t first_token;
+    size_t token_count;
+    struct ast ast;
+
+    // Where the batch lands in the result.
+    uint32_t* names; // local name id -> result name id
+    struct ast_rebase rebase;
+    uint32_t statement_at;
+};
+
+struct parallel_parse
+{
+    const char* source;
+    size_t length;
+    const struct lex_token* tokens;
+    struct parse_batch* batches;
+    struct ast* out;
+};
+
+// Cuts [0, count) into at most `max` runs of whole top-level statements of
+// roughly `count / max` tokens each. A statement ends at a ';' outside any
+// bracket, or at a '}' that closes the outermost one and is not followed by
+// 'else'. Unbalanced input just ends up in the last batch, whose parser
+// reports it.
+static size_t split_batches(const struct lex_token* tokens, const size_t count,
+                            struct parse_batch* batches, const size_t max)
+{
+    const size_t per_batch = count / max + 1;
+    size_t n = 0, start = 0;
+    long depth = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (tokens[i].type)
+        {
+        case TOKEN_LPAREN:
+        case TOKEN_LBRACKET:
+        case TOKEN_LBRACE:
+            depth++;
+            continue;
+        case TOKEN_RPAREN:
+        case TOKEN_RBRACKET:
+            depth--;
+            continue;
+        case TOKEN_RBRACE:
+            if (--depth != 0 || (i + 1 < count && tokens[i + 1].type == TOKEN_ELSE)) continue;
+            break;
+        case TOKEN_SEMICOLON:
+            if (depth != 0) continue;
+            break;
+        default:
+            continue;
+        }
+
+        if (i + 1 - start >= per_batch && n + 1 < max)
+        {
+            batches[n].first_token = start;
+            batches[n].token_count = i + 1 - start;
+            n++;
+            start = i + 1;
+        }
+    }
+    if (start < count)
+    {
+        batches[n].first_token = start;
+        batches[n].token_count = count - start;
+        n++;
+    }
+    return n;
+}
+
+static void parse_batch_task(void* context, const size_t index, const size_t worker)
+{
+    (void)worker;
+    const struct parallel_parse* job = context;
+    struct parse_batch* batch = &job->batches[index];
+    // Roughly one node per token; growing from empty would copy each batch
+    // several times over.
+    const uint32_t tokens = (uint32_t)batch->token_count;
+    ast_reserve(&batch->ast, tokens, tokens / 4, tokens / 8);
+    parse_silent(job->source, job->length, job->tokens + batch->first_token, batch->token_count, &batch->ast);
+}
+
+// A batch's own AST_PROGRAM node is the last node it added, and its
+// statement run is the last child run; everything before them is copied
+// as is, and the statements go into the result's single program run.
+static void copy_batch_task(void* context, const size_t index, const size_t worker)
+{
+    (void)worker;
+    const struct parallel_parse* job = context;
+    const struct parse_batch* batch = &job->batches[index];
+    const struct ast* src = &batch->ast;
+    const struct ast_node* program = &src->nodes[src->root];
+    const struct ast_rebase* rebase = &batch->rebase;
+    struct ast* out = job->out;
+
+    for (uint32_t i = 1; i < src->root; i++)
+    {
+        struct ast_node node = src->nodes[i];
+        ast_rebase_node(&node, rebase);
+        out->nodes[i + rebase->node_shift] = node;
+    }
+    for (uint32_t i = 0; i < program->block.first; i++)
+        out->children[i + rebase->child_shift] = src->children[i] + rebase->node_shift;
+    for (uint32_t i = 0; i < program->block.count; i++)
+        out->children[batch->statement_at + i] = src->children[program->block.first + i] + rebase->node_shift;
+    if (src->number_count)
+        memcpy(out->numbers + rebase->number_shift, src->numbers, src->number_count * sizeof(struct lex_number));
+}
+
+uint32_t parse_parallel(const char* source, const size_t length, const struct lex_token* tokens,
+                        const size_t count, struct ast* ast, struct thread_pool* pool)
+{
+    const size_t threads = thread_pool_size(pool);
+    if (threads == 1 || count < PARALLEL_MIN_TOKENS) return parse(source, length, tokens, count, ast);
+
+    const size_t max_batches = threads * 4;
+    struct parse_batch* batches = ts_calloc(max_batches, sizeof(struct parse_batch));
+    if (!batches)
+    {
+        fprintf(stderr, "Failed to allocate memory in parse_parallel\n");
+        abort();
+    }
+    const size_t batch_count = split_batches(tokens, count, batches, max_batches);
+    if (batch_count <= 1)
+    {
+        ts_free(batches);
+        return parse(source, length, tokens, count, ast);
+    }
+
+    for (size_t i = 0; i < batch_count; i++) ast_init(&batches[i].ast);
+    struct parallel_parse job = {
+        .source = source, .length = length, .tokens = tokens, .batches = batches, .out = ast,
+    };
+    thread_pool_run(pool, parse_batch_task, &job, batch_count);
+
+    int failed = 0;
+    for (size_t i = 0; i < batch_count; i++) failed |= batches[i].ast.root == 0;
+    if (failed)
+    {
+        for (size_t i = 0; i < batch_count; i++) free_ast(&batches[i].ast);
+        ts_free(batches);
+        return parse(source, length, tokens, count, ast);
+    }
+
+    // Lay the batches out one after another and translate their names.
+    uint32_t nodes = 0, children = 0, numbers = 0, statements = 0;
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        const struct ast* src = &batches[i].ast;
+        children += src->nodes[src->root].block.first;
+        statements += src->nodes[src->root].block.count;
+    }
+    uint32_t child_at = ast->child_count;
+    uint32_t statement_at = ast->child_count + children;
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        struct parse_batch* batch = &batches[i];
+        const struct ast* src = &batch->ast;
+
+        batch->names = ts_malloc((src->names.count ? src->names.count : 1) * sizeof(uint32_t));
+        if (!batch->names)
+        {
+            fprintf(stderr, "Failed to allocate memory in parse_parallel\n");
+            abort();
+        }
+        for (uint32_t id = 0; id < src->names.count; id++)
+            batch->names[id] = intern(&ast->names, src->names.entries[id].str, src->names.entries[id].length);
+
+        batch->rebase.node_shift = ast->node_count + nodes - 1;
+        batch->rebase.child_shift = child_at;
+        batch->rebase.number_shift = ast->number_count + numbers;
+        batch->rebase.names = batch->names;
+        batch->statement_at = statement_at;
+
+        nodes += src->root - 1;
+        child_at += src->nodes[src->root].block.first;
+        statement_at += src->nodes[src->root].block.count;
+        numbers += src->number_count;
+    }
+
+    ast_reserve(ast, nodes + 1, children + statements, numbers);
+    thread_pool_run(pool, copy_batch_task, &job, batch_count);
+    const uint32_t statement_first = ast->child_count + children;
+    ast->node_count += nodes;
+    ast->child_count += children + statements;
+    ast->number_count += numbers;
+
+    struct ast_node program = { .type = AST_PROGRAM };
+    program.block.first = statement_first;
+    program.block.count = statements;
+    ast->root = ast_add_node(ast, program);
+
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        free_ast(&batches[i].ast);
+        ts_free(batches[i].names);
+    }
+    ts_free(batches);
+    return ast->root;
+}
@@ -1,26 +1,137 @@
 #include "parser/parser.h"
 #include "ast.h"
 #include "lexer/lexer.h"
+#include "lexer/lines.h"
+#include "lexer/number.h"
 
+#include "utils/diag.h"
+#include "utils/alloc.h"
+
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include "utils/str.h"
+
+enum frame_kind {
+    FRAME_UNARY,
+    FRAME_BINARY,
+    FRAME_PAREN,
+    FRAME_LIST,
+    FRAME_TYPE,
+    FRAME_BLOCK,
+    FRAME_IF,
+    FRAME_ELSE,
+};
+
+// A construct that is still open: an operator waiting for its operand, a
+// bracket, argument list or block waiting for its end, or an 'if' waiting
+// for a branch.
+struct parse_frame {
+    uint8_t kind;
+    uint8_t op;
+    // Expression frames: the binding power to go back to when it closes.
+    uint8_t min_power;
+    // Left operand, if condition or type name.
+    uint32_t node;
+    uint32_t then_branch;
+    // Scratch position where the items of a list, block or type start.
+    uint32_t mark;
+};
+
+static size_t max_depth = PARSE_DEFAULT_MAX_DEPTH;
+
+void parse_set_max_depth(size_t depth) {
+    max_depth = depth ? depth : PARSE_DEFAULT_MAX_DEPTH;
+}
 
 struct parser {
+    const char* source;
+    size_t source_length;
+    // Built the first time a diagnostic needs a line number.
+    struct line_index lines;
+
     const struct lex_token* tokens;
     size_t count;
     size_t pos;
+
+    // Streaming mode: tokens are pulled from the lexer on demand and only
+    // the current and previous ones are kept.
+    struct lexer* lexer;
+    struct lex_token current;
+    struct lex_token previous;
+
+    struct ast* ast;
+
+    // Stack of node indices collected while a list, block or generic
+    // argument list is still open; the finished run is copied into
+    // ast.children at once.
+    uint32_t* scratch;
+    size_t scratch_len;
+    size_t scratch_cap;
+
+    // Open constructs, innermost last. Parsing never recurses, so nesting
+    // depth costs heap rather than C stack.
+    struct parse_frame* frames;
+    size_t frame_count;
+    size_t frame_cap;
+    // min(frame_cap, max_depth): push_frame() checks only this.
+    size_t frame_limit;
+    size_t max_depth;
+    // Set by parse_silent(): errors fail the parse without a message.
+    int silent;
+
+    // Errors unwind straight back to finish(), which returns 0.
+    jmp_buf error;
 };
 
 static const struct lex_token* peek(struct parser* p) {
+    if (p->lexer) {
+        return p->current.type != TOKEN_EOF ? &p->current : NULL;
+    }
     return p->pos < p->count ? &p->tokens[p->pos] : NULL;
 }
 
 static const struct lex_token* advance(struct parser* p) {
+    if (p->lexer) {
+        if (p->current.type == TOKEN_EOF) return NULL;
+        p->previous = p->current;
+        p->current = lexer_next(p->lexer);
+        return &p->previous;
+    }
     return p->pos < p->count ? &p->tokens[p->pos++] : NULL;
 }
 
+static const struct lex_token* previous(struct parser* p) {
+    return p->lexer ? &p->previous : &p->tokens[p->pos - 1];
+}
+
+// Prints a diagnostic at the position of `tok`, or of the end of the input
+// when there is no token left.
+static void report(struct parser* p, const struct lex_token* tok, const char* format, ...) {
+    if (p->silent) {
+        return;
+    }
+    if (!p->lines.starts) {
+        line_index_build(&p->lines, p->source, p->source_length);
+    }
+    int line, column;
+    line_index_locate(&p->lines, tok ? tok->offset : (uint32_t)p->source_length, &line, &column);
+    const char* name = diag_source();
+    if (name) {
+        fprintf(stderr, "%s:", name);
+    }
+    fprintf(stderr, "%d:%d: ", line, column);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static _Noreturn void fail(struct parser* p) {
+    longjmp(p->error, 1);
+}
+
 static int match(struct parser* p, enum token_type type) {
     if (peek(p) && peek(p)->type == type) {
         advance(p);
@@ -32,220 +143,447 @@ static int match(struct parser* p, enum token_type type) {
 static void expect(struct parser* p, enum token_type type) {
     if (!match(p, type)) {
         const char *token1 = token_type_to_str(type);
-        const char *token2 = token_type_to_str(peek(p) ? peek(p)->type : -1);
-        fprintf(stderr, "Expected token %s, got %s\n", token1, token2);
-        exit(1);
+        const char *token2 = token_type_to_str(peek(p) ? peek(p)->type : TOKEN_EOF);
+        report(p, peek(p), "Expected token %s, got %s\n", token1, token2);
+        fail(p);
     }
 }
 
-static struct ast_node* make_binary_node(struct ast_node* left, enum token_type op, struct ast_node* right) {
-    struct ast_node* node = malloc(sizeof(*node));
-    node->type = AST_EXPRESSION;
-    node->binary.left = left;
-    node->binary.right = right;
-    node->binary.op = op;
-    return node;
-}
-
-static struct ast_node* parse_expression(struct parser* p);
-static struct ast_node* parse_statement(struct parser* p);
-
-static const struct type_annotation* parse_type_annotation(struct parser* p) {
-    if (!match(p, TOKEN_TYPE_NAME)) {
-        fprintf(stderr, "Expected type name\n");
-        exit(1);
+static void scratch_push(struct parser* p, uint32_t item) {
+    if (p->scratch_len == p->scratch_cap) {
+        p->scratch_cap = p->scratch_cap ? p->scratch_cap * 2 : 64;
+        uint32_t* grown = ts_realloc(p->scratch, p->scratch_cap * sizeof(uint32_t));
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate memory in parser\n");
+            abort();
+        }
+        p->scratch = grown;
     }
+    p->scratch[p->scratch_len++] = item;
+}
 
-    const struct lex_token* tok = &p->tokens[p->pos - 1];
-    struct type_annotation* ann = malloc(sizeof(struct type_annotation));
-    ann->type_name = ts_strndup(tok->start, tok->length);
-    ann->generic_types = NULL;
-    ann->generic_count = 0;
+// Moves everything pushed since `mark` into ast.children.
+static uint32_t scratch_pop(struct parser* p, size_t mark, uint32_t* count) {
+    *count = (uint32_t)(p->scratch_len - mark);
+    const uint32_t first = ast_add_children(p->ast, p->scratch + mark, *count);
+    p->scratch_len = mark;
+    return first;
+}
 
-    if (match(p, TOKEN_LT)) {
-        struct type_annotation** generics = NULL;
-        size_t count = 0;
-        do {
-            generics = realloc(generics, sizeof(struct type_annotation*) * (count + 1));
-            generics[count] = parse_type_annotation(p);
-            count++;
-        } while (match(p, TOKEN_COMMA));
-        expect(p, TOKEN_GT);
-        ann->generic_types = generics;
-        ann->generic_count = count;
-    }
+static uint32_t intern_token(struct parser* p, const struct lex_token* tok) {
+    return intern(&p->ast->names, p->source + tok->offset, tok->length);
+}
 
-    return ann;
+static uint32_t make_binary_node(struct parser* p, uint32_t left, enum token_type op, uint32_t right) {
+    struct ast_node node = { .type = AST_BINARY, .op = (uint8_t)op };
+    node.binary.left = left;
+    node.binary.right = right;
+    return ast_add_node(p->ast, node);
 }
 
-static struct ast_node* parse_primary(struct parser* p) {
-    struct lex_token* tok = peek(p);
+static uint32_t make_unary_node(struct parser* p, enum token_type op, uint32_t operand) {
+    struct ast_node node = { .type = AST_UNARY, .op = (uint8_t)op };
+    node.unary.operand = operand;
+    return ast_add_node(p->ast, node);
+}
 
-    if (!tok) {
-        fprintf(stderr, "Unexpected end of input in expression\n");
-        exit(1);
+// Grows the frame stack, or reports the depth limit once it is reached.
+static void grow_frames(struct parser* p) {
+    if (p->frame_count == p->max_depth) {
+        report(p, peek(p), "Nesting exceeds the depth limit of %zu\n", p->max_depth);
+        fail(p);
     }
-
-    if (tok->type == TOKEN_NUMBER) {
-        advance(p);
-        struct ast_node* node = malloc(sizeof(*node));
-        node->type = AST_EXPRESSION;
-        node->number.value = atof(tok->start);
-        return node;
+    p->frame_cap = p->frame_cap ? p->frame_cap * 2 : 64;
+    struct parse_frame* grown = ts_realloc(p->frames, p->frame_cap * sizeof(struct parse_frame));
+    if (!grown) {
+        fprintf(stderr, "Failed to allocate memory in parser\n");
+        abort();
     }
+    p->frames = grown;
+    p->frame_limit = p->frame_cap < p->max_depth ? p->frame_cap : p->max_depth;
+}
 
-    if (tok->type == TOKEN_TRUE || tok->type == TOKEN_FALSE) {
-        advance(p);
-        struct ast_node* node = malloc(sizeof(*node));
-        node->type = AST_EXPRESSION;
-        node->boolean.value = (tok->type == TOKEN_TRUE);
-        return node;
+// Opens a construct on the explicit stack and returns it for the caller to
+// fill in. Nesting is bounded only by max_depth, never by the C stack.
+static inline struct parse_frame* push_frame(struct parser* p, const enum frame_kind kind) {
+    if (p->frame_count == p->frame_limit) {
+        grow_frames(p);
     }
+    struct parse_frame* frame = &p->frames[p->frame_count++];
+    frame->kind = (uint8_t)kind;
+    return frame;
+}
 
-    if (tok->type == TOKEN_IDENT) {
-        advance(p);
-        struct ast_node* node = malloc(sizeof(*node));
-        node->type = AST_EXPRESSION;
-        node->ident.name = ts_strndup(tok->start, tok->length);
-        return node;
-    }
+// Pops the innermost frame. The returned pointer stays valid until the
+// next push_frame().
+static struct parse_frame* pop_frame(struct parser* p) {
+    return &p->frames[--p->frame_count];
+}
 
-    if (match(p, TOKEN_LPAREN)) {
-        struct ast_node* inner = parse_expression(p);
-        expect(p, TOKEN_RPAREN);
-        return inner;
-    }
-
-    if (match(p, TOKEN_LBRACKET)) {
-        struct ast_node* node = malloc(sizeof(*node));
-        node->type = AST_EXPRESSION;
-        node->list.elements = NULL;
-        node->list.element_count = 0;
-
-        if (!match(p, TOKEN_RBRACKET)) {
-            do {
-                struct ast_node* element = parse_expression(p);
-                node->list.elements = realloc(node->list.elements,
-                                             sizeof(struct ast_node*) * (node->list.element_count + 1));
-                node->list.elements[node->list.element_count++] = element;
-            } while (match(p, TOKEN_COMMA));
-            expect(p, TOKEN_RBRACKET);
+static uint32_t parse_type_annotation(struct parser* p) {
+    const size_t base = p->frame_count;
+    for (;;) {
+        if (!match(p, TOKEN_TYPE_NAME)) {
+            report(p, peek(p), "Expected type name\n");
+            fail(p);
+        }
+        const uint32_t name = intern_token(p, previous(p));
+        if (match(p, TOKEN_LT)) {
+            struct parse_frame* frame = push_frame(p, FRAME_TYPE);
+            frame->node = name;
+            frame->mark = (uint32_t)p->scratch_len;
+            continue;
         }
-        return node;
-    }
-
-    fprintf(stderr, "Unexpected token in expression: %d\n", token_type_to_str(tok->type));
-    exit(1);
-}
 
-static struct ast_node* parse_unary(struct parser* p) {
-    if (match(p, TOKEN_MINUS) || match(p, TOKEN_NOT)) {
-        enum token_type op = p->tokens[p->pos - 1].type;
-        struct ast_node* expr = parse_unary(p);
-        return make_binary_node(NULL, op, expr);
+        struct ast_node node = { .type = AST_TYPE };
+        node.type_annotation.name = name;
+        uint32_t value = ast_add_node(p->ast, node);
+
+        // Close every argument list that ends here.
+        for (;;) {
+            if (p->frame_count == base) return value;
+            scratch_push(p, value);
+            if (match(p, TOKEN_COMMA)) break;
+            expect(p, TOKEN_GT);
+            const struct parse_frame* open = pop_frame(p);
+            struct ast_node type = { .type = AST_TYPE };
+            type.type_annotation.name = open->node;
+            type.type_annotation.first = scratch_pop(p, open->mark, &type.type_annotation.count);
+            value = ast_add_node(p->ast, type);
+        }
     }
-    return parse_primary(p);
 }
 
-static struct ast_node* parse_multiplicative(struct parser* p) {
-    struct ast_node* left = parse_unary(p);
-    while (match(p, TOKEN_STAR) || match(p, TOKEN_SLASH)) {
-        enum token_type op = p->tokens[p->pos - 1].type;
-        struct ast_node* right = parse_unary(p);
-        left = make_binary_node(left, op, right);
-    }
-    return left;
-}
+// Binding power of every token that can follow an operand as a binary
+// operator; 0 ends the expression. All binary operators are left
+// associative, and unary '-' and '!' bind tighter than any of them.
+static const uint8_t binding_power[TOKEN_UNKNOWN + 1] = {
+    [TOKEN_OR] = 1,
+    [TOKEN_AND] = 2,
+    [TOKEN_EQ] = 3, [TOKEN_NEQ] = 3,
+    [TOKEN_LT] = 4, [TOKEN_GT] = 4, [TOKEN_LE] = 4, [TOKEN_GE] = 4,
+    [TOKEN_PLUS] = 5, [TOKEN_MINUS] = 5,
+    [TOKEN_STAR] = 6, [TOKEN_SLASH] = 6,
+};
 
-static struct ast_node* parse_additive(struct parser* p) {
-    struct ast_node* left = parse_multiplicative(p);
-    while (match(p, TOKEN_PLUS) || match(p, TOKEN_MINUS)) {
-        enum token_type op = p->tokens[p->pos - 1].type;
-        struct ast_node* right = parse_multiplicative(p);
-        left = make_binary_node(left, op, right);
+// A literal or a name, or 0 when the next token is neither.
+static uint32_t parse_leaf(struct parser* p) {
+    const struct lex_token* tok = peek(p);
+    if (!tok) return 0;
+
+    switch (tok->type) {
+        case TOKEN_NUMBER: {
+            tok = advance(p);
+            struct lex_number value;
+            scan_number(p->source, tok->offset, tok->offset + tok->length, &value);
+            struct ast_node node = { .type = AST_NUMBER };
+            node.number.index = ast_add_number(p->ast, value);
+            return ast_add_node(p->ast, node);
+        }
+        case TOKEN_TRUE:
+        case TOKEN_FALSE: {
+            tok = advance(p);
+            struct ast_node node = { .type = AST_BOOLEAN };
+            node.boolean.value = (tok->type == TOKEN_TRUE);
+            return ast_add_node(p->ast, node);
+        }
+        case TOKEN_IDENT: {
+            tok = advance(p);
+            struct ast_node node = { .type = AST_IDENT };
+            node.ident.name = intern_token(p, tok);
+            return ast_add_node(p->ast, node);
+        }
+        default:
+            return 0;
     }
-    return left;
 }
 
-static struct ast_node* parse_comparison(struct parser* p) {
-    struct ast_node* left = parse_additive(p);
-    while (match(p, TOKEN_LT) || match(p, TOKEN_GT) || match(p, TOKEN_LE) || match(p, TOKEN_GE)) {
-        enum token_type op = p->tokens[p->pos - 1].type;
-        struct ast_node* right = parse_additive(p);
-        left = make_binary_node(left, op, right);
+// Prefix position. Returns the node for a literal or a name; for a unary
+// operator or an opening bracket it pushes a frame and returns 0, and the
+// operand follows. `min_power` is saved in bracket frames and reset.
+static uint32_t parse_prefix(struct parser* p, uint8_t* min_power) {
+    const uint32_t leaf = parse_leaf(p);
+    if (leaf) return leaf;
+
+    const struct lex_token* tok = peek(p);
+    if (!tok) {
+        report(p, NULL, "Unexpected end of input in expression\n");
+        fail(p);
     }
-    return left;
-}
 
-static struct ast_node* parse_equality(struct parser* p) {
-    struct ast_node* left = parse_comparison(p);
-    while (match(p, TOKEN_EQ) || match(p, TOKEN_NEQ)) {
-        enum token_type op = p->tokens[p->pos - 1].type;
-        struct ast_node* right = parse_comparison(p);
-        left = make_binary_node(left, op, right);
+    switch (tok->type) {
+        case TOKEN_MINUS:
+        case TOKEN_NOT:
+            push_frame(p, FRAME_UNARY)->op = (uint8_t)advance(p)->type;
+            return 0;
+        case TOKEN_LPAREN:
+            advance(p);
+            push_frame(p, FRAME_PAREN)->min_power = *min_power;
+            *min_power = 0;
+            return 0;
+        case TOKEN_LBRACKET: {
+            advance(p);
+            if (match(p, TOKEN_RBRACKET)) {
+                return ast_add_node(p->ast, (struct ast_node){ .type = AST_LIST });
+            }
+            struct parse_frame* frame = push_frame(p, FRAME_LIST);
+            frame->min_power = *min_power;
+            frame->mark = (uint32_t)p->scratch_len;
+            *min_power = 0;
+            return 0;
+        }
+        default:
+            report(p, tok, "Unexpected token in expression: %s\n", token_type_to_str(tok->type));
+            fail(p);
     }
-    return left;
 }
 
-static struct ast_node* parse_logical_and(struct parser* p) {
-    struct ast_node* left = parse_equality(p);
-    while (match(p, TOKEN_AND)) {
-        struct ast_node* right = parse_equality(p);
-        left = make_binary_node(left, TOKEN_AND, right);
-    }
-    return left;
+static uint8_t next_power(struct parser* p) {
+    const struct lex_token* tok = peek(p);
+    return tok ? binding_power[tok->type] : 0;
 }
 
-static struct ast_node* parse_logical_or(struct parser* p) {
-    struct ast_node* left = parse_logical_and(p);
-    while (match(p, TOKEN_OR)) {
-        struct ast_node* right = parse_logical_and(p);
-        left = make_binary_node(left, TOKEN_OR, right);
+// Applies the unary operators waiting directly above `base` to an operand
+// that has just been completed.
+static uint32_t apply_unary(struct parser* p, const size_t base, uint32_t value) {
+    while (p->frame_count > base && p->frames[p->frame_count - 1].kind == FRAME_UNARY) {
+        value = make_unary_node(p, pop_frame(p)->op, value);
     }
-    return left;
+    return value;
 }
 
-static struct ast_node* parse_expression(struct parser* p) {
-    return parse_logical_or(p);
+// Pratt loop on an explicit stack. Once an operand is complete, pending
+// unary operators are applied to it; then an operator that binds tighter
+// than `min_power` makes it the left side of a new binary frame whose right
+// operand is parsed at that operator's own power, which makes equal-power
+// chains associate to the left. Otherwise the innermost frame is closed
+// around it. Nodes come out in the same order as from a recursive descent.
+static uint32_t parse_expression(struct parser* p) {
+    const size_t base = p->frame_count;
+    uint8_t min_power = 0;
+    for (;;) {
+        uint32_t value = parse_prefix(p, &min_power);
+        if (!value) continue;
+        value = apply_unary(p, base, value);
+
+        for (;;) {
+            const uint8_t power = next_power(p);
+            if (power > min_power) {
+                const enum token_type op = advance(p)->type;
+                // Most right operands are a single leaf that nothing after
+                // it binds to more tightly; those need no frame at all.
+                const uint32_t right = parse_leaf(p);
+                if (right && next_power(p) <= power) {
+                    value = make_binary_node(p, value, op, right);
+                    continue;
+                }
+                struct parse_frame* frame = push_frame(p, FRAME_BINARY);
+                frame->op = (uint8_t)op;
+                frame->min_power = min_power;
+                frame->node = value;
+                min_power = power;
+                if (!right) break;
+                value = right;
+                continue;
+            }
+
+            if (p->frame_count == base) return value;
+            const struct parse_frame* top = pop_frame(p);
+            min_power = top->min_power;
+            // A binary frame is only ever pushed over a finished operand, so
+            // there is no unary operator under it left to apply.
+            if (top->kind == FRAME_BINARY) {
+                value = make_binary_node(p, top->node, top->op, value);
+                continue;
+            }
+            if (top->kind == FRAME_PAREN) {
+                expect(p, TOKEN_RPAREN);
+            } else {
+                scratch_push(p, value);
+                if (match(p, TOKEN_COMMA)) {
+                    p->frame_count++;
+                    min_power = 0;
+                    break;
+                }
+                expect(p, TOKEN_RBRACKET);
+                struct ast_node node = { .type = AST_LIST };
+                node.list.first = scratch_pop(p, top->mark, &node.list.count);
+                value = ast_add_node(p->ast, node);
+            }
+            value = apply_unary(p, base, value);
+        }
+    }
 }
 
-static struct ast_node* parse_declaration(struct parser* p) {
+static uint32_t parse_declaration(struct parser* p) {
     expect(p, TOKEN_VAR);
 
-    struct lex_token* ident_token = advance(p);
+    const struct lex_token* ident_token = advance(p);
     if (!ident_token || ident_token->type != TOKEN_IDENT) {
-        fprintf(stderr, "Expected identifier after 'var'\n");
-        exit(1);
+        report(p, ident_token, "Expected identifier after 'var'\n");
+        fail(p);
     }
 
-    struct type_annotation* type = parse_type_annotation(p);
+    struct ast_node node = { .type = AST_DECLARATION };
+    node.declaration.name = intern_token(p, ident_token);
+    node.declaration.type = parse_type_annotation(p);
 
-    struct ast_node* expr = NULL;
     if (match(p, TOKEN_DECL_ASSIGN)) {
-        expr = parse_expression(p);
+        node.declaration.expression = parse_expression(p);
     }
 
     expect(p, TOKEN_SEMICOLON);
+    return ast_add_node(p->ast, node);
+}
 
-    struct ast_node* node = malloc(sizeof(*node));
-    node->type = AST_DECLARATION;
-    node->declaration.ident = ts_strndup(ident_token->start, ident_token->length);
-    node->declaration.type = type;
-    node->declaration.expression = expr;
-    return node;
+static void open_block(struct parser* p) {
+    expect(p, TOKEN_LBRACE);
+    push_frame(p, FRAME_BLOCK)->mark = (uint32_t)p->scratch_len;
 }
 
-static struct ast_node* parse_statement(struct parser* p) {
-    if (peek(p)->type == TOKEN_VAR) {
+static uint32_t make_if_node(struct parser* p, const struct parse_frame* frame, uint32_t else_branch) {
+    struct ast_node node = { .type = AST_IF };
+    node.if_statement.condition = frame->node;
+    node.if_statement.then_branch = frame->then_branch;
+    node.if_statement.else_branch = else_branch;
+    return ast_add_node(p->ast, node);
+}
+
+// Parses a statement that is not an 'if'; an 'if' opens its frame and its
+// then-block and returns 0.
+static uint32_t open_statement(struct parser* p) {
+    const struct lex_token* tok = peek(p);
+    if (tok && tok->type == TOKEN_VAR) {
         return parse_declaration(p);
     }
+    if (tok && tok->type == TOKEN_IF) {
+        advance(p);
+        expect(p, TOKEN_LPAREN);
+        const uint32_t condition = parse_expression(p);
+        expect(p, TOKEN_RPAREN);
+        push_frame(p, FRAME_IF)->node = condition;
+        open_block(p);
+        return 0;
+    }
 
-    struct ast_node* expr = parse_expression(p);
+    // An assignment starts like an expression; only the '=' after it tells
+    // them apart, and its target must be a bare identifier.
+    const uint32_t expr = parse_expression(p);
+    if (match(p, TOKEN_ASSIGN)) {
+        if (p->ast->nodes[expr].type != AST_IDENT) {
+            report(p, previous(p), "Invalid assignment target\n");
+            fail(p);
+        }
+        struct ast_node node = { .type = AST_ASSIGNMENT };
+        node.assignment.name = p->ast->nodes[expr].ident.name;
+        node.assignment.expression = parse_expression(p);
+        expect(p, TOKEN_SEMICOLON);
+        return ast_add_node(p->ast, node);
+    }
     expect(p, TOKEN_SEMICOLON);
     return expr;
 }
 
-struct ast_node* parse(const struct lex_token* tokens, size_t count) {
-    struct parser p = { .tokens = tokens, .count = count, .pos = 0 };
-    return parse_statement(&p);
+// Blocks and if/else chains nest on the same explicit stack as expressions.
+// A value of 0 below means the innermost frame is a block still collecting
+// statements.
+static uint32_t parse_statement(struct parser* p) {
+    const size_t base = p->frame_count;
+    for (;;) {
+        uint32_t value = open_statement(p);
+
+        for (;;) {
+            if (!value) {
+                if (peek(p) && peek(p)->type != TOKEN_RBRACE) break;
+                expect(p, TOKEN_RBRACE);
+                const struct parse_frame* block = pop_frame(p);
+                struct ast_node node = { .type = AST_BLOCK };
+                node.block.first = scratch_pop(p, block->mark, &node.block.count);
+                value = ast_add_node(p->ast, node);
+            }
+            if (p->frame_count == base) return value;
+
+            struct parse_frame* top = &p->frames[p->frame_count - 1];
+            if (top->kind == FRAME_BLOCK) {
+                scratch_push(p, value);
+                value = 0;
+            } else if (top->kind == FRAME_IF) {
+                top->then_branch = value;
+                if (!match(p, TOKEN_ELSE)) {
+                    value = make_if_node(p, pop_frame(p), 0);
+                    continue;
+                }
+                top->kind = FRAME_ELSE;
+                if (peek(p) && peek(p)->type == TOKEN_IF) break;
+                open_block(p);
+                value = 0;
+            } else {
+                value = make_if_node(p, pop_frame(p), value);
+            }
+        }
+    }
+}
+
+static uint32_t parse_program(struct parser* p) {
+    struct ast_node node = { .type = AST_PROGRAM };
+    const size_t mark = p->scratch_len;
+    while (peek(p)) {
+        scratch_push(p, parse_statement(p));
+    }
+    node.block.first = scratch_pop(p, mark, &node.block.count);
+    return ast_add_node(p->ast, node);
+}
+
+static uint32_t finish_statement(struct parser* p) {
+    uint32_t node;
+    if (setjmp(p->error)) {
+        node = 0;
+    } else {
+        node = parse_statement(p);
+    }
+    ts_free(p->scratch);
+    ts_free(p->frames);
+    line_index_free(&p->lines);
+    return node;
+}
+
+static uint32_t finish(struct parser* p) {
+    if (setjmp(p->error)) {
+        p->ast->root = 0;
+    } else {
+        p->ast->root = parse_program(p);
+    }
+    ts_free(p->scratch);
+    ts_free(p->frames);
+    line_index_free(&p->lines);
+    return p->ast->root;
+}
+
+uint32_t parse_statement_at(const char* source, size_t length, const struct lex_token* tokens, size_t count,
+                            size_t* pos, struct ast* ast) {
+    struct parser p = { .source = source, .source_length = length, .tokens = tokens, .count = count, .pos = *pos, .ast = ast,
+                        .max_depth = max_depth };
+    const uint32_t node = finish_statement(&p);
+    *pos = p.pos;
+    return node;
+}
+
+uint32_t parse(const char* source, size_t length, const struct lex_token* tokens, size_t count, struct ast* ast) {
+    struct parser p = { .source = source, .source_length = length, .tokens = tokens, .count = count, .pos = 0, .ast = ast,
+                        .max_depth = max_depth };
+    return finish(&p);
+}
+
+uint32_t parse_silent(const char* source, size_t length, const struct lex_token* tokens, size_t count,
+                      struct ast* ast) {
+    struct parser p = { .source = source, .source_length = length, .tokens = tokens, .count = count, .pos = 0, .ast = ast,
+                        .max_depth = max_depth, .silent = 1 };
+    return finish(&p);
+}
+
+uint32_t parse_stream(struct lexer* lexer, struct ast* ast) {
+    struct parser p = { .source = lexer->input, .source_length = lexer->length, .lexer = lexer, .ast = ast,
+                        .max_depth = max_depth };
+    p.current = lexer_next(lexer);
+    return finish(&p);
 }
@@ -5,6 +5,37 @@
 #ifndef PARSER_H
 #define PARSER_H
 #include <stddef.h>
+#include <stdint.h>
 #include "lexer/lexer.h"
-struct ast_node* parse(const struct lex_token* tokens, size_t count);
+struct ast;
+// Parses a whole program. Appends the parsed nodes to `ast` and returns the
+// AST_PROGRAM root, which is also stored in ast->root. On a syntax error
+// the message goes to stderr and the result is 0; the nodes added so far
+// are left in `ast` until it is reset. `source` is the text the tokens were lexed from.
+uint32_t parse(const char* source, size_t length, const struct lex_token* tokens, size_t count, struct ast* ast);
+// Same as parse(), but a syntax error only makes it return 0; nothing is
+// printed. For speculative parses that are redone with parse() on failure.
+uint32_t parse_silent(const char* source, size_t length, const struct lex_token* tokens, size_t count,
+                      struct ast* ast);
+// Parses the one top-level statement at tokens[*pos], for re-parsing part of
+// a program, and moves *pos past it. On a syntax error the message goes to
+// stderr, the result is 0 and *pos is left at or just past the offending
+// token.
+uint32_t parse_statement_at(const char* source, size_t length, const struct lex_token* tokens, size_t count,
+                            size_t* pos, struct ast* ast);
+// Parses straight from the lexer without materializing the token array.
+uint32_t parse_stream(struct lexer* lexer, struct ast* ast);
+// Constructs nested deeper than the limit (brackets, unary operators,
+// right operands of tighter operators, type arguments, blocks) are a syntax
+// error. The parser keeps its own stack, so the limit bounds memory, not C
+// stack use. 0 restores the default. Takes effect for parses started after
+// the call.
+#define PARSE_DEFAULT_MAX_DEPTH 1000000
+void parse_set_max_depth(size_t depth);
+struct thread_pool;
+// Same result as parse(), with top-level statements parsed in batches on
+// `pool`. Small inputs are parsed sequentially, and so is an input with a
+// syntax error, so that its diagnostics are exactly parse()'s too.
+uint32_t parse_parallel(const char* source, size_t length, const struct lex_token* tokens, size_t count,
+                        struct ast* ast, struct thread_pool* pool);
 #endif //PARSER_H
@@ -0,0 +1,326 @@
+#include "fold.h"
+#include "parser/ast.h"
+#include "utils/alloc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Folding follows the VM's semantics: arithmetic and ordering need numbers,
+// == compares type and value, and '!', '&&' and '||' produce booleans from
+// truthiness. Anything that would be a runtime type error is left alone so
+// the error still happens at run time.
+
+static int is_number(const struct ast* ast, uint32_t index)
+{
+    return ast->nodes[index].type == AST_NUMBER;
+}
+
+static double number_of(const struct ast* ast, uint32_t index)
+{
+    return ast_number_value(ast, index);
+}
+
+static const struct lex_number* literal_of(const struct ast* ast, uint32_t index)
+{
+    return &ast->numbers[ast->nodes[index].number.index];
+}
+
+static int is_literal(const struct ast* ast, uint32_t index)
+{
+    const uint8_t type = ast->nodes[index].type;
+    return type == AST_NUMBER || type == AST_BOOLEAN;
+}
+
+static int literal_truthy(const struct ast* ast, uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    return node->type == AST_BOOLEAN ? node->boolean.value != 0 : number_of(ast, index) != 0;
+}
+
+// Whether evaluating the node can only produce a number (or fail), or a
+// list of numbers: arithmetic and '-' apply element by element to lists.
+// The identities in fold_identity rely on the list kernels (vm/packed.h)
+// computing each element exactly like the scalar operator, so x * 1, x / 1,
+// x - 0 and -(-x) give the same elements either way. They have to be limited
+// to scalars if list arithmetic ever stops working that way.
+static int yields_number(const struct ast* ast, uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    switch (node->type)
+    {
+    case AST_NUMBER: return 1;
+    case AST_UNARY: return node->op == TOKEN_MINUS;
+    case AST_BINARY:
+        return node->op == TOKEN_PLUS || node->op == TOKEN_MINUS ||
+               node->op == TOKEN_STAR || node->op == TOKEN_SLASH;
+    default: return 0;
+    }
+}
+
+// '!', '&&', '||', '==' and '!=' give a boolean whatever their operands.
+static int is_logical(const struct ast_node* node)
+{
+    if (node->type == AST_UNARY) return node->op == TOKEN_NOT;
+    return node->type == AST_BINARY && (node->op == TOKEN_AND || node->op == TOKEN_OR ||
+                                        node->op == TOKEN_EQ || node->op == TOKEN_NEQ);
+}
+
+// Whether the node is known not to be a list: a literal or a logical operator.
+static int is_scalar(const struct ast* ast, uint32_t index)
+{
+    return is_literal(ast, index) || is_logical(&ast->nodes[index]);
+}
+
+// Whether evaluating the node can only produce a boolean (or fail). Ordering
+// gives a list of booleans when either operand is a list, so it only counts
+// when both operands are known scalars.
+static int yields_boolean(const struct ast* ast, uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    if (node->type == AST_BOOLEAN || is_logical(node)) return 1;
+    if (node->type != AST_BINARY || yields_number(ast, index)) return 0;
+    return is_scalar(ast, node->binary.left) && is_scalar(ast, node->binary.right);
+}
+
+static uint32_t make_literal(struct ast* ast, uint32_t index, const struct lex_number value)
+{
+    struct ast_node* node = &ast->nodes[index];
+    node->type = AST_NUMBER;
+    node->op = 0;
+    node->number.index = ast_add_number(ast, value);
+    return index;
+}
+
+static uint32_t make_number(struct ast* ast, uint32_t index, double value)
+{
+    const struct lex_number number = {.real = value, .is_integer = 0};
+    return make_literal(ast, index, number);
+}
+
+// The VM computes in double, which holds every integer up to 2^53 exactly.
+#define EXACT_INTEGER (INT64_C(1) << 53)
+
+static int is_exact(const int64_t value)
+{
+    return value >= -EXACT_INTEGER && value <= EXACT_INTEGER;
+}
+
+// Integer literals stay integers under +, - and * while the operands and the
+// result are exact doubles, so the value is the one the VM would compute.
+// Anything larger is folded in double, the way the VM rounds it.
+static int fold_integer(const enum token_type op, const int64_t l, const int64_t r, int64_t* out)
+{
+    if (!is_exact(l) || !is_exact(r)) return 0;
+    int overflow;
+    switch (op)
+    {
+    case TOKEN_PLUS: overflow = __builtin_add_overflow(l, r, out); break;
+    case TOKEN_MINUS: overflow = __builtin_sub_overflow(l, r, out); break;
+    case TOKEN_STAR: overflow = __builtin_mul_overflow(l, r, out); break;
+    default: return 0;
+    }
+    return !overflow && is_exact(*out);
+}
+
+static uint32_t make_boolean(struct ast* ast, uint32_t index, int value)
+{
+    struct ast_node* node = &ast->nodes[index];
+    node->type = AST_BOOLEAN;
+    node->op = 0;
+    node->boolean.value = value != 0;
+    return index;
+}
+
+static uint32_t fold_unary(struct ast* ast, uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    const uint32_t operand = node->unary.operand;
+    const struct ast_node* inner = &ast->nodes[operand];
+
+    if (node->op == TOKEN_MINUS)
+    {
+        if (is_number(ast, operand))
+        {
+            const struct lex_number* value = literal_of(ast, operand);
+            if (value->is_integer && value->integer != INT64_MIN)
+                return make_literal(ast, index, (struct lex_number){.integer = -value->integer, .is_integer = 1});
+            return make_number(ast, index, -number_of(ast, operand));
+        }
+        // -(-x) is x for every number, including signed zeros and NaN.
+        if (inner->type == AST_UNARY && inner->op == TOKEN_MINUS && yields_number(ast, inner->unary.operand))
+            return inner->unary.operand;
+        return index;
+    }
+
+    if (is_literal(ast, operand)) return make_boolean(ast, index, !literal_truthy(ast, operand));
+    if (inner->type == AST_UNARY && inner->op == TOKEN_NOT && yields_boolean(ast, inner->unary.operand))
+        return inner->unary.operand;
+    return index;
+}
+
+static uint32_t fold_logical(struct ast* ast, uint32_t index, uint32_t left, uint32_t right)
+{
+    const int is_and = ast->nodes[index].op == TOKEN_AND;
+    if (!is_literal(ast, left)) return index;
+
+    // false && x -> false, true || x -> true; otherwise the result is the
+    // truthiness of the right operand.
+    const int l = literal_truthy(ast, left);
+    if (l != is_and) return make_boolean(ast, index, l);
+    if (is_literal(ast, right)) return make_boolean(ast, index, literal_truthy(ast, right));
+    if (yields_boolean(ast, right)) return right;
+    return index;
+}
+
+static uint32_t fold_identity(struct ast* ast, uint32_t index, uint32_t left, uint32_t right)
+{
+    const enum token_type op = ast->nodes[index].op;
+    const int l_num = is_number(ast, left), r_num = is_number(ast, right);
+    const double l = l_num ? number_of(ast, left) : 0, r = r_num ? number_of(ast, right) : 0;
+
+    // x + 0 is deliberately not rewritten: it turns -0 into +0.
+    if (r_num && yields_number(ast, left))
+    {
+        if ((op == TOKEN_STAR || op == TOKEN_SLASH) && r == 1) return left;
+        if (op == TOKEN_MINUS && r == 0 && !signbit(r)) return left;
+    }
+    if (l_num && op == TOKEN_STAR && l == 1 && yields_number(ast, right)) return right;
+    return index;
+}
+
+static uint32_t fold_binary(struct ast* ast, uint32_t index)
+{
+    const struct ast_node* node = &ast->nodes[index];
+    const uint32_t left = node->binary.left;
+    const uint32_t right = node->binary.right;
+
+    if (node->op == TOKEN_AND || node->op == TOKEN_OR) return fold_logical(ast, index, left, right);
+
+    if (node->op == TOKEN_EQ || node->op == TOKEN_NEQ)
+    {
+        if (!is_literal(ast, left) || !is_literal(ast, right)) return index;
+        const struct ast_node* a = &ast->nodes[left];
+        const struct ast_node* b = &ast->nodes[right];
+        int equal;
+        if (a->type != b->type) equal = 0;
+        else if (a->type == AST_NUMBER) equal = number_of(ast, left) == number_of(ast, right);
+        else equal = a->boolean.value == b->boolean.value;
+        return make_boolean(ast, index, node->op == TOKEN_EQ ? equal : !equal);
+    }
+
+    if (!is_number(ast, left) || !is_number(ast, right)) return fold_identity(ast, index, left, right);
+
+    const struct lex_number* li = literal_of(ast, left);
+    const struct lex_number* ri = literal_of(ast, right);
+    int64_t folded;
+    if (li->is_integer && ri->is_integer && fold_integer(node->op, li->integer, ri->integer, &folded))
+        return make_literal(ast, index, (struct lex_number){.integer = folded, .is_integer = 1});
+
+    const double l = number_of(ast, left), r = number_of(ast, right);
+    switch (node->op)
+    {
+    case TOKEN_PLUS: return make_number(ast, index, l + r);
+    case TOKEN_MINUS: return make_number(ast, index, l - r);
+    case TOKEN_STAR: return make_number(ast, index, l * r);
+    case TOKEN_SLASH: return make_number(ast, index, l / r);
+    case TOKEN_LT: return make_boolean(ast, index, l < r);
+    case TOKEN_LE: return make_boolean(ast, index, l <= r);
+    case TOKEN_GT: return make_boolean(ast, index, l > r);
+    case TOKEN_GE: return make_boolean(ast, index, l >= r);
+    default: return index;
+    }
+}
+
+// A node still to be visited, and the reference to it in its parent that
+// receives its replacement. Folding never adds nodes or child runs, so the
+// references stay valid while the AST is rewritten.
+struct fold_item
+{
+    uint32_t node;
+    uint32_t* slot;
+    int operands_folded;
+};
+
+struct fold_stack
+{
+    struct fold_item* items;
+    size_t count;
+    size_t capacity;
+};
+
+static void push(struct fold_stack* stack, const uint32_t node, uint32_t* slot, const int operands_folded)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        struct fold_item* grown = ts_realloc(stack->items, stack->capacity * sizeof(struct fold_item));
+        if (!grown)
+        {
+            fprintf(stderr, "Failed to allocate memory in fold_constants\n");
+            abort();
+        }
+        stack->items = grown;
+    }
+    stack->items[stack->count++] = (struct fold_item){node, slot, operands_folded};
+}
+
+// Post-order walk on an explicit stack, so nesting depth is bounded by
+// memory rather than the C stack. Children are pushed in reverse to be
+// folded left to right, as a recursive walk would.
+uint32_t fold_constants(struct ast* ast, uint32_t node)
+{
+    uint32_t result = node;
+    struct fold_stack stack = {0};
+    push(&stack, node, &result, 0);
+
+    while (stack.count)
+    {
+        const struct fold_item item = stack.items[--stack.count];
+        struct ast_node* n = &ast->nodes[item.node];
+        if (item.operands_folded)
+        {
+            *item.slot = n->type == AST_UNARY ? fold_unary(ast, item.node) : fold_binary(ast, item.node);
+            continue;
+        }
+
+        switch (n->type)
+        {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            for (uint32_t i = n->block.count; i-- > 0;)
+                push(&stack, ast->children[n->block.first + i], &ast->children[n->block.first + i], 0);
+            break;
+        case AST_IF:
+            if (n->if_statement.else_branch)
+                push(&stack, n->if_statement.else_branch, &n->if_statement.else_branch, 0);
+            push(&stack, n->if_statement.then_branch, &n->if_statement.then_branch, 0);
+            push(&stack, n->if_statement.condition, &n->if_statement.condition, 0);
+            break;
+        case AST_ASSIGNMENT:
+            push(&stack, n->assignment.expression, &n->assignment.expression, 0);
+            break;
+        case AST_DECLARATION:
+            if (n->declaration.expression)
+                push(&stack, n->declaration.expression, &n->declaration.expression, 0);
+            break;
+        case AST_LIST:
+            for (uint32_t i = n->list.count; i-- > 0;)
+                push(&stack, ast->children[n->list.first + i], &ast->children[n->list.first + i], 0);
+            break;
+        case AST_UNARY:
+            push(&stack, item.node, item.slot, 1);
+            push(&stack, n->unary.operand, &n->unary.operand, 0);
+            break;
+        case AST_BINARY:
+            push(&stack, item.node, item.slot, 1);
+            push(&stack, n->binary.right, &n->binary.right, 0);
+            push(&stack, n->binary.left, &n->binary.left, 0);
+            break;
+        default:
+            break;
+        }
+    }
+
+    ts_free(stack.items);
+    return result;
+}
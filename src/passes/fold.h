@@ -0,0 +1,11 @@
+#ifndef TS_FOLD_H
+#define TS_FOLD_H
+#include <stdint.h>
+
+struct ast;
+
+// Folds constant subexpressions and applies value-preserving identities
+// below `node`. Nodes are rewritten in place; the returned index replaces
+// `node` (it differs when the whole expression collapses to one operand).
+uint32_t fold_constants(struct ast* ast, uint32_t node);
+#endif
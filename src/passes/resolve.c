@@ -0,0 +1,197 @@
+#include "resolve.h"
+#include "parser/ast.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NO_SYMBOL UINT32_MAX
+
+// A declaration in scope. `shadowed` is the binding of the same name it
+// hides, restored when its scope closes.
+struct symbol
+{
+    uint32_t name;
+    uint32_t level; // scope nesting level, 0 for the outermost
+    uint32_t slot;
+    uint32_t shadowed;
+};
+
+struct scope
+{
+    uint32_t first_symbol; // symbols[first_symbol ..] were declared in it
+    uint32_t slot_count;
+};
+
+struct resolve_frame
+{
+    uint32_t node;
+    uint32_t step;
+};
+
+struct resolver
+{
+    struct ast* ast;
+    uint32_t* innermost; // per name id: index into symbols, or NO_SYMBOL
+    struct symbol* symbols;
+    uint32_t symbol_count;
+    uint32_t symbol_capacity;
+    struct scope* scopes;
+    uint32_t scope_count;
+    uint32_t scope_capacity;
+    struct resolve_frame* frames;
+    uint32_t frame_count;
+    uint32_t frame_capacity;
+    int errors;
+};
+
+static void* grow(void* items, uint32_t* capacity, const size_t item_size)
+{
+    *capacity = *capacity ? *capacity * 2 : 64;
+    void* grown = ts_realloc(items, (size_t)*capacity * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Failed to allocate memory in resolve\n");
+        abort();
+    }
+    return grown;
+}
+
+static void push_frame(struct resolver* r, const uint32_t node)
+{
+    if (r->frame_count == r->frame_capacity)
+        r->frames = grow(r->frames, &r->frame_capacity, sizeof(struct resolve_frame));
+    r->frames[r->frame_count++] = (struct resolve_frame){.node = node, .step = 0};
+}
+
+static void open_scope(struct resolver* r)
+{
+    if (r->scope_count == r->scope_capacity) r->scopes = grow(r->scopes, &r->scope_capacity, sizeof(struct scope));
+    r->scopes[r->scope_count++] = (struct scope){.first_symbol = r->symbol_count, .slot_count = 0};
+}
+
+static uint32_t close_scope(struct resolver* r)
+{
+    const struct scope* scope = &r->scopes[--r->scope_count];
+    while (r->symbol_count > scope->first_symbol)
+    {
+        const struct symbol* symbol = &r->symbols[--r->symbol_count];
+        r->innermost[symbol->name] = symbol->shadowed;
+    }
+    return scope->slot_count;
+}
+
+static void declare(struct resolver* r, const uint32_t name)
+{
+    const uint32_t level = r->scope_count - 1;
+    struct scope* scope = &r->scopes[level];
+    const uint32_t previous = r->innermost[name];
+    if (previous != NO_SYMBOL && r->symbols[previous].level == level)
+    {
+        fprintf(stderr, "[resolve] '%s' is already declared in this scope\n", interner_lookup(&r->ast->names, name));
+        r->errors++;
+        return;
+    }
+    if (scope->slot_count == RESOLVE_MAX_SLOTS)
+    {
+        fprintf(stderr, "[resolve] Too many variables in one scope\n");
+        r->errors++;
+        return;
+    }
+    if (r->symbol_count == r->symbol_capacity)
+        r->symbols = grow(r->symbols, &r->symbol_capacity, sizeof(struct symbol));
+    r->symbols[r->symbol_count] =
+        (struct symbol){.name = name, .level = level, .slot = scope->slot_count++, .shadowed = previous};
+    r->innermost[name] = r->symbol_count++;
+}
+
+static uint32_t reference(struct resolver* r, const uint32_t name)
+{
+    const uint32_t index = r->innermost[name];
+    if (index == NO_SYMBOL)
+    {
+        fprintf(stderr, "[resolve] Undefined variable '%s'\n", interner_lookup(&r->ast->names, name));
+        r->errors++;
+        return BINDING_NONE;
+    }
+    const struct symbol* symbol = &r->symbols[index];
+    const uint32_t depth = r->scope_count - 1 - symbol->level;
+    if (depth > RESOLVE_MAX_DEPTH)
+    {
+        fprintf(stderr, "[resolve] '%s' is declared too many scopes out\n", interner_lookup(&r->ast->names, name));
+        r->errors++;
+        return BINDING_NONE;
+    }
+    return BINDING(depth, symbol->slot);
+}
+
+// Walks the tree in evaluation order on an explicit stack. Each frame's
+// step says how many of its children have been pushed so far.
+int resolve(struct ast* ast, const uint32_t root)
+{
+    struct resolver r = {.ast = ast};
+    r.innermost = ts_malloc((ast->names.count ? ast->names.count : 1) * sizeof(uint32_t));
+    if (!r.innermost)
+    {
+        fprintf(stderr, "Failed to allocate memory in resolve\n");
+        abort();
+    }
+    for (uint32_t i = 0; i < ast->names.count; i++) r.innermost[i] = NO_SYMBOL;
+
+    // A statement outside any block still needs a scope to declare into.
+    open_scope(&r);
+    push_frame(&r, root);
+    while (r.frame_count)
+    {
+        struct resolve_frame* f = &r.frames[r.frame_count - 1];
+        struct ast_node* n = &ast->nodes[f->node];
+        const uint32_t step = f->step++;
+        uint32_t child = 0;
+        switch (n->type)
+        {
+        case AST_PROGRAM:
+        case AST_BLOCK:
+            if (step == 0) open_scope(&r);
+            if (step < n->block.count) child = ast->children[n->block.first + step];
+            else n->block.slot_count = close_scope(&r);
+            break;
+        case AST_IF:
+            if (step == 0) child = n->if_statement.condition;
+            else if (step == 1) child = n->if_statement.then_branch;
+            else if (step == 2) child = n->if_statement.else_branch;
+            break;
+        case AST_DECLARATION:
+            // The initializer cannot see the variable it initializes.
+            if (step == 0 && n->declaration.expression) child = n->declaration.expression;
+            else declare(&r, n->declaration.name);
+            break;
+        case AST_ASSIGNMENT:
+            if (step == 0) child = n->assignment.expression;
+            else n->assignment.binding = reference(&r, n->assignment.name);
+            break;
+        case AST_LIST:
+            if (step < n->list.count) child = ast->children[n->list.first + step];
+            break;
+        case AST_UNARY:
+            if (step == 0) child = n->unary.operand;
+            break;
+        case AST_BINARY:
+            if (step == 0) child = n->binary.left;
+            else if (step == 1) child = n->binary.right;
+            break;
+        case AST_IDENT:
+            n->ident.binding = reference(&r, n->ident.name);
+            break;
+        default:
+            break;
+        }
+        if (child) push_frame(&r, child);
+        else r.frame_count--;
+    }
+    close_scope(&r);
+
+    ts_free(r.innermost);
+    ts_free(r.symbols);
+    ts_free(r.scopes);
+    ts_free(r.frames);
+    return r.errors == 0;
+}
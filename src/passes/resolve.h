@@ -0,0 +1,36 @@
+#ifndef TS_RESOLVE_H
+#define TS_RESOLVE_H
+#include <stdint.h>
+
+struct ast;
+
+// Lexical scopes for variables. The program and every block (the branches
+// of an `if`) open a scope; a declaration is visible from the statement
+// after it to the end of its block, and may shadow one in an outer scope.
+//
+// resolve() gives each declaration the next slot of its block, stores the
+// block's slot count in block.slot_count, and rewrites every variable
+// reference - ident.binding and assignment.binding - to the scope it was
+// declared in, counted outwards from the reference's own, and the slot
+// there. The compiler turns each binding into the index of a VM local (see
+// vm/compiler.h), so variables are read and written by index, not by name.
+//
+// Names are interned, so the symbol table is an array indexed by name id
+// holding the innermost binding of each name; leaving a scope restores the
+// bindings it shadowed.
+
+#define BINDING(depth, slot) ((uint32_t)((depth) + 1) << 24 | (uint32_t)(slot))
+#define BINDING_DEPTH(binding) (((binding) >> 24) - 1)
+#define BINDING_SLOT(binding) ((binding) & 0xFFFFFF)
+// References that are not bound: every one the parser creates, and those
+// resolve() could not resolve.
+#define BINDING_NONE 0
+
+#define RESOLVE_MAX_DEPTH 0xFE
+#define RESOLVE_MAX_SLOTS 0xFFFFFF
+
+// Resolves every reference below `root`, a program, block or statement.
+// Returns 1 on success, 0 after reporting every undefined variable and
+// every name declared twice in one scope.
+int resolve(struct ast* ast, uint32_t root);
+#endif
@@ -0,0 +1,672 @@
+#include "typecheck.h"
+#include "passes/resolve.h"
+#include "utils/alloc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Types are checked in one walk from the root in evaluation order, on an
+// explicit stack: every operand is typed before its user and every
+// declaration before the statements after it, wherever the nodes sit in the
+// array (an edited document appends re-parsed statements at the end).
+// Variables are typed per binding (resolve.h), with one array of slots per
+// open block, so a declaration in a block shadows an outer one of the same
+// name and goes out of scope with the block, as in the VM.
+
+struct variable
+{
+    uint8_t declared;
+    uint8_t type;
+    uint8_t element;
+};
+
+// An open block: its slots are variables[base .. base + slot_count), and
+// `declared` of them have been declared.
+struct type_scope
+{
+    uint32_t base;
+    uint32_t slot_count;
+    uint32_t declared;
+};
+
+struct type_frame
+{
+    uint32_t node;
+    uint32_t step;
+};
+
+struct checker
+{
+    struct ast* ast;
+    struct type_info* info;
+    struct variable* variables;
+    uint32_t variable_capacity;
+    struct type_scope* scopes;
+    uint32_t scope_count;
+    uint32_t scope_capacity;
+    struct type_frame* frames;
+    uint32_t frame_count;
+    uint32_t frame_capacity;
+    int errors;
+};
+
+static const struct
+{
+    const char* name;
+    enum data_type type;
+} type_names[] = {
+    {"Int8", DT_INT8},     {"Int16", DT_INT16},     {"Int32", DT_INT32},   {"Int64", DT_INT64},
+    {"UInt8", DT_UINT8},   {"UInt16", DT_UINT16},   {"UInt32", DT_UINT32}, {"UInt64", DT_UINT64},
+    {"Float", DT_FLOAT},   {"Double", DT_DOUBLE},   {"String", DT_STRING}, {"Char", DT_CHAR},
+    {"Bool", DT_BOOLEAN},  {"Boolean", DT_BOOLEAN}, {"List", DT_LIST},
+};
+
+#define TYPE_NAME_COUNT (sizeof(type_names) / sizeof(type_names[0]))
+
+const char* data_type_name(const uint8_t type)
+{
+    for (size_t i = 0; i < TYPE_NAME_COUNT; i++)
+        if (type_names[i].type == type) return type_names[i].name;
+    return "?";
+}
+
+static int lookup_type(const struct ast* ast, const uint32_t name, enum data_type* type)
+{
+    const char* text = interner_lookup(&ast->names, name);
+    for (size_t i = 0; i < TYPE_NAME_COUNT; i++)
+    {
+        if (strcmp(type_names[i].name, text) == 0)
+        {
+            *type = type_names[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// List takes exactly one argument and no other type takes any; nested lists
+// are checked all the way down, but only the outermost element type is kept.
+int resolve_type(const struct ast* ast, uint32_t node, enum data_type* type, uint8_t* element)
+{
+    *element = TYPE_NONE;
+    for (int depth = 0;; depth++)
+    {
+        const struct ast_node* n = &ast->nodes[node];
+        enum data_type resolved;
+        if (n->type != AST_TYPE || !lookup_type(ast, n->type_annotation.name, &resolved)) return 0;
+        if (depth == 0) *type = resolved;
+        else if (depth == 1) *element = (uint8_t)resolved;
+        if (resolved != DT_LIST) return n->type_annotation.count == 0;
+        if (n->type_annotation.count != 1) return 0;
+        node = ast->children[n->type_annotation.first];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Numeric types
+// ---------------------------------------------------------------------------
+
+static int is_integer(const uint8_t type)
+{
+    return type <= DT_UINT64 || type == DT_CHAR;
+}
+
+static int is_numeric(const uint8_t type)
+{
+    return is_integer(type) || type == DT_FLOAT || type == DT_DOUBLE;
+}
+
+static int is_unsigned(const uint8_t type)
+{
+    return type >= DT_UINT8 && type <= DT_UINT64;
+}
+
+// Integers narrower than 32 bits compute as Int32.
+static uint8_t promote(const uint8_t type)
+{
+    switch (type)
+    {
+    case DT_INT8:
+    case DT_INT16:
+    case DT_UINT8:
+    case DT_UINT16:
+    case DT_CHAR:
+        return DT_INT32;
+    default:
+        return type;
+    }
+}
+
+// C's usual arithmetic conversions.
+static uint8_t common_type(uint8_t a, uint8_t b)
+{
+    a = promote(a);
+    b = promote(b);
+    if (a == DT_DOUBLE || b == DT_DOUBLE) return DT_DOUBLE;
+    if (a == DT_FLOAT || b == DT_FLOAT) return DT_FLOAT;
+    if (a == b) return a;
+    const int wide_a = a == DT_INT64 || a == DT_UINT64, wide_b = b == DT_INT64 || b == DT_UINT64;
+    if (is_unsigned(a) == is_unsigned(b)) return wide_a ? a : b;
+    const uint8_t u = is_unsigned(a) ? a : b, s = is_unsigned(a) ? b : a;
+    const int wide_u = u == a ? wide_a : wide_b, wide_s = s == a ? wide_a : wide_b;
+    // A signed type only wins if it can hold every value of the unsigned one.
+    if (wide_s && !wide_u) return s;
+    return wide_s ? DT_UINT64 : u;
+}
+
+static enum typed_class class_of(const uint8_t type)
+{
+    switch (type)
+    {
+    case DT_INT64: return TYPED_I64;
+    case DT_UINT32: return TYPED_U32;
+    case DT_UINT64: return TYPED_U64;
+    case DT_FLOAT: return TYPED_F32;
+    case DT_DOUBLE: return TYPED_F64;
+    case DT_BOOLEAN: return TYPED_BOOL;
+    case DT_LIST: return TYPED_LIST;
+    default: return TYPED_I32;
+    }
+}
+
+static int is_literal(const struct ast* ast, const uint32_t node)
+{
+    return ast->nodes[node].type == AST_NUMBER;
+}
+
+static uint8_t literal_type(const struct ast* ast, const uint32_t node)
+{
+    return ast->numbers[ast->nodes[node].number.index].is_integer ? DT_INT64 : DT_DOUBLE;
+}
+
+// Whether the literal's value is exactly representable in `type`.
+static int literal_fits(const struct ast* ast, const uint32_t node, const uint8_t type)
+{
+    const struct lex_number* number = &ast->numbers[ast->nodes[node].number.index];
+    if (!number->is_integer)
+        return type == DT_FLOAT ? (double)(float)number->real == number->real : type == DT_DOUBLE;
+    const int64_t v = number->integer;
+    switch (type)
+    {
+    case DT_INT8: return v >= INT8_MIN && v <= INT8_MAX;
+    case DT_INT16: return v >= INT16_MIN && v <= INT16_MAX;
+    case DT_INT32: return v >= INT32_MIN && v <= INT32_MAX;
+    case DT_INT64: return 1;
+    case DT_UINT8:
+    case DT_CHAR: return v >= 0 && v <= UINT8_MAX;
+    case DT_UINT16: return v >= 0 && v <= UINT16_MAX;
+    case DT_UINT32: return v >= 0 && v <= UINT32_MAX;
+    case DT_UINT64: return v >= 0;
+    case DT_FLOAT: return v >= -(1 << 24) && v <= 1 << 24;
+    case DT_DOUBLE: return v >= -(1ll << 53) && v <= 1ll << 53;
+    default: return 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Checking
+// ---------------------------------------------------------------------------
+
+static const char* op_text(const uint8_t op)
+{
+    switch (op)
+    {
+    case TOKEN_PLUS: return "+";
+    case TOKEN_MINUS: return "-";
+    case TOKEN_STAR: return "*";
+    case TOKEN_SLASH: return "/";
+    case TOKEN_LT: return "<";
+    case TOKEN_LE: return "<=";
+    case TOKEN_GT: return ">";
+    case TOKEN_GE: return ">=";
+    case TOKEN_EQ: return "==";
+    case TOKEN_NEQ: return "!=";
+    case TOKEN_AND: return "&&";
+    case TOKEN_OR: return "||";
+    default: return "!";
+    }
+}
+
+static enum typed_kind kind_of(const uint8_t op)
+{
+    switch (op)
+    {
+    case TOKEN_PLUS: return TYPED_ADD;
+    case TOKEN_MINUS: return TYPED_SUB;
+    case TOKEN_STAR: return TYPED_MUL;
+    case TOKEN_SLASH: return TYPED_DIV;
+    case TOKEN_LT: return TYPED_LT;
+    case TOKEN_LE: return TYPED_LE;
+    case TOKEN_GT: return TYPED_GT;
+    case TOKEN_GE: return TYPED_GE;
+    case TOKEN_EQ: return TYPED_EQ;
+    case TOKEN_NEQ: return TYPED_NE;
+    case TOKEN_AND: return TYPED_AND;
+    default: return TYPED_OR;
+    }
+}
+
+static void error(struct checker* c, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[types] ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    c->errors++;
+}
+
+static void convert(struct checker* c, const uint32_t node, const uint8_t type)
+{
+    if (c->info[node].type != type) c->info[node].convert = type;
+}
+
+// Makes the value of `node` a `type` (with `element`, for lists), for a
+// variable or a list element. Literals that fit simply take the type.
+static void coerce(struct checker* c, const uint32_t node, const uint8_t type, const uint8_t element,
+                   const char* what)
+{
+    struct type_info* info = &c->info[node];
+    if (info->type == TYPE_NONE) return;
+    if (is_literal(c->ast, node) && literal_fits(c->ast, node, type))
+    {
+        info->type = type;
+        return;
+    }
+    if (is_numeric(info->type) && is_numeric(type))
+    {
+        convert(c, node, type);
+        return;
+    }
+    if (info->type != type)
+    {
+        error(c, "Cannot use %s as %s", data_type_name(info->type), what);
+        return;
+    }
+    if (type != DT_LIST || element == TYPE_NONE || info->element == element || info->element == TYPE_NONE) return;
+
+    // A list literal takes the element type it is stored as, as far as its
+    // elements allow; any other list must already have it.
+    const struct ast_node* n = &c->ast->nodes[node];
+    if (n->type != AST_LIST)
+    {
+        error(c, "Cannot use a list of %s as %s", data_type_name(info->element), what);
+        return;
+    }
+    for (uint32_t i = 0; i < n->list.count; i++)
+    {
+        const uint32_t item = c->ast->children[n->list.first + i];
+        c->info[item].convert = TYPE_NONE;
+        coerce(c, item, element, TYPE_NONE, "a list element");
+    }
+    info->element = element;
+}
+
+// Numbers are accepted as conditions by their truthiness.
+static void condition(struct checker* c, const uint32_t node, const char* what)
+{
+    const uint8_t type = c->info[node].type;
+    if (type == TYPE_NONE || type == DT_BOOLEAN) return;
+    if (is_numeric(type)) convert(c, node, DT_BOOLEAN);
+    else error(c, "Expected a boolean or a number as %s, found %s", what, data_type_name(type));
+}
+
+static void check_list(struct checker* c, const uint32_t index)
+{
+    const struct ast_node* n = &c->ast->nodes[index];
+    struct type_info* info = &c->info[index];
+    info->type = DT_LIST;
+
+    // The element type is the common type of the elements. Literals only
+    // widen it when they do not fit.
+    uint8_t element = TYPE_NONE;
+    for (int literals = 0; literals < 2; literals++)
+    {
+        for (uint32_t i = 0; i < n->list.count; i++)
+        {
+            const uint32_t item = c->ast->children[n->list.first + i];
+            uint8_t type = c->info[item].type;
+            if (type == TYPE_NONE) return;
+            if (is_literal(c->ast, item) != literals) continue;
+            if (literals && element != TYPE_NONE && is_numeric(element) && literal_fits(c->ast, item, element))
+                continue;
+            if (literals) type = literal_type(c->ast, item);
+            if (element == TYPE_NONE) element = type;
+            else if (is_numeric(element) && is_numeric(type)) element = common_type(element, type);
+            else if (element != type)
+            {
+                error(c, "List elements have different types: %s and %s", data_type_name(element),
+                      data_type_name(type));
+                return;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < n->list.count; i++)
+        coerce(c, c->ast->children[n->list.first + i], element, TYPE_NONE, "a list element");
+    info->element = element;
+}
+
+static void check_unary(struct checker* c, const uint32_t index)
+{
+    struct ast_node* n = &c->ast->nodes[index];
+    const uint32_t operand = n->unary.operand;
+    const uint8_t type = c->info[operand].type;
+    if (type == TYPE_NONE) return;
+    if (n->op == TOKEN_NOT)
+    {
+        condition(c, operand, "the operand of '!'");
+        c->info[index].type = DT_BOOLEAN;
+        n->flags = TYPED_OP(TYPED_NOT, TYPED_BOOL);
+        return;
+    }
+    const uint8_t element = c->info[operand].element;
+    if (type == DT_LIST && (element == TYPE_NONE || is_numeric(element)))
+    {
+        c->info[index].type = DT_LIST;
+        c->info[index].element = element == TYPE_NONE ? TYPE_NONE : promote(element);
+        n->flags = TYPED_OP(TYPED_NEG, TYPED_LIST);
+        return;
+    }
+    if (!is_numeric(type))
+    {
+        error(c, "Operator '-' needs a number or a list of numbers, found %s", data_type_name(type));
+        return;
+    }
+    const uint8_t result = promote(type);
+    convert(c, operand, result);
+    c->info[index].type = result;
+    n->flags = TYPED_OP(TYPED_NEG, class_of(result));
+}
+
+// Arithmetic and ordering with a list of numbers on either side apply
+// element by element; the other operand is a number or a list of numbers.
+// The elements of the result have the common type, or are booleans.
+static void check_elementwise(struct checker* c, const uint32_t index)
+{
+    struct ast_node* n = &c->ast->nodes[index];
+    const uint32_t left = n->binary.left, right = n->binary.right;
+    struct type_info* l = &c->info[left];
+    struct type_info* r = &c->info[right];
+    uint8_t a = l->type == DT_LIST ? l->element : l->type;
+    uint8_t b = r->type == DT_LIST ? r->element : r->type;
+    // The elements of an empty list literal take the other side's type.
+    if (a == TYPE_NONE) a = b == TYPE_NONE ? DT_DOUBLE : b;
+    if (b == TYPE_NONE) b = a;
+    if (!is_numeric(a) || !is_numeric(b))
+    {
+        error(c, "Operator '%s' needs numbers or lists of numbers, found %s and %s", op_text(n->op),
+              data_type_name(l->type), data_type_name(r->type));
+        return;
+    }
+    if (l->type != DT_LIST && is_literal(c->ast, left) && literal_fits(c->ast, left, promote(b))) a = promote(b);
+    if (r->type != DT_LIST && is_literal(c->ast, right) && literal_fits(c->ast, right, promote(a))) b = promote(a);
+
+    const uint8_t common = common_type(a, b);
+    if (l->type != DT_LIST)
+    {
+        l->type = a;
+        convert(c, left, common);
+    }
+    if (r->type != DT_LIST)
+    {
+        r->type = b;
+        convert(c, right, common);
+    }
+    const enum typed_kind kind = kind_of(n->op);
+    c->info[index].type = DT_LIST;
+    c->info[index].element = kind >= TYPED_LT ? DT_BOOLEAN : common;
+    n->flags = TYPED_OP(kind, TYPED_LIST);
+}
+
+static void check_binary(struct checker* c, const uint32_t index)
+{
+    struct ast_node* n = &c->ast->nodes[index];
+    const uint32_t left = n->binary.left, right = n->binary.right;
+    struct type_info* l = &c->info[left];
+    struct type_info* r = &c->info[right];
+    if (l->type == TYPE_NONE || r->type == TYPE_NONE) return;
+    struct type_info* info = &c->info[index];
+
+    if (n->op == TOKEN_AND || n->op == TOKEN_OR)
+    {
+        condition(c, left, n->op == TOKEN_AND ? "an operand of '&&'" : "an operand of '||'");
+        condition(c, right, n->op == TOKEN_AND ? "an operand of '&&'" : "an operand of '||'");
+        info->type = DT_BOOLEAN;
+        n->flags = TYPED_OP(kind_of(n->op), TYPED_BOOL);
+        return;
+    }
+
+    const int equality = n->op == TOKEN_EQ || n->op == TOKEN_NEQ;
+    if (equality && !is_numeric(l->type) && l->type == r->type && (l->type == DT_BOOLEAN || l->type == DT_LIST))
+    {
+        info->type = DT_BOOLEAN;
+        n->flags = TYPED_OP(kind_of(n->op), class_of(l->type));
+        return;
+    }
+    if (!equality && (l->type == DT_LIST || r->type == DT_LIST))
+    {
+        check_elementwise(c, index);
+        return;
+    }
+    if (!is_numeric(l->type) || !is_numeric(r->type))
+    {
+        if (equality) error(c, "Cannot compare %s with %s", data_type_name(l->type), data_type_name(r->type));
+        else
+            error(c, "Operator '%s' needs numbers, found %s and %s", op_text(n->op), data_type_name(l->type),
+                  data_type_name(r->type));
+        return;
+    }
+
+    // A literal next to a typed operand takes its type when it fits.
+    const int l_literal = is_literal(c->ast, left), r_literal = is_literal(c->ast, right);
+    if (l_literal && !r_literal && literal_fits(c->ast, left, promote(r->type))) l->type = promote(r->type);
+    if (r_literal && !l_literal && literal_fits(c->ast, right, promote(l->type))) r->type = promote(l->type);
+
+    const uint8_t common = common_type(l->type, r->type);
+    convert(c, left, common);
+    convert(c, right, common);
+    const enum typed_kind kind = kind_of(n->op);
+    info->type = kind >= TYPED_LT ? DT_BOOLEAN : common;
+    n->flags = TYPED_OP(kind, class_of(common));
+}
+
+static void* grow(void* items, uint32_t* capacity, const uint32_t needed, const size_t item_size)
+{
+    if (needed <= *capacity) return items;
+    uint32_t grown_capacity = *capacity ? *capacity : 64;
+    while (grown_capacity < needed) grown_capacity *= 2;
+    void* grown = ts_realloc(items, (size_t)grown_capacity * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Failed to allocate memory in typecheck\n");
+        abort();
+    }
+    *capacity = grown_capacity;
+    return grown;
+}
+
+// Nested blocks take the slots after their parent's; siblings share them.
+static void open_scope(struct checker* c, const uint32_t slot_count)
+{
+    c->scopes = grow(c->scopes, &c->scope_capacity, c->scope_count + 1, sizeof(struct type_scope));
+    const struct type_scope* parent = c->scope_count ? &c->scopes[c->scope_count - 1] : NULL;
+    const uint32_t base = parent ? parent->base + parent->slot_count : 0;
+    c->variables = grow(c->variables, &c->variable_capacity, base + slot_count, sizeof(struct variable));
+    if (slot_count) memset(c->variables + base, 0, (size_t)slot_count * sizeof(struct variable));
+    c->scopes[c->scope_count++] = (struct type_scope){.base = base, .slot_count = slot_count};
+}
+
+// The next slot of the innermost block, or NULL if resolve() gave it none.
+static struct variable* declare(struct checker* c)
+{
+    struct type_scope* scope = &c->scopes[c->scope_count - 1];
+    if (scope->declared == scope->slot_count) return NULL;
+    return &c->variables[scope->base + scope->declared++];
+}
+
+// The variable a reference is bound to, or NULL if it is unbound or not
+// declared yet.
+static const struct variable* lookup(const struct checker* c, const uint32_t binding)
+{
+    if (binding == BINDING_NONE) return NULL;
+    const uint32_t depth = BINDING_DEPTH(binding), slot = BINDING_SLOT(binding);
+    if (depth >= c->scope_count) return NULL;
+    const struct type_scope* scope = &c->scopes[c->scope_count - 1 - depth];
+    if (slot >= scope->slot_count || !c->variables[scope->base + slot].declared) return NULL;
+    return &c->variables[scope->base + slot];
+}
+
+static void check_node(struct checker* c, const uint32_t index)
+{
+    struct ast* ast = c->ast;
+    const struct ast_node* n = &ast->nodes[index];
+    struct type_info* info = &c->info[index];
+    switch (n->type)
+    {
+    case AST_NUMBER:
+        info->type = literal_type(ast, index);
+        break;
+    case AST_BOOLEAN:
+        info->type = DT_BOOLEAN;
+        break;
+    case AST_IDENT:
+    {
+        const struct variable* v = lookup(c, n->ident.binding);
+        if (!v)
+        {
+            error(c, "Undefined variable '%s'", interner_lookup(&ast->names, n->ident.name));
+            break;
+        }
+        info->type = v->type;
+        info->element = v->element;
+        break;
+    }
+    case AST_LIST:
+        check_list(c, index);
+        break;
+    case AST_UNARY:
+        check_unary(c, index);
+        break;
+    case AST_BINARY:
+        check_binary(c, index);
+        break;
+    case AST_IF:
+        condition(c, n->if_statement.condition, "an 'if' condition");
+        break;
+    case AST_DECLARATION:
+    {
+        const char* name = interner_lookup(&ast->names, n->declaration.name);
+        struct variable* v = declare(c);
+        if (!v)
+        {
+            error(c, "Variable '%s' has no slot; run resolve() first", name);
+            break;
+        }
+        enum data_type type;
+        uint8_t element;
+        if (!resolve_type(ast, n->declaration.type, &type, &element))
+        {
+            // Declared all the same, so its uses are not reported again.
+            error(c, "Unknown type in the declaration of '%s'", name);
+            *v = (struct variable){.declared = 1, .type = TYPE_NONE};
+            break;
+        }
+        *v = (struct variable){.declared = 1, .type = type, .element = element};
+        if (n->declaration.expression) coerce(c, n->declaration.expression, type, element, data_type_name(type));
+        break;
+    }
+    case AST_ASSIGNMENT:
+    {
+        const struct variable* v = lookup(c, n->assignment.binding);
+        if (!v)
+            error(c, "Assignment to undeclared variable '%s'", interner_lookup(&ast->names, n->assignment.name));
+        else if (v->type != TYPE_NONE) coerce(c, n->assignment.expression, v->type, v->element, data_type_name(v->type));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// The step-th child of a node in evaluation order, or 0 once they are done.
+static uint32_t child_at(const struct ast* ast, const struct ast_node* n, const uint32_t step)
+{
+    switch (n->type)
+    {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+        return step < n->block.count ? ast->children[n->block.first + step] : 0;
+    case AST_IF:
+        if (step == 0) return n->if_statement.condition;
+        if (step == 1) return n->if_statement.then_branch;
+        return step == 2 ? n->if_statement.else_branch : 0;
+    case AST_DECLARATION:
+        return step == 0 ? n->declaration.expression : 0;
+    case AST_ASSIGNMENT:
+        return step == 0 ? n->assignment.expression : 0;
+    case AST_LIST:
+        return step < n->list.count ? ast->children[n->list.first + step] : 0;
+    case AST_UNARY:
+        return step == 0 ? n->unary.operand : 0;
+    case AST_BINARY:
+        if (step == 0) return n->binary.left;
+        return step == 1 ? n->binary.right : 0;
+    default:
+        return 0;
+    }
+}
+
+int typecheck(struct ast* ast, const uint32_t root, struct type_table* table)
+{
+    table->count = ast->node_count;
+    table->nodes = ts_malloc((ast->node_count ? ast->node_count : 1) * sizeof(struct type_info));
+    if (!table->nodes)
+    {
+        fprintf(stderr, "Failed to allocate memory in typecheck\n");
+        abort();
+    }
+    memset(table->nodes, 0xFF, ast->node_count * sizeof(struct type_info));
+    struct checker c = {.ast = ast, .info = table->nodes};
+
+    // resolve() declares a statement outside any block in a scope of its own.
+    open_scope(&c, ast->nodes[root].type == AST_DECLARATION);
+    c.frames = grow(c.frames, &c.frame_capacity, 1, sizeof(struct type_frame));
+    c.frames[c.frame_count++] = (struct type_frame){.node = root};
+    while (c.frame_count)
+    {
+        struct type_frame* f = &c.frames[c.frame_count - 1];
+        struct ast_node* n = &ast->nodes[f->node];
+        const uint32_t step = f->step++;
+        const int block = n->type == AST_PROGRAM || n->type == AST_BLOCK;
+        if (block && step == 0) open_scope(&c, n->block.slot_count);
+
+        const uint32_t child = child_at(ast, n, step);
+        if (child)
+        {
+            c.frames = grow(c.frames, &c.frame_capacity, c.frame_count + 1, sizeof(struct type_frame));
+            c.frames[c.frame_count++] = (struct type_frame){.node = child};
+            continue;
+        }
+
+        c.frame_count--;
+        if (block) c.scope_count--;
+        else
+        {
+            if (n->type == AST_UNARY || n->type == AST_BINARY) n->flags = 0;
+            check_node(&c, (uint32_t)(n - ast->nodes));
+        }
+    }
+    ts_free(c.variables);
+    ts_free(c.scopes);
+    ts_free(c.frames);
+    return c.errors == 0;
+}
+
+void type_table_free(struct type_table* table)
+{
+    ts_free(table->nodes);
+    table->nodes = NULL;
+    table->count = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef TS_TYPECHECK_H
+#define TS_TYPECHECK_H
+#include <stdint.h>
+#include "parser/ast.h"
+
+// Static types from the declared annotations.
+//
+// typecheck() resolves every `var` annotation to an enum data_type (Int32,
+// UInt8, Double, Bool, List<Int64>, ...), infers the type of every
+// expression from the declarations it reads, and records in a side table
+// where a value has to be converted: an Int16 operand of an Int64 addition,
+// the Int64 result stored into an Int32 variable, a number used as a
+// condition. Arithmetic follows C's usual conversions: Int8, Int16, UInt8,
+// UInt16 and Char are promoted to Int32; integer literals take the type of
+// the other operand, or of the variable, when their value fits.
+//
+// Each AST_UNARY and AST_BINARY node also gets a typed opcode in its `flags`,
+// such as TYPED_OP(TYPED_ADD, TYPED_I64), naming the operation and the
+// machine type it runs on once its operands are converted. An execution
+// engine can switch on it and use native integer and float arithmetic
+// instead of dispatching on boxed doubles at run time.
+//
+// Arithmetic, ordering and '-' with a list of numbers as an operand apply
+// element by element and give a list; their typed opcode has TYPED_LIST.
+//
+// There are no casts in the language, so any number converts to any other
+// number implicitly; numbers and booleans do not mix, except that numbers
+// are accepted, and converted, where a condition is expected.
+
+// Node types and conversion targets are enum data_type, or TYPE_NONE.
+#define TYPE_NONE 0xFF
+
+enum typed_kind
+{
+    TYPED_ADD = 1,
+    TYPED_SUB,
+    TYPED_MUL,
+    TYPED_DIV,
+    TYPED_LT,
+    TYPED_LE,
+    TYPED_GT,
+    TYPED_GE,
+    TYPED_EQ,
+    TYPED_NE,
+    TYPED_AND,
+    TYPED_OR,
+    TYPED_NEG,
+    TYPED_NOT,
+};
+
+// The machine type an operation works on.
+enum typed_class
+{
+    TYPED_I32,
+    TYPED_I64,
+    TYPED_U32,
+    TYPED_U64,
+    TYPED_F32,
+    TYPED_F64,
+    TYPED_BOOL,
+    TYPED_LIST, // == and != on whole lists; anything else is element-wise
+};
+
+#define TYPED_OP(kind, cls) ((uint16_t)((kind) << 4 | (cls)))
+#define TYPED_OP_KIND(op) ((enum typed_kind)((op) >> 4))
+#define TYPED_OP_CLASS(op) ((enum typed_class)((op) & 0xF))
+
+struct type_info
+{
+    uint8_t type; // enum data_type of the node's value; TYPE_NONE for statements
+    uint8_t element; // for DT_LIST, the element type, or TYPE_NONE if unknown
+    uint8_t convert; // type the value is converted to where it is used, or TYPE_NONE
+};
+
+struct type_table
+{
+    struct type_info* nodes; // indexed by node
+    uint32_t count;
+};
+
+// Checks the program, statement or expression at `root` and fills `table`.
+// Variables are looked up by their bindings, so resolve() must have run on
+// `root` first. Returns 1 if it is well typed, 0 after printing every error
+// found; the annotations are then incomplete.
+int typecheck(struct ast* ast, uint32_t root, struct type_table* table);
+void type_table_free(struct type_table* table);
+
+// Resolves an AST_TYPE node. Returns 0 for unknown names.
+int resolve_type(const struct ast* ast, uint32_t node, enum data_type* type, uint8_t* element);
+const char* data_type_name(uint8_t type);
+#endif
@@ -0,0 +1,46 @@
+#include "alloc.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct ts_allocator current;
+
+void ts_set_allocator(const struct ts_allocator* allocator)
+{
+    if (allocator) current = *allocator;
+    else memset(&current, 0, sizeof(current));
+}
+
+struct ts_allocator ts_get_allocator(void)
+{
+    return current;
+}
+
+void* ts_malloc(const size_t size)
+{
+    if (!current.reallocate) return malloc(size);
+    return current.reallocate(current.context, NULL, size ? size : 1);
+}
+
+void* ts_calloc(const size_t count, const size_t size)
+{
+    if (!current.reallocate) return calloc(count, size);
+    if (size && count > SIZE_MAX / size) return NULL;
+    const size_t total = count * size;
+    void* pointer = current.reallocate(current.context, NULL, total ? total : 1);
+    if (pointer) memset(pointer, 0, total);
+    return pointer;
+}
+
+void* ts_realloc(void* pointer, const size_t size)
+{
+    if (!current.reallocate) return realloc(pointer, size);
+    return current.reallocate(current.context, pointer, size ? size : 1);
+}
+
+void ts_free(void* pointer)
+{
+    if (!pointer) return;
+    if (!current.reallocate) free(pointer);
+    else current.reallocate(current.context, pointer, 0);
+}
@@ -0,0 +1,31 @@
+#ifndef TS_ALLOC_H
+#define TS_ALLOC_H
+#include <stddef.h>
+
+// Allocation hook. The lexer, parser, AST, name table, arena, list and
+// string helpers, the passes, the compiler, VM, JIT and column kernels and
+// the batch driver allocate through ts_malloc() and friends, which go to
+// libc unless another allocator is installed. Memory they hand
+// out (token arrays from parse_text, ts_strndup strings, list_to_array
+// arrays) must be released with ts_free().
+
+struct ts_allocator
+{
+    // Same contract as realloc(): a NULL `pointer` allocates, and a `size`
+    // of 0 frees `pointer` and returns NULL.
+    void* (*reallocate)(void* context, void* pointer, size_t size);
+    void* context;
+};
+
+// Installs `allocator`, or libc for NULL. Only call it while nothing
+// allocated by the previous allocator is still alive, or when the new one
+// forwards to it, and never while other threads are allocating.
+void ts_set_allocator(const struct ts_allocator* allocator);
+// The installed allocator; reallocate is NULL while it is libc.
+struct ts_allocator ts_get_allocator(void);
+
+void* ts_malloc(size_t size);
+void* ts_calloc(size_t count, size_t size);
+void* ts_realloc(void* pointer, size_t size);
+void ts_free(void* pointer);
+#endif
@@ -0,0 +1,106 @@
+#include "arena.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdalign.h>
+#include <string.h>
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_chunk
+{
+    struct arena_chunk* next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(const size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void arena_init(struct arena* arena, const size_t chunk_size)
+{
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+}
+
+static struct arena_chunk* new_chunk(const size_t size)
+{
+    struct arena_chunk* chunk = ts_malloc(sizeof(struct arena_chunk) + size);
+    if (!chunk)
+    {
+        fprintf(stderr, "Failed to allocate memory in arena_alloc\n");
+        abort();
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    size = align_up(size ? size : 1);
+    struct arena_chunk* chunk = arena->current;
+    if (chunk && chunk->size - chunk->used >= size)
+    {
+        void* p = chunk->data + chunk->used;
+        chunk->used += size;
+        return p;
+    }
+
+    // Move on to chunks kept by a previous reset before allocating new ones.
+    while (chunk && chunk->next)
+    {
+        chunk = chunk->next;
+        chunk->used = 0;
+        if (chunk->size >= size)
+        {
+            arena->current = chunk;
+            chunk->used = size;
+            return chunk->data;
+        }
+    }
+
+    struct arena_chunk* fresh = new_chunk(size > arena->chunk_size ? size : arena->chunk_size);
+    if (chunk)
+    {
+        fresh->next = chunk->next;
+        chunk->next = fresh;
+    }
+    else arena->head = fresh;
+    arena->current = fresh;
+    fresh->used = size;
+    return fresh->data;
+}
+
+char* arena_strndup(struct arena* arena, const char* s, const size_t n)
+{
+    char* p = arena_alloc(arena, n + 1);
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+void arena_reset(struct arena* arena)
+{
+    arena->current = arena->head;
+    if (arena->head) arena->head->used = 0;
+}
+
+void arena_free(struct arena* arena)
+{
+    struct arena_chunk* chunk = arena->head;
+    while (chunk)
+    {
+        struct arena_chunk* next = chunk->next;
+        ts_free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+}
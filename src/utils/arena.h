@@ -0,0 +1,23 @@
+#ifndef TS_ARENA_H
+#define TS_ARENA_H
+#include <stddef.h>
+
+// Bump allocator over a chain of chunks. Individual allocations are never
+// freed; arena_reset() rewinds everything at once and keeps the chunks for
+// reuse, arena_free() returns them to the system.
+
+struct arena_chunk;
+
+struct arena
+{
+    struct arena_chunk* head;
+    struct arena_chunk* current;
+    size_t chunk_size;
+};
+
+void arena_init(struct arena* arena, size_t chunk_size);
+void* arena_alloc(struct arena* arena, size_t size);
+char* arena_strndup(struct arena* arena, const char* s, size_t n);
+void arena_reset(struct arena* arena);
+void arena_free(struct arena* arena);
+#endif
@@ -0,0 +1,13 @@
+#include "cpu.h"
+#include <stdlib.h>
+
+enum cpu_level cpu_detect(void)
+{
+    if (getenv("TS_DISABLE_SIMD")) return CPU_SCALAR;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return CPU_AVX2;
+    if (__builtin_cpu_supports("sse2")) return CPU_SSE2;
+#endif
+    return CPU_SCALAR;
+}
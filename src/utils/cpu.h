@@ -0,0 +1,14 @@
+#ifndef TS_CPU_H
+#define TS_CPU_H
+
+enum cpu_level
+{
+    CPU_SCALAR,
+    CPU_SSE2,
+    CPU_AVX2,
+};
+
+// Best vector extension available at runtime. Setting TS_DISABLE_SIMD in the
+// environment forces CPU_SCALAR, which is handy for comparing code paths.
+enum cpu_level cpu_detect(void);
+#endif
@@ -0,0 +1,13 @@
+#include "diag.h"
+
+static _Thread_local const char* current_source;
+
+void diag_set_source(const char* name)
+{
+    current_source = name;
+}
+
+const char* diag_source(void)
+{
+    return current_source;
+}
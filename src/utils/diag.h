@@ -0,0 +1,10 @@
+#ifndef TS_DIAG_H
+#define TS_DIAG_H
+
+// Name of the input the calling thread is working on. Diagnostics that
+// carry a position are prefixed with it, so messages from a batch run can
+// be told apart. NULL, the default, prints no prefix. Pool workers take the
+// name of the thread that started the run (see thread_pool_run()).
+void diag_set_source(const char* name);
+const char* diag_source(void);
+#endif
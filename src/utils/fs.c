@@ -1,5 +1,12 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define FS_POSIX 1
+#endif
+
+#include "fs.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 char* read_file(const char* filename)
 {
@@ -38,3 +45,240 @@ char* read_file(const char* filename)
 
     return src;
 }
+
+static int read_stream(FILE* fd, const char* filename, struct source_file* out)
+{
+    size_t capacity = 64 * 1024, length = 0;
+    char* data = malloc(capacity);
+    while (data)
+    {
+        length += fread(data + length, 1, capacity - length, fd);
+        if (length < capacity) break;
+        capacity *= 2;
+        char* grown = realloc(data, capacity);
+        if (!grown) free(data);
+        data = grown;
+    }
+    if (!data)
+    {
+        fprintf(stderr, "Could not allocate memory for file %s\n", filename);
+        return 0;
+    }
+    if (ferror(fd))
+    {
+        fprintf(stderr, "Could not read file %s\n", filename);
+        free(data);
+        return 0;
+    }
+    out->data = data;
+    out->length = length;
+    out->mapped = 0;
+    return 1;
+}
+
+#ifdef FS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int map_file(const char* filename, struct source_file* out)
+{
+    if (filename[0] == '-' && filename[1] == '\0')
+        return read_stream(stdin, "<stdin>", out);
+
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "Could not stat file %s\n", filename);
+        close(fd);
+        return 0;
+    }
+
+    // Pipes and devices cannot be mapped, and some special files report a
+    // size of zero even though they have contents.
+    if (!S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        FILE* stream = fdopen(fd, "rb");
+        if (!stream)
+        {
+            fprintf(stderr, "Could not open file %s\n", filename);
+            close(fd);
+            return 0;
+        }
+        const int ok = read_stream(stream, filename, out);
+        fclose(stream);
+        return ok;
+    }
+
+    out->length = (size_t)st.st_size;
+    out->mapped = 1;
+    void* data = mmap(NULL, out->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map file %s\n", filename);
+        return 0;
+    }
+    posix_madvise(data, out->length, POSIX_MADV_SEQUENTIAL);
+    out->data = data;
+    return 1;
+}
+
+void unmap_file(struct source_file* file)
+{
+    if (file->mapped)
+        munmap((void*)file->data, file->length);
+    else
+        free((void*)file->data);
+    file->data = NULL;
+    file->length = 0;
+    file->mapped = 0;
+}
+#else
+int map_file(const char* filename, struct source_file* out)
+{
+    FILE* fd = filename[0] == '-' && filename[1] == '\0' ? stdin : fopen(filename, "rb");
+    if (!fd)
+    {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return 0;
+    }
+    const int ok = read_stream(fd, filename, out);
+    if (fd != stdin) fclose(fd);
+    return ok;
+}
+
+void unmap_file(struct source_file* file)
+{
+    free((void*)file->data);
+    file->data = NULL;
+    file->length = 0;
+}
+#endif
+
+void path_list_add(struct path_list* list, const char* path)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        char** grown = realloc(list->paths, list->capacity * sizeof(char*));
+        if (!grown)
+        {
+            fprintf(stderr, "Could not allocate memory for path list\n");
+            abort();
+        }
+        list->paths = grown;
+    }
+    const size_t length = strlen(path);
+    char* copy = malloc(length + 1);
+    if (!copy)
+    {
+        fprintf(stderr, "Could not allocate memory for path list\n");
+        abort();
+    }
+    memcpy(copy, path, length + 1);
+    list->paths[list->count++] = copy;
+}
+
+void path_list_free(struct path_list* list)
+{
+    for (size_t i = 0; i < list->count; i++) free(list->paths[i]);
+    free(list->paths);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+#ifdef FS_POSIX
+#include <dirent.h>
+
+static int compare_paths(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int collect_files(const char* path, struct path_list* out)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0)
+    {
+        fprintf(stderr, "Could not stat file %s\n", path);
+        return 0;
+    }
+    if (S_ISLNK(st.st_mode) && stat(path, &st) != 0)
+    {
+        fprintf(stderr, "Could not stat file %s\n", path);
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        path_list_add(out, path);
+        return 1;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir)
+    {
+        fprintf(stderr, "Could not open directory %s\n", path);
+        return 0;
+    }
+
+    // Gather this directory's entries first so they can be sorted; readdir
+    // order depends on the file system.
+    struct path_list entries = {0};
+    const size_t base = strlen(path);
+    const int slash = base > 0 && path[base - 1] == '/';
+    char* child = NULL;
+    size_t child_capacity = 0;
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        const size_t needed = base + 1 + strlen(entry->d_name) + 1;
+        if (needed > child_capacity)
+        {
+            child_capacity = needed * 2;
+            char* grown = realloc(child, child_capacity);
+            if (!grown)
+            {
+                fprintf(stderr, "Could not allocate memory for path list\n");
+                abort();
+            }
+            child = grown;
+        }
+        snprintf(child, child_capacity, slash ? "%s%s" : "%s/%s", path, entry->d_name);
+        path_list_add(&entries, child);
+    }
+    closedir(dir);
+    free(child);
+
+    if (entries.count) qsort(entries.paths, entries.count, sizeof(char*), compare_paths);
+
+    int ok = 1;
+    for (size_t i = 0; i < entries.count; i++)
+    {
+        struct stat entry_st;
+        if (lstat(entries.paths[i], &entry_st) != 0) continue;
+        if (S_ISDIR(entry_st.st_mode)) ok &= collect_files(entries.paths[i], out);
+        else if (S_ISREG(entry_st.st_mode)) path_list_add(out, entries.paths[i]);
+        else if (S_ISLNK(entry_st.st_mode) && stat(entries.paths[i], &entry_st) == 0 && S_ISREG(entry_st.st_mode))
+            path_list_add(out, entries.paths[i]);
+    }
+    path_list_free(&entries);
+    return ok;
+}
+#else
+int collect_files(const char* path, struct path_list* out)
+{
+    path_list_add(out, path);
+    return 1;
+}
+#endif
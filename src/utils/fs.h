@@ -1,5 +1,35 @@
 #ifndef FS_H
 #define FS_H
+#include <stddef.h>
+
+// Read-only view of a source file. Regular files are memory-mapped; pipes,
+// character devices and "-" (stdin) are read into a heap buffer instead.
+// The data is not NUL-terminated.
+struct source_file
+{
+    const char *data;
+    size_t length;
+    int mapped;
+};
+
 char *read_file(const char *filename);
+// Returns 1 on success, 0 after printing an error.
+int map_file(const char *filename, struct source_file *out);
+void unmap_file(struct source_file *file);
+
+// Growable list of heap-allocated paths.
+struct path_list
+{
+    char **paths;
+    size_t count;
+    size_t capacity;
+};
+
+void path_list_add(struct path_list *list, const char *path);
+void path_list_free(struct path_list *list);
+// Adds `path` if it names a file, or every regular file under it if it is a
+// directory, in name order. Symbolic links to directories are not followed.
+// Returns 1 on success, 0 after printing an error.
+int collect_files(const char *path, struct path_list *out);
 
-#endif
\ No newline at end of file
+#endif
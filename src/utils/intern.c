@@ -0,0 +1,123 @@
+#include "intern.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS 256
+
+static uint32_t hash_bytes(const char* s, const size_t length)
+{
+    // FNV-1a; names are short, so a simple byte loop is hard to beat.
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void* checked_realloc(void* p, const size_t size)
+{
+    void* q = ts_realloc(p, size);
+    if (!q)
+    {
+        fprintf(stderr, "Failed to allocate memory in intern\n");
+        abort();
+    }
+    return q;
+}
+
+void interner_init(struct interner* in)
+{
+    arena_init(&in->strings, 0);
+    in->entries = NULL;
+    in->count = 0;
+    in->capacity = 0;
+    in->slots = NULL;
+    in->slot_mask = 0;
+}
+
+static void rehash(struct interner* in, const uint32_t slot_count)
+{
+    ts_free(in->slots);
+    in->slots = ts_calloc(slot_count, sizeof(uint32_t));
+    if (!in->slots)
+    {
+        fprintf(stderr, "Failed to allocate memory in intern\n");
+        abort();
+    }
+    in->slot_mask = slot_count - 1;
+    for (uint32_t id = 0; id < in->count; id++)
+    {
+        uint32_t i = in->entries[id].hash & in->slot_mask;
+        while (in->slots[i]) i = (i + 1) & in->slot_mask;
+        in->slots[i] = id + 1;
+    }
+}
+
+uint32_t intern(struct interner* in, const char* s, const size_t length)
+{
+    if (!in->slots) rehash(in, INITIAL_SLOTS);
+
+    const uint32_t hash = hash_bytes(s, length);
+    uint32_t i = hash & in->slot_mask;
+    while (in->slots[i])
+    {
+        const struct intern_entry* e = &in->entries[in->slots[i] - 1];
+        if (e->hash == hash && e->length == length && memcmp(e->str, s, length) == 0)
+            return in->slots[i] - 1;
+        i = (i + 1) & in->slot_mask;
+    }
+
+    if (in->count == in->capacity)
+    {
+        in->capacity = in->capacity ? in->capacity * 2 : 64;
+        in->entries = checked_realloc(in->entries, in->capacity * sizeof(struct intern_entry));
+    }
+    const uint32_t id = in->count++;
+    in->entries[id].str = arena_strndup(&in->strings, s, length);
+    in->entries[id].length = (uint32_t)length;
+    in->entries[id].hash = hash;
+    in->slots[i] = id + 1;
+
+    // Keep the load factor under one half.
+    if (in->count * 2 > in->slot_mask + 1) rehash(in, (in->slot_mask + 1) * 2);
+    return id;
+}
+
+const char* intern_str(struct interner* in, const char* s, const size_t length)
+{
+    const uint32_t id = intern(in, s, length);
+    return in->entries[id].str;
+}
+
+const char* interner_lookup(const struct interner* in, const uint32_t id)
+{
+    return id < in->count ? in->entries[id].str : NULL;
+}
+
+void interner_rebuild(struct interner* in)
+{
+    uint32_t slot_count = INITIAL_SLOTS;
+    while (slot_count / 2 < in->count) slot_count *= 2;
+    for (uint32_t id = 0; id < in->count; id++)
+        in->entries[id].hash = hash_bytes(in->entries[id].str, in->entries[id].length);
+    rehash(in, slot_count);
+}
+
+void interner_reset(struct interner* in)
+{
+    arena_reset(&in->strings);
+    in->count = 0;
+    if (in->slots) memset(in->slots, 0, (in->slot_mask + 1) * sizeof(uint32_t));
+}
+
+void interner_free(struct interner* in)
+{
+    arena_free(&in->strings);
+    ts_free(in->entries);
+    ts_free(in->slots);
+    interner_init(in);
+}
@@ -0,0 +1,38 @@
+#ifndef TS_INTERN_H
+#define TS_INTERN_H
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+// Open-addressing string table. Each distinct byte string is stored once and
+// gets a dense id; the returned pointers stay valid until the interner is
+// reset, so equal names compare equal by pointer or by id.
+
+struct intern_entry
+{
+    const char* str;
+    uint32_t length;
+    uint32_t hash;
+};
+
+struct interner
+{
+    struct arena strings;
+    struct intern_entry* entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* slots; // id + 1, 0 marks an empty slot
+    uint32_t slot_mask;
+};
+
+void interner_init(struct interner* in);
+uint32_t intern(struct interner* in, const char* s, size_t length);
+// Same as intern() but hands back the stored, NUL-terminated copy.
+const char* intern_str(struct interner* in, const char* s, size_t length);
+const char* interner_lookup(const struct interner* in, uint32_t id);
+// Rehashes every entry and rebuilds the lookup table, for an interner whose
+// `entries` and `count` were filled in directly, as by an AST cache load.
+void interner_rebuild(struct interner* in);
+void interner_reset(struct interner* in);
+void interner_free(struct interner* in);
+#endif
@@ -1,4 +1,5 @@
 #include "list.h"
+#include "alloc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -10,7 +11,7 @@ struct list create_list(size_t items_size)
     list.items_size = items_size;
     list.capacity = INITIAL_LIST_CAPACITY;
     list.length = 0;
-    list.items = malloc(list.items_size * INITIAL_LIST_CAPACITY);
+    list.items = ts_malloc(list.items_size * INITIAL_LIST_CAPACITY);
     if (list.items == NULL)
     {
         fprintf(stderr, "Failed to allocate memory in create_list\n");
@@ -25,7 +26,7 @@ void list_add_item(struct list *list, const void *item)
     if (list->length >= list->capacity)
     {
         list->capacity *= 2;
-        void *new_list = realloc(list->items, list->items_size * list->capacity);
+        void *new_list = ts_realloc(list->items, list->items_size * list->capacity);
         if (list->items == NULL)
         {
             fprintf(stderr, "Failed to reallocate memory in add_item\n");
@@ -69,7 +70,7 @@ void list_set_item(const struct list *list, const size_t index, const void *item
 void *list_to_array(const struct list *list, size_t *len)
 {
     size_t total_size = list->items_size * list->length;
-    void *arr = malloc(total_size);
+    void *arr = ts_malloc(total_size);
     if(arr == NULL) {
         fprintf(stderr, "Failed to allocate memory in list_to_array\n");
         abort();
@@ -0,0 +1,219 @@
+#include "pool.h"
+#include "diag.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Indices a thread still owns in the current run. Only the owner grows it
+// (after a steal); everyone else can only take from its end, so once the
+// owner finds it empty and nothing is left to steal, it is done.
+struct pool_range
+{
+    _Alignas(64) pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+};
+
+struct pool_worker
+{
+    struct thread_pool* pool;
+    size_t id;
+    pthread_t thread;
+};
+
+struct thread_pool
+{
+    struct pool_worker* workers;
+    size_t worker_count;
+    struct pool_range* ranges; // one per thread, caller first
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // a new run was posted, or shutdown
+    pthread_cond_t idle; // the last worker left the current run
+
+    // Current run; published under `lock` by bumping `generation`.
+    pool_task task;
+    void* context;
+    const char* source; // the caller's diag_source(), which workers take on
+    size_t busy; // workers still inside the current run
+    unsigned long generation;
+    int shutdown;
+};
+
+static int take(struct pool_range* range, size_t* index)
+{
+    pthread_mutex_lock(&range->lock);
+    const int found = range->begin < range->end;
+    if (found) *index = range->begin++;
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+static int steal(struct thread_pool* pool, const size_t self)
+{
+    const size_t threads = pool->worker_count + 1;
+    for (size_t k = 1; k < threads; k++)
+    {
+        struct pool_range* victim = &pool->ranges[(self + k) % threads];
+        pthread_mutex_lock(&victim->lock);
+        const size_t left = victim->end - victim->begin;
+        if (left == 0)
+        {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        const size_t end = victim->end;
+        victim->end -= (left + 1) / 2;
+        const size_t begin = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+
+        struct pool_range* own = &pool->ranges[self];
+        pthread_mutex_lock(&own->lock);
+        own->begin = begin;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    return 0;
+}
+
+static void drain(struct thread_pool* pool, const size_t self)
+{
+    size_t index;
+    do
+    {
+        while (take(&pool->ranges[self], &index)) pool->task(pool->context, index, self);
+    } while (steal(pool, self));
+}
+
+static void* worker_main(void* arg)
+{
+    const struct pool_worker* worker = arg;
+    struct thread_pool* pool = worker->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->shutdown && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        diag_set_source(pool->source);
+        pthread_mutex_unlock(&pool->lock);
+
+        drain(pool, worker->id);
+        diag_set_source(NULL);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static size_t online_cpus(void)
+{
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+}
+
+static void* checked_alloc(void* p)
+{
+    if (!p)
+    {
+        fprintf(stderr, "Failed to allocate thread pool\n");
+        abort();
+    }
+    return p;
+}
+
+struct thread_pool* thread_pool_create(size_t threads)
+{
+    if (threads == 0) threads = online_cpus();
+
+    struct thread_pool* pool = checked_alloc(calloc(1, sizeof(struct thread_pool)));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    pool->ranges = checked_alloc(aligned_alloc(_Alignof(struct pool_range), threads * sizeof(struct pool_range)));
+    for (size_t i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+        pool->ranges[i].begin = pool->ranges[i].end = 0;
+    }
+
+    if (threads > 1)
+    {
+        pool->workers = checked_alloc(calloc(threads - 1, sizeof(struct pool_worker)));
+        for (size_t i = 0; i < threads - 1; i++)
+        {
+            struct pool_worker* worker = &pool->workers[i];
+            worker->pool = pool;
+            worker->id = i + 1;
+            if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) break;
+            pool->worker_count++;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool* pool)
+{
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->worker_count; i++) pthread_join(pool->workers[i].thread, NULL);
+
+    for (size_t i = 0; i < pool->worker_count + 1; i++) pthread_mutex_destroy(&pool->ranges[i].lock);
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->ranges);
+    free(pool->workers);
+    free(pool);
+}
+
+size_t thread_pool_size(const struct thread_pool* pool)
+{
+    return pool->worker_count + 1;
+}
+
+void thread_pool_run(struct thread_pool* pool, const pool_task task, void* context, const size_t count)
+{
+    if (pool->worker_count == 0 || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++) task(context, i, 0);
+        return;
+    }
+
+    // Workers only touch the ranges after seeing the new generation, and
+    // the previous run has fully drained, so no locks are needed here.
+    const size_t threads = pool->worker_count + 1;
+    for (size_t i = 0; i < threads; i++)
+    {
+        pool->ranges[i].begin = count * i / threads;
+        pool->ranges[i].end = count * (i + 1) / threads;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->source = diag_source();
+    pool->busy = pool->worker_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    drain(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy) pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,25 @@
+#ifndef TS_POOL_H
+#define TS_POOL_H
+#include <stddef.h>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every run, so a pool of size 1 has no workers at all and
+// runs everything inline.
+
+struct thread_pool;
+
+// `worker` is in [0, thread_pool_size()) and identifies the thread running
+// the task (0 is the caller), so tasks can keep per-thread scratch state.
+typedef void (*pool_task)(void* context, size_t index, size_t worker);
+
+// `threads` counts the caller; 0 means one per online CPU.
+struct thread_pool* thread_pool_create(size_t threads);
+void thread_pool_destroy(struct thread_pool* pool);
+size_t thread_pool_size(const struct thread_pool* pool);
+// Calls task(context, i, worker) for every i in [0, count) and returns once
+// all of them have finished. Each thread starts on its own contiguous slice
+// of the indices and, when that runs dry, steals half of what another
+// thread has left, so uneven tasks balance themselves. The workers report
+// diagnostics under the caller's diag_source() (utils/diag.h) meanwhile.
+void thread_pool_run(struct thread_pool* pool, pool_task task, void* context, size_t count);
+#endif
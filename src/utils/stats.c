@@ -0,0 +1,111 @@
+#include "stats.h"
+#include "alloc.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char* const phase_names[STATS_PHASE_COUNT] = {
+    "read", "cache", "lex", "parse", "fold", "run", "print",
+};
+
+static int enabled;
+static struct ts_allocator wrapped;
+static double started[STATS_PHASE_COUNT];
+static double seconds[STATS_PHASE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+// The lexer and parser allocate from pool threads.
+static _Atomic uint64_t allocations;
+static _Atomic uint64_t allocated_bytes;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void* counting_reallocate(void* context, void* pointer, const size_t size)
+{
+    (void)context;
+    if (size)
+    {
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&allocated_bytes, size, memory_order_relaxed);
+    }
+    if (wrapped.reallocate) return wrapped.reallocate(wrapped.context, pointer, size);
+    if (size) return realloc(pointer, size);
+    free(pointer);
+    return NULL;
+}
+
+void stats_enable(void)
+{
+    if (!enabled)
+    {
+        wrapped = ts_get_allocator();
+        const struct ts_allocator counting = {.reallocate = counting_reallocate};
+        ts_set_allocator(&counting);
+    }
+    enabled = 1;
+    memset(started, 0, sizeof(started));
+    memset(seconds, 0, sizeof(seconds));
+    memset(counters, 0, sizeof(counters));
+    atomic_store(&allocations, 0);
+    atomic_store(&allocated_bytes, 0);
+}
+
+void stats_disable(void)
+{
+    if (!enabled) return;
+    ts_set_allocator(wrapped.reallocate ? &wrapped : NULL);
+    enabled = 0;
+}
+
+int stats_enabled(void)
+{
+    return enabled;
+}
+
+void stats_start(const enum stats_phase phase)
+{
+    if (enabled) started[phase] = now();
+}
+
+void stats_stop(const enum stats_phase phase)
+{
+    if (enabled) seconds[phase] += now() - started[phase];
+}
+
+void stats_add(const enum stats_counter counter, const uint64_t amount)
+{
+    if (enabled) counters[counter] += amount;
+}
+
+void stats_get(struct ts_stats* out)
+{
+    memcpy(out->seconds, seconds, sizeof(seconds));
+    memcpy(out->counters, counters, sizeof(counters));
+    out->allocations = atomic_load(&allocations);
+    out->allocated_bytes = atomic_load(&allocated_bytes);
+}
+
+void stats_print(const struct ts_stats* stats, FILE* out)
+{
+    double total = 0;
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) total += stats->seconds[i];
+    fprintf(out, "%-8s %10s %7s\n", "phase", "ms", "share");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        if (stats->seconds[i] == 0) continue;
+        fprintf(out, "%-8s %10.3f %6.1f%%\n", phase_names[i], stats->seconds[i] * 1e3,
+                total > 0 ? stats->seconds[i] / total * 100 : 0);
+    }
+    fprintf(out, "%-8s %10.3f\n", "total", total * 1e3);
+    fprintf(out, "source   %llu bytes\n", (unsigned long long)stats->counters[STATS_SOURCE_BYTES]);
+    fprintf(out, "tokens   %llu\n", (unsigned long long)stats->counters[STATS_TOKENS]);
+    fprintf(out, "nodes    %llu\n", (unsigned long long)stats->counters[STATS_NODES]);
+    fprintf(out, "allocs   %llu calls, %llu bytes\n", (unsigned long long)stats->allocations,
+            (unsigned long long)stats->allocated_bytes);
+}
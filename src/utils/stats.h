@@ -0,0 +1,57 @@
+#ifndef TS_STATS_H
+#define TS_STATS_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Opt-in instrumentation: wall-clock time per phase, plus counters for the
+// work done and for every front-end allocation (see alloc.h). Nothing is
+// recorded until stats_enable() is called. Hosts bracket their phases with
+// stats_start() / stats_stop(), report what they processed with stats_add(),
+// and read everything back with stats_get().
+
+enum stats_phase
+{
+    STATS_READ, // reading or mapping the source
+    STATS_CACHE, // loading or saving the AST cache
+    STATS_LEX, // parse_text
+    STATS_PARSE, // parse
+    STATS_FOLD, // fold_constants
+    STATS_RUN, // compiling and running
+    STATS_PRINT, // print_ast
+    STATS_PHASE_COUNT,
+};
+
+enum stats_counter
+{
+    STATS_SOURCE_BYTES,
+    STATS_TOKENS,
+    STATS_NODES,
+    STATS_COUNTER_COUNT,
+};
+
+struct ts_stats
+{
+    double seconds[STATS_PHASE_COUNT];
+    uint64_t counters[STATS_COUNTER_COUNT];
+    // Calls that returned memory (malloc, calloc and realloc alike), and
+    // the bytes they asked for. A realloc counts its whole new size.
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+};
+
+// Clears everything and starts recording. The counting allocator wraps the
+// allocator installed at this point, so install a custom one first.
+// Must not be called while other threads are allocating.
+void stats_enable(void);
+// Stops recording and puts the wrapped allocator back.
+void stats_disable(void);
+int stats_enabled(void);
+
+// Phases may repeat; their times add up.
+void stats_start(enum stats_phase phase);
+void stats_stop(enum stats_phase phase);
+void stats_add(enum stats_counter counter, uint64_t amount);
+void stats_get(struct ts_stats* out);
+void stats_print(const struct ts_stats* stats, FILE* out);
+#endif
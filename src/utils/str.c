@@ -3,11 +3,12 @@
 //
 
 #include "str.h"
+#include "alloc.h"
 #include <stdlib.h>
 #include <string.h>
 
 char* ts_strndup(const char* s, size_t n) {
-    char* p = malloc(n + 1);
+    char* p = ts_malloc(n + 1);
     if (!p) return NULL;
     memcpy(p, s, n);
     p[n] = '\0';
@@ -0,0 +1,71 @@
+#ifndef TS_BYTECODE_H
+#define TS_BYTECODE_H
+#include <stdint.h>
+#include "value.h"
+
+// Register-based instruction set. Every instruction is one 32-bit word:
+//   op:8 | a:8 | b:8 | c:8
+// Instructions marked [x] are followed by one extra word holding a 32-bit
+// operand (constant index, global or local slot, or absolute jump target).
+enum opcode
+{
+    OP_LOADK, // R[a] = K[x]                          [x]
+    OP_LOADBOOL, // R[a] = b != 0
+    OP_LOADNIL, // R[a] = nil
+    OP_MOVE, // R[a] = R[b]
+    OP_GETGLOBAL, // R[a] = G[x]                      [x]
+    OP_SETGLOBAL, // G[x] = R[a]                      [x]
+    OP_GETLOCAL, // R[a] = L[x]                       [x]
+    OP_SETLOCAL, // L[x] = R[a]                       [x]
+    OP_ADD, // R[a] = R[b] + R[c]
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_EQ, // R[a] = R[b] == R[c]
+    OP_NEQ,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_NEG, // R[a] = -R[b]
+    OP_NOT, // R[a] = !R[b]
+    OP_BOOL, // R[a] = truthy(R[b])
+    OP_JMP, // pc = x                                 [x]
+    OP_JMPIF, // if truthy(R[a]) pc = x               [x]
+    OP_JMPIFNOT, // if !truthy(R[a]) pc = x           [x]
+    OP_NEWLIST, // R[a] = new list with capacity x    [x]
+    OP_APPEND, // append R[b] .. R[b + c - 1] to R[a]
+    OP_RETURN, // return R[a]
+    OP_COUNT
+};
+
+#define INSTR(op, a, b, c) ((uint32_t)(op) | (uint32_t)(a) << 8 | (uint32_t)(b) << 16 | (uint32_t)(c) << 24)
+#define INSTR_OP(i) ((i) & 0xFF)
+#define INSTR_A(i) (((i) >> 8) & 0xFF)
+#define INSTR_B(i) (((i) >> 16) & 0xFF)
+#define INSTR_C(i) ((i) >> 24)
+
+#define VM_MAX_REGISTERS 256
+
+struct chunk
+{
+    uint32_t* code;
+    uint32_t count;
+    uint32_t capacity;
+
+    struct value* constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+
+    uint32_t global_count; // globals are addressed by interned name id
+    uint32_t local_count; // locals are the slots of the script's variables
+    uint32_t register_count;
+};
+
+void chunk_init(struct chunk* chunk);
+void chunk_free(struct chunk* chunk);
+// Empties the chunk but keeps its buffers for the next compile.
+void chunk_reset(struct chunk* chunk);
+uint32_t chunk_emit(struct chunk* chunk, uint32_t word);
+uint32_t chunk_add_constant(struct chunk* chunk, struct value value);
+#endif
@@ -0,0 +1,54 @@
+#include "bytecode.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void* grow(void* items, uint32_t* capacity, const size_t item_size)
+{
+    *capacity = *capacity ? *capacity * 2 : 64;
+    void* grown = ts_realloc(items, (size_t)*capacity * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Failed to allocate memory for bytecode\n");
+        abort();
+    }
+    return grown;
+}
+
+void chunk_init(struct chunk* chunk)
+{
+    memset(chunk, 0, sizeof(*chunk));
+}
+
+void chunk_free(struct chunk* chunk)
+{
+    ts_free(chunk->code);
+    ts_free(chunk->constants);
+    chunk_init(chunk);
+}
+
+void chunk_reset(struct chunk* chunk)
+{
+    chunk->count = 0;
+    chunk->constant_count = 0;
+    chunk->global_count = 0;
+    chunk->local_count = 0;
+    chunk->register_count = 0;
+}
+
+uint32_t chunk_emit(struct chunk* chunk, const uint32_t word)
+{
+    if (chunk->count == chunk->capacity)
+        chunk->code = grow(chunk->code, &chunk->capacity, sizeof(uint32_t));
+    chunk->code[chunk->count] = word;
+    return chunk->count++;
+}
+
+uint32_t chunk_add_constant(struct chunk* chunk, const struct value value)
+{
+    if (chunk->constant_count == chunk->constant_capacity)
+        chunk->constants = grow(chunk->constants, &chunk->constant_capacity, sizeof(struct value));
+    chunk->constants[chunk->constant_count] = value;
+    return chunk->constant_count++;
+}
@@ -0,0 +1,650 @@
+#include "columns.h"
+#include "parser/ast.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum column_op
+{
+    CI_INPUT, // V[dst] = column a, used in place
+    CI_LOAD_INT32, // V[dst] = (double)column a
+    CI_LOAD_INT64,
+    // number, number -> number, in every operand shape
+    CI_ADD,
+    CI_SUB,
+    CI_MUL,
+    CI_DIV,
+    // number, number -> bool, in every operand shape
+    CI_LT,
+    CI_LE,
+    CI_GT,
+    CI_GE,
+    CI_EQ,
+    CI_NE,
+    // bool, bool -> bool, vectors only
+    CI_AND,
+    CI_OR,
+    CI_BOOL_EQ,
+    CI_BOOL_NE,
+    // one vector operand
+    CI_NOT, // bool -> bool
+    CI_TRUTHY, // number -> bool
+    CI_NEG, // number -> number
+};
+
+enum column_shape
+{
+    SHAPE_VV, // V[a] op V[b]
+    SHAPE_VS, // V[a] op scalar
+    SHAPE_SV, // scalar op V[b]
+};
+
+struct column_instr
+{
+    uint8_t op; // enum column_op
+    uint8_t shape; // enum column_shape
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+    double scalar;
+};
+
+// ---------------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------------
+
+// One loop per operator and shape. Operands never alias the destination
+// (see alloc_vector), so every loop is a straight SIMD candidate.
+typedef void (*binary_kernel)(void* restrict out, const double* restrict a, const double* restrict b, size_t n);
+typedef void (*scalar_right_kernel)(void* restrict out, const double* restrict a, double y, size_t n);
+typedef void (*scalar_left_kernel)(void* restrict out, double x, const double* restrict b, size_t n);
+
+#define NUMERIC_KERNELS(name, T, expr) \
+    static void name##_vv(void* restrict out, const double* restrict a, const double* restrict b, const size_t n) \
+    { \
+        T* restrict d = out; \
+        for (size_t i = 0; i < n; i++) \
+        { \
+            const double x = a[i], y = b[i]; \
+            d[i] = (expr); \
+        } \
+    } \
+    static void name##_vs(void* restrict out, const double* restrict a, const double y, const size_t n) \
+    { \
+        T* restrict d = out; \
+        for (size_t i = 0; i < n; i++) \
+        { \
+            const double x = a[i]; \
+            d[i] = (expr); \
+        } \
+    } \
+    static void name##_sv(void* restrict out, const double x, const double* restrict b, const size_t n) \
+    { \
+        T* restrict d = out; \
+        for (size_t i = 0; i < n; i++) \
+        { \
+            const double y = b[i]; \
+            d[i] = (expr); \
+        } \
+    }
+
+NUMERIC_KERNELS(add, double, x + y)
+NUMERIC_KERNELS(sub, double, x - y)
+NUMERIC_KERNELS(mul, double, x * y)
+NUMERIC_KERNELS(div, double, x / y)
+NUMERIC_KERNELS(lt, uint8_t, x < y)
+NUMERIC_KERNELS(le, uint8_t, x <= y)
+NUMERIC_KERNELS(gt, uint8_t, x > y)
+NUMERIC_KERNELS(ge, uint8_t, x >= y)
+NUMERIC_KERNELS(eq, uint8_t, x == y)
+NUMERIC_KERNELS(ne, uint8_t, x != y)
+
+#undef NUMERIC_KERNELS
+
+// Indexed by op - CI_ADD.
+static const binary_kernel numeric_vv[] = {add_vv, sub_vv, mul_vv, div_vv, lt_vv, le_vv, gt_vv, ge_vv, eq_vv, ne_vv};
+static const scalar_right_kernel numeric_vs[] = {
+    add_vs, sub_vs, mul_vs, div_vs, lt_vs, le_vs, gt_vs, ge_vs, eq_vs, ne_vs,
+};
+static const scalar_left_kernel numeric_sv[] = {add_sv, sub_sv, mul_sv, div_sv, lt_sv, le_sv, gt_sv, ge_sv, eq_sv, ne_sv};
+
+static void logic_kernel(const enum column_op op, uint8_t* restrict d, const uint8_t* restrict a,
+                         const uint8_t* restrict b, const size_t n)
+{
+    switch (op)
+    {
+    case CI_AND:
+        for (size_t i = 0; i < n; i++) d[i] = a[i] & b[i];
+        break;
+    case CI_OR:
+        for (size_t i = 0; i < n; i++) d[i] = a[i] | b[i];
+        break;
+    case CI_BOOL_EQ:
+        for (size_t i = 0; i < n; i++) d[i] = a[i] == b[i];
+        break;
+    case CI_BOOL_NE:
+        for (size_t i = 0; i < n; i++) d[i] = a[i] != b[i];
+        break;
+    default:
+        for (size_t i = 0; i < n; i++) d[i] = !a[i];
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Compiling
+// ---------------------------------------------------------------------------
+
+enum operand_kind
+{
+    OPERAND_CONSTANT,
+    OPERAND_VECTOR,
+};
+
+// What a node evaluates to: a constant, or a vector of results. Vectors of
+// input columns are shared; every other vector is used by exactly one
+// parent, which releases it.
+struct operand
+{
+    uint8_t kind; // enum operand_kind
+    uint8_t boolean; // 1 for booleans, 0 for numbers
+    uint8_t shared;
+    uint32_t vector;
+    double value;
+};
+
+struct column_compiler
+{
+    const struct ast* ast;
+    const struct column* columns;
+    size_t column_count;
+    struct column_program* program;
+    struct operand* inputs; // per column, kind is OPERAND_CONSTANT until used
+    uint32_t* free_vectors;
+    uint32_t free_count;
+    int failed;
+};
+
+static void* checked_realloc(void* p, const size_t size)
+{
+    void* q = ts_realloc(p, size);
+    if (!q)
+    {
+        fprintf(stderr, "Failed to allocate memory in columns\n");
+        abort();
+    }
+    return q;
+}
+
+static void fail(struct column_compiler* c, const char* message, const char* detail)
+{
+    if (!c->failed) fprintf(stderr, "[columns] %s%s\n", message, detail ? detail : "");
+    c->failed = 1;
+}
+
+// A fresh vector is taken before the operands are released, so an
+// instruction never writes over its own inputs.
+static uint32_t alloc_vector(struct column_compiler* c)
+{
+    if (c->free_count) return c->free_vectors[--c->free_count];
+    const uint32_t vector = c->program->vector_count++;
+    c->free_vectors = checked_realloc(c->free_vectors, c->program->vector_count * sizeof(uint32_t));
+    return vector;
+}
+
+static void release(struct column_compiler* c, const struct operand* operand)
+{
+    if (operand->kind == OPERAND_VECTOR && !operand->shared) c->free_vectors[c->free_count++] = operand->vector;
+}
+
+static void emit(struct column_compiler* c, const struct column_instr instr)
+{
+    struct column_program* program = c->program;
+    if (program->count == program->capacity)
+    {
+        program->capacity = program->capacity ? program->capacity * 2 : 16;
+        program->code = checked_realloc(program->code, program->capacity * sizeof(struct column_instr));
+    }
+    program->code[program->count++] = instr;
+}
+
+static struct operand constant(const double value, const int boolean)
+{
+    return (struct operand){.kind = OPERAND_CONSTANT, .boolean = (uint8_t)boolean, .value = value};
+}
+
+// Emits `op` over the operands into a new vector and releases them.
+static struct operand emit_op(struct column_compiler* c, const enum column_op op, const int boolean,
+                              const struct operand* a, const struct operand* b)
+{
+    struct column_instr instr = {.op = (uint8_t)op, .shape = SHAPE_VV};
+    instr.dst = alloc_vector(c);
+    if (a->kind == OPERAND_VECTOR) instr.a = a->vector;
+    else
+    {
+        instr.shape = SHAPE_SV;
+        instr.scalar = a->value;
+    }
+    if (b && b->kind == OPERAND_VECTOR) instr.b = b->vector;
+    else if (b)
+    {
+        instr.shape = SHAPE_VS;
+        instr.scalar = b->value;
+    }
+    emit(c, instr);
+    release(c, a);
+    if (b) release(c, b);
+    return (struct operand){.kind = OPERAND_VECTOR, .boolean = (uint8_t)boolean, .vector = instr.dst};
+}
+
+static struct operand column_input(struct column_compiler* c, const uint32_t name)
+{
+    const char* text = interner_lookup(&c->ast->names, name);
+    size_t index = 0;
+    while (index < c->column_count && strcmp(c->columns[index].name, text) != 0) index++;
+    if (index == c->column_count)
+    {
+        fail(c, "Unbound identifier ", text);
+        return constant(0, 0);
+    }
+    struct operand* input = &c->inputs[index];
+    if (input->kind == OPERAND_VECTOR) return *input;
+
+    const enum column_type type = c->columns[index].type;
+    const enum column_op op = type == COLUMN_INT32 ? CI_LOAD_INT32 : type == COLUMN_INT64 ? CI_LOAD_INT64 : CI_INPUT;
+    struct column_instr instr = {.op = (uint8_t)op, .dst = alloc_vector(c), .a = (uint32_t)index};
+    emit(c, instr);
+    *input = (struct operand){
+        .kind = OPERAND_VECTOR, .boolean = type == COLUMN_BOOL, .shared = 1, .vector = instr.dst,
+    };
+    return *input;
+}
+
+static struct operand to_bool(struct column_compiler* c, const struct operand* operand)
+{
+    if (operand->boolean) return *operand;
+    if (operand->kind == OPERAND_CONSTANT) return constant(operand->value != 0, 1);
+    return emit_op(c, CI_TRUTHY, 1, operand, NULL);
+}
+
+static double fold(const enum column_op op, const double x, const double y)
+{
+    switch (op)
+    {
+    case CI_ADD: return x + y;
+    case CI_SUB: return x - y;
+    case CI_MUL: return x * y;
+    case CI_DIV: return x / y;
+    case CI_LT: return x < y;
+    case CI_LE: return x <= y;
+    case CI_GT: return x > y;
+    case CI_GE: return x >= y;
+    case CI_EQ:
+    case CI_BOOL_EQ: return x == y;
+    case CI_NE:
+    case CI_BOOL_NE: return x != y;
+    case CI_AND: return x != 0 && y != 0;
+    case CI_OR: return x != 0 || y != 0;
+    default: return 0;
+    }
+}
+
+static enum column_op numeric_op(const enum token_type op)
+{
+    switch (op)
+    {
+    case TOKEN_PLUS: return CI_ADD;
+    case TOKEN_MINUS: return CI_SUB;
+    case TOKEN_STAR: return CI_MUL;
+    case TOKEN_SLASH: return CI_DIV;
+    case TOKEN_LT: return CI_LT;
+    case TOKEN_LE: return CI_LE;
+    case TOKEN_GT: return CI_GT;
+    case TOKEN_GE: return CI_GE;
+    case TOKEN_EQ: return CI_EQ;
+    default: return CI_NE;
+    }
+}
+
+// && and || with one constant side, and boolean == and != with one, reduce
+// to the other side, its negation, or a constant.
+static struct operand logic(struct column_compiler* c, const enum column_op op, const struct operand* a,
+                            const struct operand* b)
+{
+    if (a->kind == OPERAND_CONSTANT && b->kind == OPERAND_CONSTANT) return constant(fold(op, a->value, b->value), 1);
+    if (a->kind == OPERAND_VECTOR && b->kind == OPERAND_VECTOR) return emit_op(c, op, 1, a, b);
+
+    const struct operand* known = a->kind == OPERAND_CONSTANT ? a : b;
+    const struct operand* other = known == a ? b : a;
+    const int value = known->value != 0;
+    switch (op)
+    {
+    case CI_AND: return value ? *other : constant(0, 1);
+    case CI_OR: return value ? constant(1, 1) : *other;
+    case CI_BOOL_EQ: return value ? *other : emit_op(c, CI_NOT, 1, other, NULL);
+    default: return value ? emit_op(c, CI_NOT, 1, other, NULL) : *other;
+    }
+}
+
+static struct operand binary(struct column_compiler* c, const struct ast_node* node, const struct operand* l,
+                             const struct operand* r)
+{
+    const enum token_type op = node->op;
+    if (op == TOKEN_AND || op == TOKEN_OR)
+    {
+        const struct operand a = to_bool(c, l);
+        const struct operand b = to_bool(c, r);
+        return logic(c, op == TOKEN_AND ? CI_AND : CI_OR, &a, &b);
+    }
+    if (op == TOKEN_EQ || op == TOKEN_NEQ)
+    {
+        // Values of different types are never equal.
+        if (l->boolean != r->boolean)
+        {
+            release(c, l);
+            release(c, r);
+            return constant(op == TOKEN_NEQ, 1);
+        }
+        if (l->boolean) return logic(c, op == TOKEN_EQ ? CI_BOOL_EQ : CI_BOOL_NE, l, r);
+    }
+    else if (l->boolean || r->boolean)
+    {
+        fail(c, "Operands must be numbers", NULL);
+        return constant(0, 0);
+    }
+
+    const enum column_op cop = numeric_op(op);
+    const int boolean = cop >= CI_LT;
+    if (l->kind == OPERAND_CONSTANT && r->kind == OPERAND_CONSTANT)
+        return constant(fold(cop, l->value, r->value), boolean);
+    return emit_op(c, cop, boolean, l, r);
+}
+
+static struct operand unary(struct column_compiler* c, const struct ast_node* node, const struct operand* operand)
+{
+    if (node->op == TOKEN_NOT)
+    {
+        const struct operand b = to_bool(c, operand);
+        if (b.kind == OPERAND_CONSTANT) return constant(b.value == 0, 1);
+        return emit_op(c, CI_NOT, 1, &b, NULL);
+    }
+    if (operand->boolean)
+    {
+        fail(c, "Operands must be numbers", NULL);
+        return constant(0, 0);
+    }
+    if (operand->kind == OPERAND_CONSTANT) return constant(-operand->value, 0);
+    return emit_op(c, CI_NEG, 0, operand, NULL);
+}
+
+// The expression statement a program consists of, or the node itself.
+static uint32_t expression_root(const struct ast* ast, const uint32_t node)
+{
+    const struct ast_node* n = &ast->nodes[node];
+    if (n->type != AST_PROGRAM || n->block.count != 1) return node;
+    const uint32_t statement = ast->children[n->block.first];
+    switch (ast->nodes[statement].type)
+    {
+    case AST_ASSIGNMENT:
+    case AST_DECLARATION:
+    case AST_IF:
+    case AST_BLOCK:
+        return node;
+    default:
+        return statement;
+    }
+}
+
+int column_compile(const struct ast* ast, uint32_t node, const struct column* columns, const size_t column_count,
+                   struct column_program* program)
+{
+    memset(program, 0, sizeof(*program));
+    node = expression_root(ast, node);
+    struct column_compiler c = {.ast = ast, .columns = columns, .column_count = column_count, .program = program};
+    c.inputs = ts_calloc(column_count ? column_count : 1, sizeof(struct operand));
+    // Children sit below their parent, so marking the subtree top-down and
+    // then visiting it bottom-up sees every operand before its user.
+    uint8_t* live = ts_calloc((size_t)node + 1, 1);
+    struct operand* values = ts_calloc((size_t)node + 1, sizeof(struct operand));
+    if (!c.inputs || !live || !values)
+    {
+        fprintf(stderr, "Failed to allocate memory in columns\n");
+        abort();
+    }
+
+    live[node] = 1;
+    for (uint32_t i = node; i > 0 && !c.failed; i--)
+    {
+        if (!live[i]) continue;
+        const struct ast_node* n = &ast->nodes[i];
+        switch (n->type)
+        {
+        case AST_UNARY:
+            live[n->unary.operand] = 1;
+            break;
+        case AST_BINARY:
+            live[n->binary.left] = 1;
+            live[n->binary.right] = 1;
+            break;
+        case AST_NUMBER:
+        case AST_BOOLEAN:
+        case AST_IDENT:
+            break;
+        case AST_LIST:
+            fail(&c, "Lists are not supported in column expressions", NULL);
+            break;
+        default:
+            fail(&c, "Expected an expression", NULL);
+            break;
+        }
+    }
+
+    for (uint32_t i = 1; i <= node && !c.failed; i++)
+    {
+        if (!live[i]) continue;
+        const struct ast_node* n = &ast->nodes[i];
+        switch (n->type)
+        {
+        case AST_NUMBER:
+            values[i] = constant(ast_number_value(ast, i), 0);
+            break;
+        case AST_BOOLEAN:
+            values[i] = constant(n->boolean.value != 0, 1);
+            break;
+        case AST_IDENT:
+            values[i] = column_input(&c, n->ident.name);
+            break;
+        case AST_UNARY:
+            values[i] = unary(&c, n, &values[n->unary.operand]);
+            break;
+        default:
+            values[i] = binary(&c, n, &values[n->binary.left], &values[n->binary.right]);
+            break;
+        }
+    }
+
+    if (!c.failed)
+    {
+        const struct operand* result = &values[node];
+        program->result_type = result->boolean ? COLUMN_RESULT_BOOL : COLUMN_RESULT_NUMBER;
+        program->result_constant = result->kind == OPERAND_CONSTANT;
+        program->constant = result->value;
+        program->result = result->vector;
+    }
+    ts_free(values);
+    ts_free(live);
+    ts_free(c.inputs);
+    ts_free(c.free_vectors);
+    if (c.failed) column_program_free(program);
+    return !c.failed;
+}
+
+void column_program_free(struct column_program* program)
+{
+    ts_free(program->code);
+    memset(program, 0, sizeof(*program));
+}
+
+// ---------------------------------------------------------------------------
+// Evaluating
+// ---------------------------------------------------------------------------
+
+// Scratch for one call: a COLUMN_BATCH-double buffer per vector, and where
+// each vector's data is for the current batch.
+struct column_frame
+{
+    double* storage;
+    const void** vectors;
+};
+
+static void frame_init(struct column_frame* frame, const struct column_program* program)
+{
+    const size_t count = program->vector_count ? program->vector_count : 1;
+    frame->storage = ts_malloc(count * COLUMN_BATCH * sizeof(double));
+    frame->vectors = ts_malloc(count * sizeof(void*));
+    if (!frame->storage || !frame->vectors)
+    {
+        fprintf(stderr, "Failed to allocate memory in columns\n");
+        abort();
+    }
+    for (size_t i = 0; i < count; i++) frame->vectors[i] = frame->storage + i * COLUMN_BATCH;
+}
+
+static void frame_free(struct column_frame* frame)
+{
+    ts_free(frame->storage);
+    ts_free(frame->vectors);
+}
+
+// Runs the program over rows [first, first + n) and returns the result
+// vector (NULL for a constant result).
+static const void* run_batch(const struct column_program* program, const struct column* columns,
+                             const struct column_frame* frame, const size_t first, const size_t n)
+{
+    const void** V = frame->vectors;
+    for (uint32_t k = 0; k < program->count; k++)
+    {
+        const struct column_instr* in = &program->code[k];
+        void* dst = frame->storage + (size_t)in->dst * COLUMN_BATCH;
+        switch (in->op)
+        {
+        case CI_INPUT:
+        {
+            const struct column* column = &columns[in->a];
+            const size_t size = column->type == COLUMN_BOOL ? sizeof(uint8_t) : sizeof(double);
+            V[in->dst] = (const char*)column->data + first * size;
+            break;
+        }
+        case CI_LOAD_INT32:
+        {
+            const int32_t* restrict from = (const int32_t*)columns[in->a].data + first;
+            double* restrict to = dst;
+            for (size_t i = 0; i < n; i++) to[i] = (double)from[i];
+            break;
+        }
+        case CI_LOAD_INT64:
+        {
+            const int64_t* restrict from = (const int64_t*)columns[in->a].data + first;
+            double* restrict to = dst;
+            for (size_t i = 0; i < n; i++) to[i] = (double)from[i];
+            break;
+        }
+        case CI_AND:
+        case CI_OR:
+        case CI_BOOL_EQ:
+        case CI_BOOL_NE:
+            logic_kernel(in->op, dst, V[in->a], V[in->b], n);
+            break;
+        case CI_NOT:
+            logic_kernel(CI_NOT, dst, V[in->a], NULL, n);
+            break;
+        case CI_TRUTHY:
+            ne_vs(dst, V[in->a], 0, n);
+            break;
+        case CI_NEG:
+        {
+            const double* restrict from = V[in->a];
+            double* restrict to = dst;
+            for (size_t i = 0; i < n; i++) to[i] = -from[i];
+            break;
+        }
+        default:
+        {
+            const int index = in->op - CI_ADD;
+            if (in->shape == SHAPE_VV) numeric_vv[index](dst, V[in->a], V[in->b], n);
+            else if (in->shape == SHAPE_VS) numeric_vs[index](dst, V[in->a], in->scalar, n);
+            else numeric_sv[index](dst, in->scalar, V[in->b], n);
+            break;
+        }
+        }
+        if (in->op != CI_INPUT) V[in->dst] = dst;
+    }
+    return program->result_constant ? NULL : V[program->result];
+}
+
+void column_eval(const struct column_program* program, const struct column* columns, const size_t rows, void* out)
+{
+    const int boolean = program->result_type == COLUMN_RESULT_BOOL;
+    const size_t size = boolean ? sizeof(uint8_t) : sizeof(double);
+    if (program->result_constant)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            if (boolean) ((uint8_t*)out)[i] = program->constant != 0;
+            else ((double*)out)[i] = program->constant;
+        }
+        return;
+    }
+
+    struct column_frame frame;
+    frame_init(&frame, program);
+    for (size_t first = 0; first < rows; first += COLUMN_BATCH)
+    {
+        const size_t n = rows - first < COLUMN_BATCH ? rows - first : COLUMN_BATCH;
+        const void* result = run_batch(program, columns, &frame, first, n);
+        memcpy((char*)out + first * size, result, n * size);
+    }
+    frame_free(&frame);
+}
+
+size_t column_select(const struct column_program* program, const struct column* columns, const size_t rows,
+                     uint32_t* selection)
+{
+    size_t count = 0;
+    if (program->result_constant)
+    {
+        if (program->constant != 0)
+            for (size_t i = 0; i < rows; i++) selection[count++] = (uint32_t)i;
+        return count;
+    }
+
+    struct column_frame frame;
+    frame_init(&frame, program);
+    uint8_t* truthy = ts_malloc(COLUMN_BATCH);
+    if (!truthy)
+    {
+        fprintf(stderr, "Failed to allocate memory in columns\n");
+        abort();
+    }
+    for (size_t first = 0; first < rows; first += COLUMN_BATCH)
+    {
+        const size_t n = rows - first < COLUMN_BATCH ? rows - first : COLUMN_BATCH;
+        const void* result = run_batch(program, columns, &frame, first, n);
+        const uint8_t* flags = result;
+        if (program->result_type == COLUMN_RESULT_NUMBER)
+        {
+            ne_vs(truthy, result, 0, n);
+            flags = truthy;
+        }
+        // Branch-free compaction: always write, advance only on a hit.
+        for (size_t i = 0; i < n; i++)
+        {
+            selection[count] = (uint32_t)(first + i);
+            count += flags[i];
+        }
+    }
+    ts_free(truthy);
+    frame_free(&frame);
+    return count;
+}
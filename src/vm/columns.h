@@ -0,0 +1,77 @@
+#ifndef TS_COLUMNS_H
+#define TS_COLUMNS_H
+#include <stddef.h>
+#include <stdint.h>
+
+struct ast;
+
+// Columnar evaluation of one expression over many rows, for filters and
+// derived fields over host data.
+//
+// column_compile() binds every identifier in the expression to a host column
+// by name, checks operand types once for the whole column instead of once
+// per row, and lowers the tree to a short list of vector instructions.
+// column_eval() then runs each instruction over COLUMN_BATCH rows at a time
+// with a plain loop per operator and operand shape, which the compiler
+// turns into SIMD code.
+//
+// Results match the VM: numbers are doubles, && and || give booleans of
+// the operands' truthiness, comparing a number with a boolean for equality
+// is false. Both sides of && and || are evaluated for every row, which is
+// unobservable since expressions cannot fail once they have type-checked.
+// The flip side is that a type error is reported even where the VM would
+// have skipped over it, as in `false && -true`. Lists are not supported.
+
+#define COLUMN_BATCH 1024
+
+enum column_type
+{
+    COLUMN_DOUBLE, // const double*
+    COLUMN_INT32, // const int32_t*, read as double
+    COLUMN_INT64, // const int64_t*, read as double
+    COLUMN_BOOL, // const uint8_t*, 0 or 1
+};
+
+struct column
+{
+    const char* name;
+    enum column_type type;
+    const void* data; // one value per row
+};
+
+enum column_result
+{
+    COLUMN_RESULT_NUMBER, // column_eval writes doubles
+    COLUMN_RESULT_BOOL, // column_eval writes uint8_t 0 or 1
+};
+
+struct column_instr;
+
+struct column_program
+{
+    struct column_instr* code;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t vector_count; // scratch vectors of COLUMN_BATCH doubles
+    uint32_t result; // vector holding the result, unless it is constant
+    int result_constant;
+    double constant;
+    enum column_result result_type;
+};
+
+// Compiles the expression at `node`, or the single expression statement of
+// the program at `node`, against the names and types in `columns`. Returns
+// 1 on success, 0 after printing an error.
+int column_compile(const struct ast* ast, uint32_t node, const struct column* columns, size_t column_count,
+                   struct column_program* program);
+void column_program_free(struct column_program* program);
+
+// `columns` must have the names, order and types it was compiled against;
+// only the data pointers may change. Writes `rows` results to `out`, as
+// doubles or as uint8_t depending on program->result_type.
+void column_eval(const struct column_program* program, const struct column* columns, size_t rows, void* out);
+// Writes the indices of the rows whose result is truthy to `selection`, in
+// ascending order, and returns how many there are.
+size_t column_select(const struct column_program* program, const struct column* columns, size_t rows,
+                     uint32_t* selection);
+#endif
@@ -0,0 +1,384 @@
+#include "compiler.h"
+#include "parser/ast.h"
+#include "passes/resolve.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Elements of a list literal are evaluated into consecutive registers and
+// appended this many at a time.
+#define LIST_BATCH 32
+
+// A block whose variables are in scope: its slots are the locals
+// [base, base + slot_count), and `declared` of them have been declared.
+struct compile_scope
+{
+    uint32_t base;
+    uint32_t slot_count;
+    uint32_t declared;
+};
+
+struct compiler
+{
+    const struct ast* ast;
+    struct chunk* chunk;
+    uint32_t next_reg;
+    int failed;
+
+    struct compile_frame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+
+    struct compile_scope* scopes;
+    uint32_t scope_count;
+    uint32_t scope_capacity;
+};
+
+static void emit(struct compiler* c, const uint32_t word)
+{
+    chunk_emit(c->chunk, word);
+}
+
+static void emit_x(struct compiler* c, const enum opcode op, const uint32_t a, const uint32_t x)
+{
+    chunk_emit(c->chunk, INSTR(op, a, 0, 0));
+    chunk_emit(c->chunk, x);
+}
+
+static uint32_t emit_jump(struct compiler* c, const enum opcode op, const uint32_t a)
+{
+    chunk_emit(c->chunk, INSTR(op, a, 0, 0));
+    return chunk_emit(c->chunk, 0);
+}
+
+static void patch_jump(struct compiler* c, const uint32_t slot)
+{
+    c->chunk->code[slot] = c->chunk->count;
+}
+
+static uint32_t alloc_reg(struct compiler* c)
+{
+    if (c->next_reg >= VM_MAX_REGISTERS)
+    {
+        if (!c->failed) fprintf(stderr, "[compiler] Expression needs more than %d registers\n", VM_MAX_REGISTERS);
+        c->failed = 1;
+        return VM_MAX_REGISTERS - 1;
+    }
+    const uint32_t reg = c->next_reg++;
+    if (c->next_reg > c->chunk->register_count) c->chunk->register_count = c->next_reg;
+    return reg;
+}
+
+// Nested blocks take the locals after their parent's; siblings share them.
+static void open_scope(struct compiler* c, const uint32_t slot_count)
+{
+    if (c->scope_count == c->scope_capacity)
+    {
+        c->scope_capacity = c->scope_capacity ? c->scope_capacity * 2 : 16;
+        struct compile_scope* grown = ts_realloc(c->scopes, c->scope_capacity * sizeof(struct compile_scope));
+        if (!grown)
+        {
+            fprintf(stderr, "Failed to allocate memory in compiler\n");
+            abort();
+        }
+        c->scopes = grown;
+    }
+    const struct compile_scope* parent = c->scope_count ? &c->scopes[c->scope_count - 1] : NULL;
+    const uint32_t base = parent ? parent->base + parent->slot_count : 0;
+    if (slot_count > UINT32_MAX - base)
+    {
+        fprintf(stderr, "[compiler] Too many variables\n");
+        c->failed = 1;
+    }
+    c->scopes[c->scope_count++] = (struct compile_scope){.base = base, .slot_count = slot_count};
+    if (!c->failed && base + slot_count > c->chunk->local_count) c->chunk->local_count = base + slot_count;
+}
+
+// The local a bound reference names. Bindings come from resolve() or from
+// an AST cache, so they are checked against the scopes before use.
+static int local_index(struct compiler* c, const uint32_t binding, uint32_t* index)
+{
+    const uint32_t depth = BINDING_DEPTH(binding);
+    if (depth >= c->scope_count || BINDING_SLOT(binding) >= c->scopes[c->scope_count - 1 - depth].slot_count)
+    {
+        if (!c->failed) fprintf(stderr, "[compiler] Variable binding is out of scope; run resolve() first\n");
+        c->failed = 1;
+        return 0;
+    }
+    *index = c->scopes[c->scope_count - 1 - depth].base + BINDING_SLOT(binding);
+    return 1;
+}
+
+// Reads (OP_GETLOCAL / OP_GETGLOBAL) or writes the variable into or from `reg`.
+static void emit_variable(struct compiler* c, const int store, const uint32_t reg, const uint32_t name,
+                          const uint32_t binding)
+{
+    uint32_t index;
+    if (binding == BINDING_NONE) emit_x(c, store ? OP_SETGLOBAL : OP_GETGLOBAL, reg, name);
+    else if (local_index(c, binding, &index)) emit_x(c, store ? OP_SETLOCAL : OP_GETLOCAL, reg, index);
+}
+
+// Declarations take the slots of their block in order.
+static void emit_declaration(struct compiler* c, const uint32_t reg)
+{
+    struct compile_scope* scope = &c->scopes[c->scope_count - 1];
+    if (scope->declared == scope->slot_count)
+    {
+        if (!c->failed) fprintf(stderr, "[compiler] Declaration has no slot; run resolve() first\n");
+        c->failed = 1;
+        return;
+    }
+    emit_x(c, OP_SETLOCAL, reg, scope->base + scope->declared++);
+}
+
+static enum opcode binary_opcode(const enum token_type op)
+{
+    switch (op)
+    {
+    case TOKEN_PLUS: return OP_ADD;
+    case TOKEN_MINUS: return OP_SUB;
+    case TOKEN_STAR: return OP_MUL;
+    case TOKEN_SLASH: return OP_DIV;
+    case TOKEN_EQ: return OP_EQ;
+    case TOKEN_NEQ: return OP_NEQ;
+    case TOKEN_LT: return OP_LT;
+    case TOKEN_LE: return OP_LE;
+    case TOKEN_GT: return OP_GT;
+    case TOKEN_GE: return OP_GE;
+    default: return OP_COUNT;
+    }
+}
+
+// A node being compiled into `dst`, resumed at `step` each time the child
+// it pushed has been emitted. `reg` is the right operand, condition or
+// batch register and `slot` a pending jump.
+struct compile_frame
+{
+    uint32_t node;
+    uint32_t dst;
+    uint32_t step;
+    uint32_t reg;
+    uint32_t slot;
+    int statement;
+};
+
+static void push_frame(struct compiler* c, const uint32_t node, const uint32_t dst, const int statement)
+{
+    if (c->frame_count == c->frame_capacity)
+    {
+        c->frame_capacity = c->frame_capacity ? c->frame_capacity * 2 : 64;
+        struct compile_frame* grown = ts_realloc(c->frames, c->frame_capacity * sizeof(struct compile_frame));
+        if (!grown)
+        {
+            fprintf(stderr, "Failed to allocate memory in compiler\n");
+            abort();
+        }
+        c->frames = grown;
+    }
+    c->frames[c->frame_count++] = (struct compile_frame){.node = node, .dst = dst, .statement = statement};
+}
+
+// Elements of a list are compiled in batches; step k appends batch k - 1
+// and starts batch k.
+static void compile_list(struct compiler* c, struct compile_frame* f, const struct ast_node* node, const uint32_t step)
+{
+    const uint32_t dst = f->dst;
+    if (step == 0) emit_x(c, OP_NEWLIST, dst, node->list.count);
+    else
+    {
+        const uint32_t appended = node->list.count - (step - 1) * LIST_BATCH;
+        emit(c, INSTR(OP_APPEND, dst, f->reg, appended < LIST_BATCH ? appended : LIST_BATCH));
+        c->next_reg = f->reg;
+    }
+
+    const uint32_t done = step * LIST_BATCH;
+    if (done >= node->list.count)
+    {
+        c->frame_count--;
+        return;
+    }
+    const uint32_t n = node->list.count - done < LIST_BATCH ? node->list.count - done : LIST_BATCH;
+    const uint32_t base = c->next_reg;
+    f->reg = base;
+    for (uint32_t i = 0; i < n; i++) alloc_reg(c);
+    for (uint32_t i = n; i-- > 0;) push_frame(c, c->ast->children[node->list.first + done + i], base + i, 0);
+}
+
+static void compile_expr(struct compiler* c, struct compile_frame* f, const struct ast_node* node, const uint32_t step)
+{
+    const uint32_t dst = f->dst;
+    switch (node->type)
+    {
+    case AST_NUMBER:
+        emit_x(c, OP_LOADK, dst, node->number.index);
+        break;
+    case AST_BOOLEAN:
+        emit(c, INSTR(OP_LOADBOOL, dst, node->boolean.value != 0, 0));
+        break;
+    case AST_IDENT:
+        emit_variable(c, 0, dst, node->ident.name, node->ident.binding);
+        break;
+    case AST_LIST:
+        compile_list(c, f, node, step);
+        return;
+    case AST_UNARY:
+        if (step == 0)
+        {
+            push_frame(c, node->unary.operand, dst, 0);
+            return;
+        }
+        emit(c, INSTR(node->op == TOKEN_NOT ? OP_NOT : OP_NEG, dst, dst, 0));
+        break;
+    case AST_BINARY:
+        if (node->op == TOKEN_AND || node->op == TOKEN_OR)
+        {
+            if (step == 0)
+            {
+                push_frame(c, node->binary.left, dst, 0);
+                return;
+            }
+            if (step == 1)
+            {
+                f->slot = emit_jump(c, node->op == TOKEN_AND ? OP_JMPIFNOT : OP_JMPIF, dst);
+                push_frame(c, node->binary.right, dst, 0);
+                return;
+            }
+            patch_jump(c, f->slot);
+            emit(c, INSTR(OP_BOOL, dst, dst, 0));
+        }
+        else
+        {
+            const enum opcode op = binary_opcode(node->op);
+            if (op == OP_COUNT)
+            {
+                fprintf(stderr, "[compiler] Unsupported operator %s\n", token_type_to_str(node->op));
+                c->failed = 1;
+                break;
+            }
+            if (step == 0)
+            {
+                push_frame(c, node->binary.left, dst, 0);
+                return;
+            }
+            if (step == 1)
+            {
+                const uint32_t rhs = alloc_reg(c);
+                f->reg = rhs;
+                push_frame(c, node->binary.right, rhs, 0);
+                return;
+            }
+            emit(c, INSTR(op, dst, dst, f->reg));
+            c->next_reg--;
+        }
+        break;
+    default:
+        fprintf(stderr, "[compiler] Node type %d is not an expression\n", node->type);
+        c->failed = 1;
+        break;
+    }
+    c->frame_count--;
+}
+
+// Statements leave their value in `dst`, so a program evaluates to its last
+// declaration, assignment or expression statement.
+static void compile_statement(struct compiler* c, struct compile_frame* f, const struct ast_node* node,
+                              const uint32_t step)
+{
+    const uint32_t dst = f->dst;
+    switch (node->type)
+    {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+        if (step == 0) open_scope(c, node->block.slot_count);
+        if (step < node->block.count)
+        {
+            push_frame(c, c->ast->children[node->block.first + step], dst, 1);
+            return;
+        }
+        c->scope_count--;
+        break;
+    case AST_IF:
+        if (step == 0)
+        {
+            const uint32_t cond = alloc_reg(c);
+            f->reg = cond;
+            push_frame(c, node->if_statement.condition, cond, 0);
+            return;
+        }
+        if (step == 1)
+        {
+            c->next_reg--;
+            f->slot = emit_jump(c, OP_JMPIFNOT, f->reg);
+            push_frame(c, node->if_statement.then_branch, dst, 1);
+            return;
+        }
+        if (step == 2 && node->if_statement.else_branch)
+        {
+            const uint32_t skip_then = f->slot;
+            f->slot = emit_jump(c, OP_JMP, 0);
+            patch_jump(c, skip_then);
+            push_frame(c, node->if_statement.else_branch, dst, 1);
+            return;
+        }
+        patch_jump(c, f->slot);
+        break;
+    case AST_DECLARATION:
+        if (step == 0 && node->declaration.expression)
+        {
+            push_frame(c, node->declaration.expression, dst, 0);
+            return;
+        }
+        if (!node->declaration.expression) emit(c, INSTR(OP_LOADNIL, dst, 0, 0));
+        emit_declaration(c, dst);
+        break;
+    case AST_ASSIGNMENT:
+        if (step == 0)
+        {
+            push_frame(c, node->assignment.expression, dst, 0);
+            return;
+        }
+        emit_variable(c, 1, dst, node->assignment.name, node->assignment.binding);
+        break;
+    default:
+        f->statement = 0;
+        compile_expr(c, f, node, step);
+        return;
+    }
+    c->frame_count--;
+}
+
+// Walks the tree on an explicit stack rather than recursing, so nesting
+// depth is bounded by the register file and memory, not by the C stack.
+// Each frame is resumed once per child it pushed.
+static void compile_node(struct compiler* c, const uint32_t index, const uint32_t dst)
+{
+    push_frame(c, index, dst, 1);
+    while (c->frame_count)
+    {
+        struct compile_frame* f = &c->frames[c->frame_count - 1];
+        const struct ast_node* node = &c->ast->nodes[f->node];
+        const uint32_t step = f->step++;
+        if (f->statement) compile_statement(c, f, node, step);
+        else compile_expr(c, f, node, step);
+    }
+}
+
+int compile(const struct ast* ast, const uint32_t node, struct chunk* chunk)
+{
+    struct compiler c = {.ast = ast, .chunk = chunk};
+
+    // Number literals keep their index: K[i] is ast->numbers[i].
+    for (uint32_t i = 0; i < ast->number_count; i++)
+        chunk_add_constant(chunk, (struct value){.type = VAL_NUMBER, .number = lex_number_to_double(&ast->numbers[i])});
+    chunk->global_count = ast->names.count;
+
+    // resolve() declares a statement outside any block in a scope of its own.
+    open_scope(&c, ast->nodes[node].type == AST_DECLARATION);
+    const uint32_t result = alloc_reg(&c);
+    emit(&c, INSTR(OP_LOADNIL, result, 0, 0));
+    compile_node(&c, node, result);
+    emit(&c, INSTR(OP_RETURN, result, 0, 0));
+    ts_free(c.frames);
+    ts_free(c.scopes);
+    return !c.failed;
+}
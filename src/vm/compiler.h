@@ -0,0 +1,17 @@
+#ifndef TS_COMPILER_H
+#define TS_COMPILER_H
+#include <stdint.h>
+#include "bytecode.h"
+
+struct ast;
+
+// Compiles the program, statement or expression at `node` into `chunk`,
+// ending with an OP_RETURN of its value (nil for an empty program). Returns 1 on success, 0 after printing an error.
+//
+// Declared variables live in VM locals: every block in scope has its slots
+// (see passes/resolve.h) at a fixed offset in the chunk's locals, so a bound
+// reference compiles to one local index. Run resolve() first on anything
+// that declares variables. References it did not bind read and write the
+// globals by name id, which is how a host hands values to an expression.
+int compile(const struct ast* ast, uint32_t node, struct chunk* chunk);
+#endif
@@ -0,0 +1,540 @@
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define _DEFAULT_SOURCE
+#define JIT_NATIVE 1
+#endif
+
+#include "jit.h"
+#include "compiler.h"
+#include "parser/ast.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JIT_NATIVE
+#include <sys/mman.h>
+#endif
+
+// xmm0 .. xmm14 hold intermediates; xmm15 is scratch for constants.
+#define JIT_REGISTERS 15
+#define SCRATCH 15
+
+enum jit_type
+{
+    JIT_NUMBER,
+    JIT_BOOL,
+    JIT_UNSUPPORTED,
+};
+
+// cmpsd predicates
+enum
+{
+    CMP_EQ = 0,
+    CMP_LT = 1,
+    CMP_LE = 2,
+    CMP_NEQ = 4,
+};
+
+struct fixup
+{
+    uint32_t at; // offset of a rip-relative disp32
+    uint32_t constant;
+};
+
+struct emit_frame
+{
+    uint32_t node;
+    uint8_t reg; // the result goes to xmm<reg>; higher registers are free
+    uint8_t stage;
+};
+
+struct jit_compiler
+{
+    const struct ast* ast;
+    const char* const* slot_names;
+    size_t slot_count;
+    uint8_t* types; // enum jit_type, per node
+    uint8_t* needs; // registers a node needs, per node
+
+    uint8_t* code;
+    size_t size;
+    size_t capacity;
+    double* constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+    struct fixup* fixups;
+    uint32_t fixup_count;
+    uint32_t fixup_capacity;
+};
+
+static void* grow(void* items, uint32_t* capacity, const size_t item_size)
+{
+    *capacity = *capacity ? *capacity * 2 : 16;
+    void* grown = ts_realloc(items, (size_t)*capacity * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Failed to allocate memory in jit\n");
+        abort();
+    }
+    return grown;
+}
+
+// The expression statement a program consists of, or the node itself.
+static uint32_t expression_root(const struct ast* ast, const uint32_t node)
+{
+    const struct ast_node* n = &ast->nodes[node];
+    if (n->type != AST_PROGRAM || n->block.count != 1) return node;
+    const uint32_t statement = ast->children[n->block.first];
+    switch (ast->nodes[statement].type)
+    {
+    case AST_ASSIGNMENT:
+    case AST_DECLARATION:
+    case AST_IF:
+    case AST_BLOCK:
+        return node;
+    default:
+        return statement;
+    }
+}
+
+static size_t find_slot(const char* const* slot_names, const size_t slot_count, const char* name)
+{
+    size_t slot = 0;
+    while (slot < slot_count && strcmp(slot_names[slot], name) != 0) slot++;
+    return slot;
+}
+
+// ---------------------------------------------------------------------------
+// Analysis
+// ---------------------------------------------------------------------------
+
+static int mixed_equality(const struct jit_compiler* c, const struct ast_node* n)
+{
+    return (n->op == TOKEN_EQ || n->op == TOKEN_NEQ) && c->types[n->binary.left] != c->types[n->binary.right];
+}
+
+// Types every node and counts the registers it needs, evaluating the child
+// that needs more first (Sethi-Ullman). Children sit below their parent, so
+// one ascending pass over the marked subtree sees operands first.
+static int analyze(struct jit_compiler* c, const uint32_t root)
+{
+    const struct ast* ast = c->ast;
+    uint8_t* live = ts_calloc((size_t)root + 1, 1);
+    if (!live)
+    {
+        fprintf(stderr, "Failed to allocate memory in jit\n");
+        abort();
+    }
+    live[root] = 1;
+    for (uint32_t i = root; i > 0; i--)
+    {
+        if (!live[i]) continue;
+        const struct ast_node* n = &ast->nodes[i];
+        if (n->type == AST_UNARY) live[n->unary.operand] = 1;
+        else if (n->type == AST_BINARY) live[n->binary.left] = live[n->binary.right] = 1;
+    }
+
+    int supported = 1;
+    for (uint32_t i = 1; i <= root && supported; i++)
+    {
+        if (!live[i]) continue;
+        const struct ast_node* n = &ast->nodes[i];
+        uint8_t type = JIT_UNSUPPORTED, need = 1;
+        switch (n->type)
+        {
+        case AST_NUMBER:
+            type = JIT_NUMBER;
+            break;
+        case AST_BOOLEAN:
+            type = JIT_BOOL;
+            break;
+        case AST_IDENT:
+            if (find_slot(c->slot_names, c->slot_count, interner_lookup(&ast->names, n->ident.name)) < c->slot_count)
+                type = JIT_NUMBER;
+            break;
+        case AST_UNARY:
+        {
+            const uint8_t operand = c->types[n->unary.operand];
+            if (n->op == TOKEN_NOT) type = JIT_BOOL;
+            else if (operand == JIT_NUMBER) type = JIT_NUMBER;
+            need = c->needs[n->unary.operand];
+            break;
+        }
+        case AST_BINARY:
+        {
+            const uint8_t left = c->types[n->binary.left], right = c->types[n->binary.right];
+            const uint8_t a = c->needs[n->binary.left], b = c->needs[n->binary.right];
+            need = a == b ? (uint8_t)(a + 1) : a > b ? a : b;
+            switch (n->op)
+            {
+            case TOKEN_PLUS:
+            case TOKEN_MINUS:
+            case TOKEN_STAR:
+            case TOKEN_SLASH:
+                if (left == JIT_NUMBER && right == JIT_NUMBER) type = JIT_NUMBER;
+                break;
+            case TOKEN_LT:
+            case TOKEN_LE:
+            case TOKEN_GT:
+            case TOKEN_GE:
+                if (left == JIT_NUMBER && right == JIT_NUMBER) type = JIT_BOOL;
+                break;
+            default: // == != && ||
+                type = JIT_BOOL;
+                // Values of different types are never equal; nothing is evaluated.
+                if (mixed_equality(c, n)) need = 1;
+                break;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        c->types[i] = type;
+        c->needs[i] = need;
+        if (type == JIT_UNSUPPORTED || need > JIT_REGISTERS) supported = 0;
+    }
+    ts_free(live);
+    return supported;
+}
+
+// ---------------------------------------------------------------------------
+// x86-64 encoding
+// ---------------------------------------------------------------------------
+
+static void byte(struct jit_compiler* c, const uint8_t value)
+{
+    if (c->size == c->capacity)
+    {
+        uint32_t capacity = (uint32_t)c->capacity;
+        c->code = grow(c->code, &capacity, 1);
+        c->capacity = capacity;
+    }
+    c->code[c->size++] = value;
+}
+
+static void dword(struct jit_compiler* c, const uint32_t value)
+{
+    for (int i = 0; i < 4; i++) byte(c, (uint8_t)(value >> (8 * i)));
+}
+
+// prefix [REX] 0F opcode modrm, for the SSE2 instructions used here.
+static void sse_prefix(struct jit_compiler* c, const uint8_t prefix, const uint8_t opcode, const int reg,
+                       const int rm)
+{
+    byte(c, prefix);
+    const uint8_t rex = (uint8_t)(0x40 | (reg >= 8) << 2 | (rm >= 8));
+    if (rex != 0x40) byte(c, rex);
+    byte(c, 0x0F);
+    byte(c, opcode);
+}
+
+static void sse(struct jit_compiler* c, const uint8_t prefix, const uint8_t opcode, const int reg, const int rm)
+{
+    sse_prefix(c, prefix, opcode, reg, rm);
+    byte(c, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+#define ADDSD(c, d, s) sse(c, 0xF2, 0x58, d, s)
+#define MULSD(c, d, s) sse(c, 0xF2, 0x59, d, s)
+#define SUBSD(c, d, s) sse(c, 0xF2, 0x5C, d, s)
+#define DIVSD(c, d, s) sse(c, 0xF2, 0x5E, d, s)
+#define ANDPD(c, d, s) sse(c, 0x66, 0x54, d, s)
+#define ORPD(c, d, s) sse(c, 0x66, 0x56, d, s)
+#define XORPD(c, d, s) sse(c, 0x66, 0x57, d, s)
+#define MOVAPD(c, d, s) sse(c, 0x66, 0x28, d, s)
+
+static void cmpsd(struct jit_compiler* c, const int d, const int s, const uint8_t predicate)
+{
+    sse(c, 0xF2, 0xC2, d, s);
+    byte(c, predicate);
+}
+
+// movsd xmm<reg>, [rdi + 8 * slot]
+static void load_slot(struct jit_compiler* c, const int reg, const size_t slot)
+{
+    sse_prefix(c, 0xF2, 0x10, reg, 0);
+    byte(c, (uint8_t)(0x80 | (reg & 7) << 3 | 7));
+    dword(c, (uint32_t)(slot * sizeof(double)));
+}
+
+// movsd xmm<reg>, [rip + constant], patched once the pool's place is known.
+static void load_constant(struct jit_compiler* c, const int reg, const double value)
+{
+    uint32_t k = 0;
+    while (k < c->constant_count && memcmp(&c->constants[k], &value, sizeof(double)) != 0) k++;
+    if (k == c->constant_count)
+    {
+        if (c->constant_count == c->constant_capacity)
+            c->constants = grow(c->constants, &c->constant_capacity, sizeof(double));
+        c->constants[c->constant_count++] = value;
+    }
+    if (c->fixup_count == c->fixup_capacity) c->fixups = grow(c->fixups, &c->fixup_capacity, sizeof(struct fixup));
+
+    sse_prefix(c, 0xF2, 0x10, reg, 0);
+    byte(c, (uint8_t)((reg & 7) << 3 | 5));
+    c->fixups[c->fixup_count++] = (struct fixup){.at = (uint32_t)c->size, .constant = k};
+    dword(c, 0);
+}
+
+// 0.0 or 1.0 from a cmpsd mask.
+static void mask_to_bool(struct jit_compiler* c, const int reg)
+{
+    load_constant(c, SCRATCH, 1.0);
+    ANDPD(c, reg, SCRATCH);
+}
+
+// Numbers become 1.0 unless they are 0, as in value_truthy (NaN is true).
+static void truthy(struct jit_compiler* c, const int reg, const uint8_t type)
+{
+    if (type == JIT_BOOL) return;
+    XORPD(c, SCRATCH, SCRATCH);
+    cmpsd(c, reg, SCRATCH, CMP_NEQ);
+    mask_to_bool(c, reg);
+}
+
+// ---------------------------------------------------------------------------
+// Code generation
+// ---------------------------------------------------------------------------
+
+static void emit_leaf(struct jit_compiler* c, const uint32_t node, const int reg)
+{
+    const struct ast* ast = c->ast;
+    const struct ast_node* n = &ast->nodes[node];
+    if (n->type == AST_NUMBER) load_constant(c, reg, ast_number_value(ast, node));
+    else if (n->type == AST_BOOLEAN) load_constant(c, reg, n->boolean.value ? 1.0 : 0.0);
+    else load_slot(c, reg, find_slot(c->slot_names, c->slot_count, interner_lookup(&ast->names, n->ident.name)));
+}
+
+static void emit_unary(struct jit_compiler* c, const struct ast_node* n, const int reg)
+{
+    if (n->op == TOKEN_MINUS)
+    {
+        load_constant(c, SCRATCH, -0.0);
+        XORPD(c, reg, SCRATCH);
+    }
+    else if (c->types[n->unary.operand] == JIT_BOOL)
+    {
+        load_constant(c, SCRATCH, 1.0);
+        XORPD(c, reg, SCRATCH);
+    }
+    else
+    {
+        XORPD(c, SCRATCH, SCRATCH);
+        cmpsd(c, reg, SCRATCH, CMP_EQ);
+        mask_to_bool(c, reg);
+    }
+}
+
+// Combines the operands of `n`, held in xmm<left> and xmm<right>, into
+// xmm<reg>, which is one of the two.
+static void emit_binary(struct jit_compiler* c, const struct ast_node* n, const int reg, const int left,
+                        const int right)
+{
+    int d = left;
+    switch (n->op)
+    {
+    case TOKEN_PLUS: ADDSD(c, left, right); break;
+    case TOKEN_MINUS: SUBSD(c, left, right); break;
+    case TOKEN_STAR: MULSD(c, left, right); break;
+    case TOKEN_SLASH: DIVSD(c, left, right); break;
+    case TOKEN_AND:
+    case TOKEN_OR:
+        truthy(c, left, c->types[n->binary.left]);
+        truthy(c, right, c->types[n->binary.right]);
+        if (n->op == TOKEN_AND) ANDPD(c, left, right);
+        else ORPD(c, left, right);
+        break;
+    default:
+    {
+        // a > b is b < a; NaN compares false either way round.
+        uint8_t predicate = CMP_EQ;
+        switch (n->op)
+        {
+        case TOKEN_LT: predicate = CMP_LT; break;
+        case TOKEN_LE: predicate = CMP_LE; break;
+        case TOKEN_GT: predicate = CMP_LT; d = right; break;
+        case TOKEN_GE: predicate = CMP_LE; d = right; break;
+        case TOKEN_NEQ: predicate = CMP_NEQ; break;
+        default: break;
+        }
+        cmpsd(c, d, d == left ? right : left, predicate);
+        mask_to_bool(c, d);
+        break;
+    }
+    }
+    if (d != reg) MOVAPD(c, reg, d);
+}
+
+static void generate(struct jit_compiler* c, const uint32_t root)
+{
+    const struct ast* ast = c->ast;
+    struct emit_frame* stack = NULL;
+    uint32_t count = 0, capacity = 0;
+    stack = grow(stack, &capacity, sizeof(struct emit_frame));
+    stack[count++] = (struct emit_frame){.node = root, .reg = 0, .stage = 0};
+    while (count)
+    {
+        struct emit_frame* f = &stack[count - 1];
+        const struct ast_node* n = &ast->nodes[f->node];
+        uint32_t next = 0;
+        uint8_t next_reg = f->reg;
+        if (n->type == AST_UNARY)
+        {
+            if (f->stage++ == 0) next = n->unary.operand;
+            else emit_unary(c, n, f->reg);
+        }
+        else if (n->type == AST_BINARY && mixed_equality(c, n))
+            load_constant(c, f->reg, n->op == TOKEN_NEQ ? 1.0 : 0.0);
+        else if (n->type == AST_BINARY)
+        {
+            const uint32_t l = n->binary.left, r = n->binary.right;
+            const uint32_t first = c->needs[r] > c->needs[l] ? r : l;
+            switch (f->stage++)
+            {
+            case 0:
+                next = first;
+                break;
+            case 1:
+                next = first == l ? r : l;
+                next_reg = (uint8_t)(f->reg + 1);
+                break;
+            default:
+                if (first == l) emit_binary(c, n, f->reg, f->reg, f->reg + 1);
+                else emit_binary(c, n, f->reg, f->reg + 1, f->reg);
+                break;
+            }
+        }
+        else emit_leaf(c, f->node, f->reg);
+
+        if (!next)
+        {
+            count--;
+            continue;
+        }
+        if (count == capacity) stack = grow(stack, &capacity, sizeof(struct emit_frame));
+        stack[count++] = (struct emit_frame){.node = next, .reg = next_reg, .stage = 0};
+    }
+    ts_free(stack);
+    byte(c, 0xC3); // ret, with the result in xmm0
+}
+
+#ifdef JIT_NATIVE
+// Appends the constant pool, resolves the loads from it, and maps the code
+// executable. Returns 0 if the system refuses.
+static int install(struct jit_compiler* c, struct jit_expression* expression)
+{
+    while (c->size % sizeof(double)) byte(c, 0xCC);
+    const size_t pool = c->size;
+    for (uint32_t k = 0; k < c->constant_count; k++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &c->constants[k], sizeof(bits));
+        dword(c, (uint32_t)bits);
+        dword(c, (uint32_t)(bits >> 32));
+    }
+    for (uint32_t i = 0; i < c->fixup_count; i++)
+    {
+        const struct fixup* fixup = &c->fixups[i];
+        const int32_t displacement = (int32_t)(pool + fixup->constant * sizeof(double) - (fixup->at + 4));
+        memcpy(c->code + fixup->at, &displacement, sizeof(displacement));
+    }
+
+    void* code = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) return 0;
+    memcpy(code, c->code, c->size);
+    if (mprotect(code, c->size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, c->size);
+        return 0;
+    }
+    expression->code = code;
+    expression->code_size = c->size;
+    expression->native = (jit_function)code;
+    return 1;
+}
+#endif
+
+static int compile_native(const struct ast* ast, const uint32_t root, const char* const* slot_names,
+                          const size_t slot_count, struct jit_expression* expression)
+{
+#ifdef JIT_NATIVE
+    struct jit_compiler c = {.ast = ast, .slot_names = slot_names, .slot_count = slot_count};
+    c.types = ts_calloc((size_t)root + 1, 1);
+    c.needs = ts_calloc((size_t)root + 1, 1);
+    if (!c.types || !c.needs)
+    {
+        fprintf(stderr, "Failed to allocate memory in jit\n");
+        abort();
+    }
+    int ok = root && slot_count <= INT32_MAX / sizeof(double) && analyze(&c, root);
+    if (ok)
+    {
+        expression->boolean = c.types[root] == JIT_BOOL;
+        generate(&c, root);
+        ok = install(&c, expression);
+    }
+    ts_free(c.types);
+    ts_free(c.needs);
+    ts_free(c.code);
+    ts_free(c.constants);
+    ts_free(c.fixups);
+    return ok;
+#else
+    (void)ast;
+    (void)root;
+    (void)slot_names;
+    (void)slot_count;
+    (void)expression;
+    return 0;
+#endif
+}
+
+// Points each slot at the global the chunk reads it from.
+static int compile_fallback(const struct ast* ast, const uint32_t root, const char* const* slot_names,
+                            const size_t slot_count, struct jit_expression* expression)
+{
+    chunk_init(&expression->chunk);
+    if (!compile(ast, root, &expression->chunk)) return 0;
+    vm_init(&expression->vm);
+    const uint32_t global_count = expression->chunk.global_count;
+    expression->vm.globals = ts_malloc((global_count ? global_count : 1) * sizeof(struct value));
+    expression->globals = ts_malloc((slot_count ? slot_count : 1) * sizeof(uint32_t));
+    if (!expression->vm.globals || !expression->globals)
+    {
+        fprintf(stderr, "Failed to allocate memory in jit\n");
+        abort();
+    }
+    expression->vm.global_count = global_count;
+    for (uint32_t i = 0; i < global_count; i++) expression->vm.globals[i].type = VAL_UNDEFINED;
+    for (size_t slot = 0; slot < slot_count; slot++)
+    {
+        expression->globals[slot] = UINT32_MAX;
+        for (uint32_t id = 0; id < global_count && id < ast->names.count; id++)
+            if (strcmp(interner_lookup(&ast->names, id), slot_names[slot]) == 0) expression->globals[slot] = id;
+    }
+    return 1;
+}
+
+int jit_compile(const struct ast* ast, uint32_t node, const char* const* slot_names, const size_t slot_count,
+                struct jit_expression* expression)
+{
+    memset(expression, 0, sizeof(*expression));
+    node = expression_root(ast, node);
+    expression->slot_count = slot_count;
+    if (compile_native(ast, node, slot_names, slot_count, expression)) return 1;
+    if (compile_fallback(ast, node, slot_names, slot_count, expression)) return 1;
+    jit_free(expression);
+    return 0;
+}
+
+void jit_free(struct jit_expression* expression)
+{
+#ifdef JIT_NATIVE
+    if (expression->code) munmap(expression->code, expression->code_size);
+#endif
+    chunk_free(&expression->chunk);
+    if (expression->vm.globals) vm_free(&expression->vm);
+    ts_free(expression->globals);
+    memset(expression, 0, sizeof(*expression));
+}
@@ -0,0 +1,76 @@
+#ifndef TS_JIT_H
+#define TS_JIT_H
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+#include "vm.h"
+
+struct ast;
+
+// Native code for one hot expression over numeric host slots.
+//
+// jit_compile() binds each identifier to the slot of the same name, so the
+// expression reads slots[i] where the host keeps its values, and lowers the
+// tree to x86-64 SSE2 code in a buffer of its own: every intermediate lives
+// in an xmm register, booleans are 0.0 or 1.0, and the function returns in
+// xmm0. The buffer is written first and only then made executable.
+//
+// Numbers, slot identifiers, + - * /, comparisons, == and !=, !, unary -,
+// && and || are compiled. Anything else - lists, unknown names, operands of
+// the wrong type, trees too deep for the registers, or a machine that is not
+// x86-64 - falls back to the bytecode VM, which gives the same result or the
+// same runtime error. Both sides of && and || are evaluated natively; that
+// cannot be observed, as native code cannot fail.
+
+typedef double (*jit_function)(const double* slots);
+
+struct jit_expression
+{
+    jit_function native; // NULL when the VM runs the expression
+    void* code;
+    size_t code_size;
+    int boolean; // the native result is a boolean, 0.0 or 1.0
+
+    // Fallback: the expression's chunk, and the global each slot feeds.
+    struct chunk chunk;
+    struct vm vm;
+    uint32_t* globals; // per slot, UINT32_MAX when the expression never reads it
+    size_t slot_count;
+};
+
+// Compiles the expression at `node`, or the single expression statement of
+// the program at `node`. Returns 1 on success, natively or not, and 0 after
+// printing an error if not even the VM can compile it.
+int jit_compile(const struct ast* ast, uint32_t node, const char* const* slot_names, size_t slot_count,
+                struct jit_expression* expression);
+void jit_free(struct jit_expression* expression);
+
+// Evaluates the expression with slots[i] as the value of slot i. Native code
+// is reentrant; the fallback runs on the expression's own VM and is not.
+static inline enum vm_status jit_eval(struct jit_expression* expression, const double* slots,
+                                      struct value* result)
+{
+    if (expression->native)
+    {
+        const double value = expression->native(slots);
+        if (expression->boolean)
+        {
+            result->type = VAL_BOOL;
+            result->boolean = value != 0;
+        }
+        else
+        {
+            result->type = VAL_NUMBER;
+            result->number = value;
+        }
+        return VM_OK;
+    }
+    for (size_t i = 0; i < expression->slot_count; i++)
+    {
+        if (expression->globals[i] == UINT32_MAX) continue;
+        expression->vm.globals[expression->globals[i]].type = VAL_NUMBER;
+        expression->vm.globals[expression->globals[i]].number = slots[i];
+    }
+    return vm_run(&expression->vm, &expression->chunk, result);
+}
+#endif
@@ -0,0 +1,434 @@
+#include "packed.h"
+#include "utils/cpu.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PACKED_X86 1
+#include <immintrin.h>
+#endif
+
+// Element i of each operand; a scalar operand stays where it is.
+#define AT_A(shape, a, i) ((shape) == PACKED_SV ? (a) : (a) + (i))
+#define AT_B(shape, b, i) ((shape) == PACKED_VS ? (b) : (b) + (i))
+
+// ---------------------------------------------------------------------------
+// Scalar kernels, also used for the elements left over after the vector loops
+// ---------------------------------------------------------------------------
+
+static void arith_scalar(const enum packed_op op, const enum packed_shape shape, double* out, const double* a,
+                         const double* b, const size_t count)
+{
+    const size_t as = shape != PACKED_SV, bs = shape != PACKED_VS;
+    switch (op)
+    {
+    case PACKED_ADD: for (size_t i = 0; i < count; i++) out[i] = a[i * as] + b[i * bs]; break;
+    case PACKED_SUB: for (size_t i = 0; i < count; i++) out[i] = a[i * as] - b[i * bs]; break;
+    case PACKED_MUL: for (size_t i = 0; i < count; i++) out[i] = a[i * as] * b[i * bs]; break;
+    case PACKED_DIV: for (size_t i = 0; i < count; i++) out[i] = a[i * as] / b[i * bs]; break;
+    default: break;
+    }
+}
+
+static void compare_scalar(const enum packed_op op, const enum packed_shape shape, uint8_t* out, const double* a,
+                           const double* b, const size_t count)
+{
+    const size_t as = shape != PACKED_SV, bs = shape != PACKED_VS;
+    switch (op)
+    {
+    case PACKED_LT: for (size_t i = 0; i < count; i++) out[i] = a[i * as] < b[i * bs]; break;
+    case PACKED_LE: for (size_t i = 0; i < count; i++) out[i] = a[i * as] <= b[i * bs]; break;
+    case PACKED_GT: for (size_t i = 0; i < count; i++) out[i] = a[i * as] > b[i * bs]; break;
+    case PACKED_GE: for (size_t i = 0; i < count; i++) out[i] = a[i * as] >= b[i * bs]; break;
+    default: break;
+    }
+}
+
+static void negate_scalar(double* out, const double* a, const size_t count)
+{
+    for (size_t i = 0; i < count; i++) out[i] = -a[i];
+}
+
+static double sum_scalar(const double* a, const size_t count)
+{
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) sum += a[i];
+    return sum;
+}
+
+static double min_scalar(const double* a, const size_t count)
+{
+    double min = a[0];
+    for (size_t i = 0; i < count; i++)
+    {
+        if (isnan(a[i])) return NAN;
+        if (a[i] < min) min = a[i];
+    }
+    return min;
+}
+
+static double max_scalar(const double* a, const size_t count)
+{
+    double max = a[0];
+    for (size_t i = 0; i < count; i++)
+    {
+        if (isnan(a[i])) return NAN;
+        if (a[i] > max) max = a[i];
+    }
+    return max;
+}
+
+static size_t count_scalar(const uint8_t* flags, const size_t count)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) n += flags[i];
+    return n;
+}
+
+static int equal_scalar(const double* a, const double* b, const size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (a[i] != b[i]) return 0;
+    return 1;
+}
+
+#ifdef PACKED_X86
+// ---------------------------------------------------------------------------
+// Vector kernels, written once against the V_* and B_* macros and
+// instantiated for SSE2 and for AVX2
+// ---------------------------------------------------------------------------
+
+// A compare mask from movemask, one bit per lane, spread to one byte per
+// lane (x86 is little-endian).
+static const uint32_t spread[16] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101, 0x00010000, 0x00010001, 0x00010100, 0x00010101,
+    0x01000000, 0x01000001, 0x01000100, 0x01000101, 0x01010000, 0x01010001, 0x01010100, 0x01010101,
+};
+
+// Runs `body` over whole vectors with x and y holding the operands.
+#define VECTOR_SHAPES(body) \
+    switch (shape) \
+    { \
+    case PACKED_VV: \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) \
+        { \
+            const V x = V_LOAD(a + i), y = V_LOAD(b + i); \
+            body; \
+        } \
+        break; \
+    case PACKED_VS: \
+    { \
+        const V y = V_SET1(*b); \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) \
+        { \
+            const V x = V_LOAD(a + i); \
+            body; \
+        } \
+        break; \
+    } \
+    case PACKED_SV: \
+    { \
+        const V x = V_SET1(*a); \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) \
+        { \
+            const V y = V_LOAD(b + i); \
+            body; \
+        } \
+        break; \
+    } \
+    }
+
+#define STORE_NUMBERS(vop) V_STORE(out + i, vop(x, y))
+#define STORE_FLAGS(vop) \
+    do { \
+        const uint32_t bytes = spread[V_MASK(vop(x, y))]; \
+        memcpy(out + i, &bytes, V_WIDTH); \
+    } while (0)
+
+// Horizontal min or max of `m`, folded into the scalar result for the tail.
+#define EXTREME_KERNEL(name, isa, target, vop, scalar, better) \
+    target static double name##_##isa(const double* a, const size_t count) \
+    { \
+        if (count < V_WIDTH) return scalar(a, count); \
+        V m = V_LOAD(a); \
+        V nan = V_UNORD(m, m); \
+        size_t i = V_WIDTH; \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) \
+        { \
+            const V x = V_LOAD(a + i); \
+            nan = V_OR(nan, V_UNORD(x, x)); \
+            m = vop(m, x); \
+        } \
+        if (V_MASK(nan)) return NAN; \
+        double lanes[V_WIDTH]; \
+        V_STORE(lanes, m); \
+        double result = i < count ? scalar(a + i, count - i) : lanes[0]; \
+        for (int k = 0; k < V_WIDTH; k++) \
+            if (lanes[k] better result) result = lanes[k]; \
+        return result; \
+    }
+
+#define VECTOR_KERNELS(isa, target) \
+    target static void arith_##isa(const enum packed_op op, const enum packed_shape shape, double* out, \
+                                   const double* a, const double* b, const size_t count) \
+    { \
+        size_t i = 0; \
+        switch (op) \
+        { \
+        case PACKED_ADD: VECTOR_SHAPES(STORE_NUMBERS(V_ADD)); break; \
+        case PACKED_SUB: VECTOR_SHAPES(STORE_NUMBERS(V_SUB)); break; \
+        case PACKED_MUL: VECTOR_SHAPES(STORE_NUMBERS(V_MUL)); break; \
+        case PACKED_DIV: VECTOR_SHAPES(STORE_NUMBERS(V_DIV)); break; \
+        default: break; \
+        } \
+        arith_scalar(op, shape, out + i, AT_A(shape, a, i), AT_B(shape, b, i), count - i); \
+    } \
+    target static void compare_##isa(const enum packed_op op, const enum packed_shape shape, uint8_t* out, \
+                                     const double* a, const double* b, const size_t count) \
+    { \
+        size_t i = 0; \
+        switch (op) \
+        { \
+        case PACKED_LT: VECTOR_SHAPES(STORE_FLAGS(V_LT)); break; \
+        case PACKED_LE: VECTOR_SHAPES(STORE_FLAGS(V_LE)); break; \
+        case PACKED_GT: VECTOR_SHAPES(STORE_FLAGS(V_GT)); break; \
+        case PACKED_GE: VECTOR_SHAPES(STORE_FLAGS(V_GE)); break; \
+        default: break; \
+        } \
+        compare_scalar(op, shape, out + i, AT_A(shape, a, i), AT_B(shape, b, i), count - i); \
+    } \
+    target static void negate_##isa(double* out, const double* a, const size_t count) \
+    { \
+        const V sign = V_SET1(-0.0); \
+        size_t i = 0; \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) V_STORE(out + i, V_XOR(V_LOAD(a + i), sign)); \
+        negate_scalar(out + i, a + i, count - i); \
+    } \
+    /* Two accumulators hide the latency of the adds. */ \
+    target static double sum_##isa(const double* a, const size_t count) \
+    { \
+        V s0 = V_ZERO, s1 = V_ZERO; \
+        size_t i = 0; \
+        for (; i + 2 * V_WIDTH <= count; i += 2 * V_WIDTH) \
+        { \
+            s0 = V_ADD(s0, V_LOAD(a + i)); \
+            s1 = V_ADD(s1, V_LOAD(a + i + V_WIDTH)); \
+        } \
+        double lanes[V_WIDTH]; \
+        V_STORE(lanes, V_ADD(s0, s1)); \
+        double sum = 0; \
+        for (int k = 0; k < V_WIDTH; k++) sum += lanes[k]; \
+        return sum + sum_scalar(a + i, count - i); \
+    } \
+    EXTREME_KERNEL(min, isa, target, V_MIN, min_scalar, <) \
+    EXTREME_KERNEL(max, isa, target, V_MAX, max_scalar, >) \
+    /* Flags are 0 or 1, so their sum of absolute differences from zero */ \
+    /* is the count. */ \
+    target static size_t count_##isa(const uint8_t* flags, const size_t count) \
+    { \
+        B total = B_ZERO; \
+        size_t i = 0; \
+        for (; i + sizeof(B) <= count; i += sizeof(B)) total = B_ADD64(total, B_SAD(B_LOAD(flags + i), B_ZERO)); \
+        uint64_t lanes[sizeof(B) / 8]; \
+        B_STORE(lanes, total); \
+        size_t n = 0; \
+        for (size_t k = 0; k < sizeof(B) / 8; k++) n += (size_t)lanes[k]; \
+        return n + count_scalar(flags + i, count - i); \
+    } \
+    target static int equal_##isa(const double* a, const double* b, const size_t count) \
+    { \
+        size_t i = 0; \
+        for (; i + V_WIDTH <= count; i += V_WIDTH) \
+            if (V_MASK(V_EQ(V_LOAD(a + i), V_LOAD(b + i))) != (1 << V_WIDTH) - 1) return 0; \
+        return equal_scalar(a + i, b + i, count - i); \
+    }
+
+#define V __m128d
+#define V_WIDTH 2
+#define V_LOAD _mm_loadu_pd
+#define V_STORE _mm_storeu_pd
+#define V_SET1 _mm_set1_pd
+#define V_ZERO _mm_setzero_pd()
+#define V_ADD _mm_add_pd
+#define V_SUB _mm_sub_pd
+#define V_MUL _mm_mul_pd
+#define V_DIV _mm_div_pd
+#define V_LT _mm_cmplt_pd
+#define V_LE _mm_cmple_pd
+#define V_GT _mm_cmpgt_pd
+#define V_GE _mm_cmpge_pd
+#define V_EQ _mm_cmpeq_pd
+#define V_UNORD _mm_cmpunord_pd
+#define V_OR _mm_or_pd
+#define V_XOR _mm_xor_pd
+#define V_MIN _mm_min_pd
+#define V_MAX _mm_max_pd
+#define V_MASK _mm_movemask_pd
+#define B __m128i
+#define B_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define B_STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define B_ZERO _mm_setzero_si128()
+#define B_SAD _mm_sad_epu8
+#define B_ADD64 _mm_add_epi64
+VECTOR_KERNELS(sse2, )
+#undef V
+#undef V_WIDTH
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_LT
+#undef V_LE
+#undef V_GT
+#undef V_GE
+#undef V_EQ
+#undef V_UNORD
+#undef V_OR
+#undef V_XOR
+#undef V_MIN
+#undef V_MAX
+#undef V_MASK
+#undef B
+#undef B_LOAD
+#undef B_STORE
+#undef B_ZERO
+#undef B_SAD
+#undef B_ADD64
+
+#define V __m256d
+#define V_WIDTH 4
+#define V_LOAD _mm256_loadu_pd
+#define V_STORE _mm256_storeu_pd
+#define V_SET1 _mm256_set1_pd
+#define V_ZERO _mm256_setzero_pd()
+#define V_ADD _mm256_add_pd
+#define V_SUB _mm256_sub_pd
+#define V_MUL _mm256_mul_pd
+#define V_DIV _mm256_div_pd
+#define V_LT(x, y) _mm256_cmp_pd(x, y, _CMP_LT_OQ)
+#define V_LE(x, y) _mm256_cmp_pd(x, y, _CMP_LE_OQ)
+#define V_GT(x, y) _mm256_cmp_pd(x, y, _CMP_GT_OQ)
+#define V_GE(x, y) _mm256_cmp_pd(x, y, _CMP_GE_OQ)
+#define V_EQ(x, y) _mm256_cmp_pd(x, y, _CMP_EQ_OQ)
+#define V_UNORD(x, y) _mm256_cmp_pd(x, y, _CMP_UNORD_Q)
+#define V_OR _mm256_or_pd
+#define V_XOR _mm256_xor_pd
+#define V_MIN _mm256_min_pd
+#define V_MAX _mm256_max_pd
+#define V_MASK _mm256_movemask_pd
+#define B __m256i
+#define B_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define B_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define B_ZERO _mm256_setzero_si256()
+#define B_SAD _mm256_sad_epu8
+#define B_ADD64 _mm256_add_epi64
+VECTOR_KERNELS(avx2, __attribute__((target("avx2"))))
+#undef V
+#undef V_WIDTH
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_LT
+#undef V_LE
+#undef V_GT
+#undef V_GE
+#undef V_EQ
+#undef V_UNORD
+#undef V_OR
+#undef V_XOR
+#undef V_MIN
+#undef V_MAX
+#undef V_MASK
+#undef B
+#undef B_LOAD
+#undef B_STORE
+#undef B_ZERO
+#undef B_SAD
+#undef B_ADD64
+#endif
+
+struct packed_ops
+{
+    void (*arith)(enum packed_op, enum packed_shape, double*, const double*, const double*, size_t);
+    void (*compare)(enum packed_op, enum packed_shape, uint8_t*, const double*, const double*, size_t);
+    void (*negate)(double*, const double*, size_t);
+    double (*sum)(const double*, size_t);
+    double (*min)(const double*, size_t);
+    double (*max)(const double*, size_t);
+    size_t (*count)(const uint8_t*, size_t);
+    int (*equal)(const double*, const double*, size_t);
+};
+
+static struct packed_ops ops = {arith_scalar, compare_scalar, negate_scalar, sum_scalar,
+                                min_scalar,   max_scalar,     count_scalar,  equal_scalar};
+
+#ifdef PACKED_X86
+__attribute__((constructor))
+static void packed_select(void)
+{
+    switch (cpu_detect())
+    {
+    case CPU_AVX2:
+        ops = (struct packed_ops){arith_avx2, compare_avx2, negate_avx2, sum_avx2,
+                                  min_avx2,   max_avx2,     count_avx2,  equal_avx2};
+        break;
+    case CPU_SSE2:
+        ops = (struct packed_ops){arith_sse2, compare_sse2, negate_sse2, sum_sse2,
+                                  min_sse2,   max_sse2,     count_sse2,  equal_sse2};
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+void packed_arith(const enum packed_op op, const enum packed_shape shape, double* out, const double* a,
+                  const double* b, const size_t count)
+{
+    ops.arith(op, shape, out, a, b, count);
+}
+
+void packed_compare(const enum packed_op op, const enum packed_shape shape, uint8_t* out, const double* a,
+                    const double* b, const size_t count)
+{
+    ops.compare(op, shape, out, a, b, count);
+}
+
+void packed_negate(double* out, const double* a, const size_t count)
+{
+    ops.negate(out, a, count);
+}
+
+double packed_sum(const double* a, const size_t count)
+{
+    return ops.sum(a, count);
+}
+
+double packed_min(const double* a, const size_t count)
+{
+    return ops.min(a, count);
+}
+
+double packed_max(const double* a, const size_t count)
+{
+    return ops.max(a, count);
+}
+
+size_t packed_count(const uint8_t* flags, const size_t count)
+{
+    return ops.count(flags, count);
+}
+
+int packed_equal(const double* a, const double* b, const size_t count)
+{
+    return ops.equal(a, b, count);
+}
@@ -0,0 +1,52 @@
+#ifndef TS_PACKED_H
+#define TS_PACKED_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernels over the element arrays of packed lists: doubles for a list of
+// numbers, one byte 0 or 1 per element for a list of booleans (see
+// struct ts_list). Each call runs on AVX2 or SSE2 when the CPU has it (see
+// utils/cpu.h) and on a scalar loop otherwise, with the same results, except
+// that packed_sum adds in several lanes and may round differently from a
+// left-to-right sum.
+
+enum packed_op
+{
+    // number, number -> number
+    PACKED_ADD,
+    PACKED_SUB,
+    PACKED_MUL,
+    PACKED_DIV,
+    // number, number -> bool
+    PACKED_LT,
+    PACKED_LE,
+    PACKED_GT,
+    PACKED_GE,
+};
+
+enum packed_shape
+{
+    PACKED_VV, // a[i] op b[i]
+    PACKED_VS, // a[i] op *b
+    PACKED_SV, // *a op b[i]
+};
+
+// out[i] = a op b for i < count, for PACKED_ADD .. PACKED_DIV. `out` may be
+// one of the operands.
+void packed_arith(enum packed_op op, enum packed_shape shape, double* out, const double* a, const double* b,
+                  size_t count);
+// The same for PACKED_LT .. PACKED_GE, writing 0 or 1.
+void packed_compare(enum packed_op op, enum packed_shape shape, uint8_t* out, const double* a, const double* b,
+                    size_t count);
+void packed_negate(double* out, const double* a, size_t count);
+
+// Reductions. packed_min and packed_max need count > 0 and return NaN if any
+// element is NaN; between 0 and -0 either may be returned.
+double packed_sum(const double* a, size_t count);
+double packed_min(const double* a, size_t count);
+double packed_max(const double* a, size_t count);
+// Number of flags that are set; each must be 0 or 1.
+size_t packed_count(const uint8_t* flags, size_t count);
+// Whether a[i] == b[i] for every i, as numbers: NaN is unequal to itself.
+int packed_equal(const double* a, const double* b, size_t count);
+#endif
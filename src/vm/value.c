@@ -0,0 +1,103 @@
+#include "value.h"
+#include "packed.h"
+#include <stdio.h>
+#include <string.h>
+
+int value_truthy(const struct value* v)
+{
+    switch (v->type)
+    {
+    case VAL_BOOL: return v->boolean;
+    case VAL_NUMBER: return v->number != 0;
+    case VAL_LIST: return 1;
+    default: return 0;
+    }
+}
+
+int values_equal(const struct value* a, const struct value* b)
+{
+    if (a->type != b->type) return 0;
+    switch (a->type)
+    {
+    case VAL_BOOL: return a->boolean == b->boolean;
+    case VAL_NUMBER: return a->number == b->number;
+    case VAL_LIST:
+    {
+        const struct ts_list* l = a->list;
+        const struct ts_list* r = b->list;
+        if (l->length != r->length) return 0;
+        if (l->length == 0) return 1;
+        if (l->kind == LIST_NUMBERS && r->kind == LIST_NUMBERS) return packed_equal(l->numbers, r->numbers, l->length);
+        if (l->kind == LIST_BOOLS && r->kind == LIST_BOOLS) return memcmp(l->bools, r->bools, l->length) == 0;
+        for (uint32_t i = 0; i < l->length; i++)
+        {
+            const struct value x = list_get(l, i), y = list_get(r, i);
+            if (!values_equal(&x, &y)) return 0;
+        }
+        return 1;
+    }
+    default: return 1;
+    }
+}
+
+void print_value(const struct value* v)
+{
+    switch (v->type)
+    {
+    case VAL_BOOL:
+        printf("%s", v->boolean ? "true" : "false");
+        break;
+    case VAL_NUMBER:
+        printf("%g", v->number);
+        break;
+    case VAL_LIST:
+        printf("[");
+        for (uint32_t i = 0; i < v->list->length; i++)
+        {
+            if (i > 0) printf(", ");
+            const struct value item = list_get(v->list, i);
+            print_value(&item);
+        }
+        printf("]");
+        break;
+    case VAL_NIL:
+        printf("nil");
+        break;
+    default:
+        printf("undefined");
+        break;
+    }
+}
+
+struct value list_get(const struct ts_list* list, const uint32_t i)
+{
+    switch (list->kind)
+    {
+    case LIST_NUMBERS: return (struct value){.type = VAL_NUMBER, .number = list->numbers[i]};
+    case LIST_BOOLS: return (struct value){.type = VAL_BOOL, .boolean = list->bools[i]};
+    default: return list->items[i];
+    }
+}
+
+int list_reduce(const struct ts_list* list, const enum list_reduction reduction, double* result)
+{
+    if (list->kind == LIST_BOXED || (reduction != REDUCE_SUM && list->length == 0)) return 0;
+    if (list->kind == LIST_BOOLS)
+    {
+        const size_t set = packed_count(list->bools, list->length);
+        switch (reduction)
+        {
+        case REDUCE_SUM: *result = (double)set; break;
+        case REDUCE_MIN: *result = set == list->length; break;
+        case REDUCE_MAX: *result = set > 0; break;
+        }
+        return 1;
+    }
+    switch (reduction)
+    {
+    case REDUCE_SUM: *result = packed_sum(list->numbers, list->length); break;
+    case REDUCE_MIN: *result = packed_min(list->numbers, list->length); break;
+    case REDUCE_MAX: *result = packed_max(list->numbers, list->length); break;
+    }
+    return 1;
+}
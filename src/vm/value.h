@@ -0,0 +1,70 @@
+#ifndef TS_VALUE_H
+#define TS_VALUE_H
+#include <stdint.h>
+
+enum value_type
+{
+    VAL_UNDEFINED, // global slot that was never declared
+    VAL_NIL,
+    VAL_BOOL,
+    VAL_NUMBER,
+    VAL_LIST,
+};
+
+struct ts_list;
+
+struct value
+{
+    uint8_t type; // enum value_type
+    union
+    {
+        int boolean;
+        double number;
+        struct ts_list* list;
+    };
+};
+
+// How a list stores its elements. A list whose elements are all numbers, or
+// all booleans, keeps them packed in a native array instead of boxed; the
+// first element of another type turns it into a boxed list for good.
+enum list_kind
+{
+    LIST_NUMBERS, // numbers: double[], also the kind of an empty list
+    LIST_BOOLS, // booleans: uint8_t[], 0 or 1
+    LIST_BOXED, // anything else: struct value[]
+};
+
+// Lists are owned by the VM that created them and are reclaimed by its
+// collector once no global or register refers to them.
+struct ts_list
+{
+    struct ts_list* next;
+    uint32_t marked;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t kind; // enum list_kind
+    union
+    {
+        struct value* items;
+        double* numbers;
+        uint8_t* bools;
+    };
+};
+
+enum list_reduction
+{
+    REDUCE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX,
+};
+
+int value_truthy(const struct value* v);
+int values_equal(const struct value* a, const struct value* b);
+void print_value(const struct value* v);
+// Element i of a list, boxed.
+struct value list_get(const struct ts_list* list, uint32_t i);
+// Sums, or finds the least or greatest element of, a list of numbers, or of
+// booleans counted as 0 and 1. Returns 0 for any other list and for the min
+// or max of an empty one.
+int list_reduce(const struct ts_list* list, enum list_reduction reduction, double* result);
+#endif
@@ -0,0 +1,468 @@
+#include "vm.h"
+#include "compiler.h"
+#include "packed.h"
+#include "parser/ast.h"
+#include "utils/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+#define FIRST_COLLECT 1024
+#define FIRST_COLLECT_BYTES ((size_t)32 << 20)
+
+void vm_init(struct vm* vm)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->next_collect = FIRST_COLLECT;
+    vm->next_collect_bytes = FIRST_COLLECT_BYTES;
+}
+
+void vm_free(struct vm* vm)
+{
+    struct ts_list* list = vm->objects;
+    while (list)
+    {
+        struct ts_list* next = list->next;
+        ts_free(list->items);
+        ts_free(list);
+        list = next;
+    }
+    ts_free(vm->globals);
+    ts_free(vm->locals);
+    vm_init(vm);
+}
+
+static void* checked_realloc(void* p, const size_t size)
+{
+    void* q = ts_realloc(p, size);
+    if (!q)
+    {
+        fprintf(stderr, "Failed to allocate memory in vm\n");
+        abort();
+    }
+    return q;
+}
+
+static size_t element_size(const uint32_t kind)
+{
+    switch (kind)
+    {
+    case LIST_NUMBERS: return sizeof(double);
+    case LIST_BOOLS: return sizeof(uint8_t);
+    default: return sizeof(struct value);
+    }
+}
+
+static void mark_value(const struct value* v)
+{
+    if (v->type != VAL_LIST || v->list->marked) return;
+    v->list->marked = 1;
+    if (v->list->kind != LIST_BOXED) return;
+    for (uint32_t i = 0; i < v->list->length; i++) mark_value(&v->list->items[i]);
+}
+
+void vm_collect(struct vm* vm)
+{
+    for (uint32_t i = 0; i < vm->global_count; i++) mark_value(&vm->globals[i]);
+    for (uint32_t i = 0; i < vm->local_count; i++) mark_value(&vm->locals[i]);
+    for (uint32_t i = 0; i < VM_MAX_REGISTERS; i++) mark_value(&vm->registers[i]);
+
+    struct ts_list** link = &vm->objects;
+    uint32_t live = 0;
+    size_t live_bytes = 0;
+    while (*link)
+    {
+        struct ts_list* list = *link;
+        if (list->marked)
+        {
+            list->marked = 0;
+            live++;
+            live_bytes += list->capacity * element_size(list->kind);
+            link = &list->next;
+            continue;
+        }
+        *link = list->next;
+        ts_free(list->items);
+        ts_free(list);
+    }
+    vm->object_count = live;
+    vm->next_collect = live * 2 > FIRST_COLLECT ? live * 2 : FIRST_COLLECT;
+    vm->element_bytes = live_bytes;
+    vm->next_collect_bytes = live_bytes * 2 > FIRST_COLLECT_BYTES ? live_bytes * 2 : FIRST_COLLECT_BYTES;
+}
+
+static struct ts_list* new_list(struct vm* vm, const uint32_t kind, const uint32_t capacity)
+{
+    if (vm->object_count >= vm->next_collect || vm->element_bytes >= vm->next_collect_bytes) vm_collect(vm);
+    struct ts_list* list = checked_realloc(NULL, sizeof(struct ts_list));
+    vm->object_count++;
+    vm->element_bytes += capacity * element_size(kind);
+    list->marked = 0;
+    list->length = 0;
+    list->capacity = capacity;
+    list->kind = kind;
+    list->items = capacity ? checked_realloc(NULL, capacity * element_size(kind)) : NULL;
+    list->next = vm->objects;
+    vm->objects = list;
+    return list;
+}
+
+// Changes how the list stores its elements: to any kind while it is empty,
+// otherwise only to LIST_BOXED.
+static void list_convert(struct vm* vm, struct ts_list* list, const uint32_t kind)
+{
+    vm->element_bytes += list->capacity * element_size(kind);
+    vm->element_bytes -= list->capacity * element_size(list->kind);
+    if (list->length == 0)
+    {
+        if (list->capacity) list->items = checked_realloc(list->items, list->capacity * element_size(kind));
+    }
+    else
+    {
+        struct value* items = checked_realloc(NULL, list->capacity * sizeof(struct value));
+        for (uint32_t i = 0; i < list->length; i++) items[i] = list_get(list, i);
+        ts_free(list->items);
+        list->items = items;
+    }
+    list->kind = kind;
+}
+
+static void list_append(struct vm* vm, struct ts_list* list, const struct value* items, const uint32_t count)
+{
+    if (count == 0) return;
+    uint32_t kind = items[0].type == VAL_NUMBER ? LIST_NUMBERS : items[0].type == VAL_BOOL ? LIST_BOOLS : LIST_BOXED;
+    for (uint32_t i = 1; i < count && kind != LIST_BOXED; i++)
+        if (items[i].type != items[0].type) kind = LIST_BOXED;
+    if (kind != list->kind && list->kind != LIST_BOXED) list_convert(vm, list, list->length ? LIST_BOXED : kind);
+
+    if (list->length + count > list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity : 8;
+        while (capacity < list->length + count) capacity *= 2;
+        list->items = checked_realloc(list->items, capacity * element_size(list->kind));
+        vm->element_bytes += (capacity - list->capacity) * element_size(list->kind);
+        list->capacity = capacity;
+    }
+    switch (list->kind)
+    {
+    case LIST_NUMBERS:
+        for (uint32_t i = 0; i < count; i++) list->numbers[list->length + i] = items[i].number;
+        break;
+    case LIST_BOOLS:
+        for (uint32_t i = 0; i < count; i++) list->bools[list->length + i] = items[i].boolean != 0;
+        break;
+    default:
+        memcpy(list->items + list->length, items, count * sizeof(struct value));
+        break;
+    }
+    list->length += count;
+}
+
+// Element-wise arithmetic and ordering: a list of numbers with a number on
+// either side, or two lists of numbers of the same length. Comparisons give
+// a list of booleans.
+static enum vm_status list_binary(struct vm* vm, const uint32_t opcode, const struct value* l,
+                                  const struct value* r, struct value* out)
+{
+    if ((l->type != VAL_NUMBER && l->type != VAL_LIST) || (r->type != VAL_NUMBER && r->type != VAL_LIST))
+    {
+        fprintf(stderr, "[vm] Operands must be numbers (opcode %u)\n", opcode);
+        return VM_RUNTIME_ERROR;
+    }
+    const struct ts_list* a = l->type == VAL_LIST ? l->list : NULL;
+    const struct ts_list* b = r->type == VAL_LIST ? r->list : NULL;
+    if ((a && a->kind != LIST_NUMBERS) || (b && b->kind != LIST_NUMBERS))
+    {
+        fprintf(stderr, "[vm] Element-wise operands must be lists of numbers (opcode %u)\n", opcode);
+        return VM_RUNTIME_ERROR;
+    }
+    if (a && b && a->length != b->length)
+    {
+        fprintf(stderr, "[vm] List lengths differ (%u and %u)\n", a->length, b->length);
+        return VM_RUNTIME_ERROR;
+    }
+
+    enum packed_op op;
+    switch (opcode)
+    {
+    case OP_ADD: op = PACKED_ADD; break;
+    case OP_SUB: op = PACKED_SUB; break;
+    case OP_MUL: op = PACKED_MUL; break;
+    case OP_DIV: op = PACKED_DIV; break;
+    case OP_LT: op = PACKED_LT; break;
+    case OP_LE: op = PACKED_LE; break;
+    case OP_GT: op = PACKED_GT; break;
+    default: op = PACKED_GE; break;
+    }
+    const uint32_t length = a ? a->length : b->length;
+    const enum packed_shape shape = a && b ? PACKED_VV : a ? PACKED_VS : PACKED_SV;
+    const double* x = a ? a->numbers : &l->number;
+    const double* y = b ? b->numbers : &r->number;
+    // The operands sit in registers, so a collection here keeps them.
+    struct ts_list* list = new_list(vm, op >= PACKED_LT ? LIST_BOOLS : LIST_NUMBERS, length);
+    if (length)
+    {
+        if (op >= PACKED_LT) packed_compare(op, shape, list->bools, x, y, length);
+        else packed_arith(op, shape, list->numbers, x, y, length);
+    }
+    list->length = length;
+    out->type = VAL_LIST;
+    out->list = list;
+    return VM_OK;
+}
+
+struct value vm_number_list(struct vm* vm, const double* numbers, const uint32_t count)
+{
+    struct ts_list* list = new_list(vm, LIST_NUMBERS, count);
+    if (count) memcpy(list->numbers, numbers, count * sizeof(double));
+    list->length = count;
+    return (struct value){.type = VAL_LIST, .list = list};
+}
+
+static void ensure_globals(struct vm* vm, const uint32_t count)
+{
+    if (count <= vm->global_count) return;
+    vm->globals = checked_realloc(vm->globals, count * sizeof(struct value));
+    for (uint32_t i = vm->global_count; i < count; i++) vm->globals[i].type = VAL_UNDEFINED;
+    vm->global_count = count;
+}
+
+// Unlike globals, locals do not outlive a run.
+static void reset_locals(struct vm* vm, const uint32_t count)
+{
+    if (count > vm->local_count)
+    {
+        vm->locals = checked_realloc(vm->locals, count * sizeof(struct value));
+        vm->local_count = count;
+    }
+    for (uint32_t i = 0; i < vm->local_count; i++) vm->locals[i].type = VAL_NIL;
+}
+
+enum vm_status vm_run(struct vm* vm, const struct chunk* chunk, struct value* result)
+{
+    ensure_globals(vm, chunk->global_count);
+    reset_locals(vm, chunk->local_count);
+
+    struct value* const R = vm->registers;
+    const struct value* const K = chunk->constants;
+    struct value* const G = vm->globals;
+    struct value* const L = vm->locals;
+    const uint32_t* pc = chunk->code;
+    uint32_t ins;
+
+#define A (INSTR_A(ins))
+#define B (INSTR_B(ins))
+#define C (INSTR_C(ins))
+#define X (*pc++)
+
+// Anything but two numbers goes to list_binary, which handles lists and
+// reports the type error otherwise.
+#define ARITH(expr) \
+    do { \
+        const struct value* l = &R[B]; \
+        const struct value* r = &R[C]; \
+        if (l->type == VAL_NUMBER && r->type == VAL_NUMBER) \
+        { \
+            R[A].number = (expr); \
+            R[A].type = VAL_NUMBER; \
+        } \
+        else if (list_binary(vm, INSTR_OP(ins), l, r, &R[A]) != VM_OK) \
+            return VM_RUNTIME_ERROR; \
+    } while (0)
+
+#define COMPARE(expr) \
+    do { \
+        const struct value* l = &R[B]; \
+        const struct value* r = &R[C]; \
+        if (l->type == VAL_NUMBER && r->type == VAL_NUMBER) \
+        { \
+            R[A].boolean = (expr); \
+            R[A].type = VAL_BOOL; \
+        } \
+        else if (list_binary(vm, INSTR_OP(ins), l, r, &R[A]) != VM_OK) \
+            return VM_RUNTIME_ERROR; \
+    } while (0)
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* const labels[OP_COUNT] = {
+        &&L_OP_LOADK, &&L_OP_LOADBOOL, &&L_OP_LOADNIL, &&L_OP_MOVE, &&L_OP_GETGLOBAL, &&L_OP_SETGLOBAL,
+        &&L_OP_GETLOCAL, &&L_OP_SETLOCAL, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_EQ,
+        &&L_OP_NEQ, &&L_OP_LT, &&L_OP_LE, &&L_OP_GT, &&L_OP_GE, &&L_OP_NEG, &&L_OP_NOT, &&L_OP_BOOL,
+        &&L_OP_JMP, &&L_OP_JMPIF, &&L_OP_JMPIFNOT, &&L_OP_NEWLIST, &&L_OP_APPEND, &&L_OP_RETURN,
+    };
+#define CASE(op) L_##op:
+#define DISPATCH() do { ins = *pc++; goto *labels[INSTR_OP(ins)]; } while (0)
+    DISPATCH();
+#else
+#define CASE(op) case op:
+#define DISPATCH() break
+    for (;;)
+    {
+        ins = *pc++;
+        switch (INSTR_OP(ins))
+        {
+#endif
+
+    CASE(OP_LOADK)
+        R[A] = K[X];
+        DISPATCH();
+    CASE(OP_LOADBOOL)
+        R[A].type = VAL_BOOL;
+        R[A].boolean = B;
+        DISPATCH();
+    CASE(OP_LOADNIL)
+        R[A].type = VAL_NIL;
+        DISPATCH();
+    CASE(OP_MOVE)
+        R[A] = R[B];
+        DISPATCH();
+    CASE(OP_GETGLOBAL)
+    {
+        const uint32_t slot = X;
+        if (G[slot].type == VAL_UNDEFINED)
+        {
+            fprintf(stderr, "[vm] Undefined variable (global %u)\n", slot);
+            return VM_RUNTIME_ERROR;
+        }
+        R[A] = G[slot];
+        DISPATCH();
+    }
+    CASE(OP_SETGLOBAL)
+        G[X] = R[A];
+        DISPATCH();
+    CASE(OP_GETLOCAL)
+        R[A] = L[X];
+        DISPATCH();
+    CASE(OP_SETLOCAL)
+        L[X] = R[A];
+        DISPATCH();
+    CASE(OP_ADD)
+        ARITH(l->number + r->number);
+        DISPATCH();
+    CASE(OP_SUB)
+        ARITH(l->number - r->number);
+        DISPATCH();
+    CASE(OP_MUL)
+        ARITH(l->number * r->number);
+        DISPATCH();
+    CASE(OP_DIV)
+        ARITH(l->number / r->number);
+        DISPATCH();
+    CASE(OP_EQ)
+    {
+        const int eq = values_equal(&R[B], &R[C]);
+        R[A].type = VAL_BOOL;
+        R[A].boolean = eq;
+        DISPATCH();
+    }
+    CASE(OP_NEQ)
+    {
+        const int eq = values_equal(&R[B], &R[C]);
+        R[A].type = VAL_BOOL;
+        R[A].boolean = !eq;
+        DISPATCH();
+    }
+    CASE(OP_LT)
+        COMPARE(l->number < r->number);
+        DISPATCH();
+    CASE(OP_LE)
+        COMPARE(l->number <= r->number);
+        DISPATCH();
+    CASE(OP_GT)
+        COMPARE(l->number > r->number);
+        DISPATCH();
+    CASE(OP_GE)
+        COMPARE(l->number >= r->number);
+        DISPATCH();
+    CASE(OP_NEG)
+        if (R[B].type == VAL_NUMBER)
+        {
+            R[A].type = VAL_NUMBER;
+            R[A].number = -R[B].number;
+        }
+        else if (R[B].type == VAL_LIST && R[B].list->kind == LIST_NUMBERS)
+        {
+            const struct ts_list* from = R[B].list;
+            struct ts_list* list = new_list(vm, LIST_NUMBERS, from->length);
+            if (from->length) packed_negate(list->numbers, from->numbers, from->length);
+            list->length = from->length;
+            R[A].type = VAL_LIST;
+            R[A].list = list;
+        }
+        else goto type_error;
+        DISPATCH();
+    CASE(OP_NOT)
+    {
+        const int truthy = value_truthy(&R[B]);
+        R[A].type = VAL_BOOL;
+        R[A].boolean = !truthy;
+        DISPATCH();
+    }
+    CASE(OP_BOOL)
+    {
+        const int truthy = value_truthy(&R[B]);
+        R[A].type = VAL_BOOL;
+        R[A].boolean = truthy;
+        DISPATCH();
+    }
+    CASE(OP_JMP)
+        pc = chunk->code + *pc;
+        DISPATCH();
+    CASE(OP_JMPIF)
+        if (value_truthy(&R[A])) pc = chunk->code + *pc;
+        else pc++;
+        DISPATCH();
+    CASE(OP_JMPIFNOT)
+        if (!value_truthy(&R[A])) pc = chunk->code + *pc;
+        else pc++;
+        DISPATCH();
+    CASE(OP_NEWLIST)
+    {
+        struct ts_list* list = new_list(vm, LIST_NUMBERS, X);
+        R[A].type = VAL_LIST;
+        R[A].list = list;
+        DISPATCH();
+    }
+    CASE(OP_APPEND)
+        list_append(vm, R[A].list, &R[B], C);
+        DISPATCH();
+    CASE(OP_RETURN)
+        if (result) *result = R[A];
+        return VM_OK;
+
+#ifndef VM_COMPUTED_GOTO
+        default:
+            fprintf(stderr, "[vm] Bad opcode %u\n", INSTR_OP(ins));
+            return VM_RUNTIME_ERROR;
+        }
+    }
+#endif
+
+type_error:
+    fprintf(stderr, "[vm] Operands must be numbers (opcode %u)\n", INSTR_OP(ins));
+    return VM_RUNTIME_ERROR;
+
+#undef A
+#undef B
+#undef C
+#undef X
+#undef ARITH
+#undef COMPARE
+#undef CASE
+#undef DISPATCH
+}
+
+enum vm_status evaluate(struct vm* vm, const struct ast* ast, struct value* result)
+{
+    struct chunk chunk;
+    chunk_init(&chunk);
+    enum vm_status status = VM_COMPILE_ERROR;
+    if (compile(ast, ast->root, &chunk))
+        status = vm_run(vm, &chunk, result);
+    chunk_free(&chunk);
+    return status;
+}
@@ -0,0 +1,52 @@
+#ifndef TS_VM_H
+#define TS_VM_H
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+#include "value.h"
+
+struct ast;
+
+enum vm_status
+{
+    VM_OK,
+    VM_COMPILE_ERROR,
+    VM_RUNTIME_ERROR,
+};
+
+struct vm
+{
+    struct value registers[VM_MAX_REGISTERS];
+    // vm_free() releases this with ts_free(), so a host that fills it in
+    // itself allocates it with ts_calloc().
+    struct value* globals;
+    uint32_t global_count;
+    // The script's declared variables (see compiler.h); they only live for
+    // one run and start out nil.
+    struct value* locals;
+    uint32_t local_count;
+    struct ts_list* objects;
+    uint32_t object_count;
+    uint32_t next_collect;
+    // Bytes of element storage held by the lists; a packed list can be large
+    // on its own, so this triggers a collection too.
+    size_t element_bytes;
+    size_t next_collect_bytes;
+};
+
+void vm_init(struct vm* vm);
+void vm_free(struct vm* vm);
+// Frees every list not reachable from the globals, locals or registers.
+void vm_collect(struct vm* vm);
+// A list of `count` numbers, stored packed, for a host to hand data to a
+// script through a global. Like any list it is reclaimed once unreachable,
+// so store it in a global before creating the next one.
+struct value vm_number_list(struct vm* vm, const double* numbers, uint32_t count);
+// Globals persist across runs on the same VM. Lists reachable from the result
+// stay valid until the next vm_run() or vm_free().
+enum vm_status vm_run(struct vm* vm, const struct chunk* chunk, struct value* result);
+
+// Compiles and runs the AST's program; the result is the value of the last
+// statement executed. Its variables must have been resolved (resolve.h).
+enum vm_status evaluate(struct vm* vm, const struct ast* ast, struct value* result);
+#endif